@@ -0,0 +1,125 @@
+//
+// Created by Renatus Madrigal on 6/17/2025.
+//
+
+// Accuracy versus time of the FMM and Barnes-Hut gravity against the direct
+// sum. Usage: FMMBenchmark [bodies] [threads]
+
+#include "phosphorus/phosphorus.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numbers>
+#include <random>
+#include <vector>
+
+using namespace phosphorus;
+using std::cout;
+using std::vector;
+
+using Clock = std::chrono::steady_clock;
+
+template <typename System> void pushPlummerSphere(System &system, size_t n) {
+  // A Plummer sphere is clustered in the center, which is a harder case for
+  // the tree methods than a uniform cloud.
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<> uniform(0, 1);
+  const double scale = 1.0_au;
+  const double mass = Constants::M / static_cast<double>(n);
+  for (size_t i = 0; i < n; ++i) {
+    auto radius = scale / std::sqrt(std::pow(uniform(gen), -2.0 / 3.0) - 1);
+    auto cos_theta = 2 * uniform(gen) - 1;
+    auto sin_theta = std::sqrt(1 - cos_theta * cos_theta);
+    auto phi = 2 * std::numbers::pi * uniform(gen);
+    system.pushParticle(CommonParticle(mass, 0),
+                        Cartesian3D{radius * sin_theta * std::cos(phi),
+                                    radius * sin_theta * std::sin(phi),
+                                    radius * cos_theta},
+                        Cartesian3D::Vector{});
+  }
+}
+
+// Time one force evaluation, and return the accelerations it produced. The
+// first step of a fresh system evaluates the forces twice, once to start and
+// once after the drift, so the time is divided by the evaluations counted.
+template <typename System>
+vector<double> evaluate(System &system, double &seconds) {
+  const auto evaluations = system.forceEvaluations();
+  auto start = Clock::now();
+  system.step(0.0);
+  seconds = std::chrono::duration<double>(Clock::now() - start).count() /
+            static_cast<double>(system.forceEvaluations() - evaluations);
+
+  vector<double> result;
+  result.reserve(3 * system.size());
+  for (auto &&elem : system) {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      result.push_back(elem.acceleration[axis]);
+    }
+  }
+  return result;
+}
+
+double relativeRmsError(const vector<double> &actual,
+                        const vector<double> &expected) {
+  double error = 0, norm = 0;
+  for (size_t i = 0; i < actual.size(); ++i) {
+    error += (actual[i] - expected[i]) * (actual[i] - expected[i]);
+    norm += expected[i] * expected[i];
+  }
+  return std::sqrt(error / norm);
+}
+
+void report(const char *method, const char *parameter, double seconds,
+            double direct_seconds, double error) {
+  cout << std::left << std::setw(12) << method << std::setw(14) << parameter
+       << std::right << std::setw(12) << std::fixed << std::setprecision(4)
+       << seconds << std::setw(10) << std::setprecision(1)
+       << direct_seconds / seconds << "x" << std::setw(14)
+       << std::scientific << std::setprecision(3) << error << '\n';
+}
+
+int main(int argc, char *argv[]) {
+  const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+  const ParallelConfig parallel{
+      .num_threads = argc > 2 ? std::atoi(argv[2]) : 0};
+
+  cout << "Bodies: " << n << ", threads: " << parallel.threads() << "\n\n";
+  cout << std::left << std::setw(12) << "Method" << std::setw(14)
+       << "Parameter" << std::right << std::setw(12) << "Time (s)"
+       << std::setw(11) << "Speedup" << std::setw(14) << "Error" << '\n';
+
+  GravityIntegrator<Cartesian3D, CommonParticle> direct(parallel);
+  pushPlummerSphere(direct, n);
+  double direct_seconds;
+  auto expected = evaluate(direct, direct_seconds);
+  report("Direct", "-", direct_seconds, direct_seconds, 0);
+
+  for (double theta : {0.8, 0.5, 0.3}) {
+    BarnesHutGravityIntegrator<Cartesian3D, CommonParticle> tree(theta,
+                                                                 parallel);
+    pushPlummerSphere(tree, n);
+    double seconds;
+    auto actual = evaluate(tree, seconds);
+    auto parameter = "theta=" + std::to_string(theta).substr(0, 3);
+    report("Barnes-Hut", parameter.c_str(), seconds, direct_seconds,
+           relativeRmsError(actual, expected));
+  }
+
+  for (size_t order : {2, 4, 6, 8, 10}) {
+    FMMGravityIntegrator<Cartesian3D, CommonParticle> fmm(
+        order, FMMGravityIntegrator<Cartesian3D, CommonParticle>::
+                   kDefaultOpeningAngle,
+        parallel);
+    pushPlummerSphere(fmm, n);
+    double seconds;
+    auto actual = evaluate(fmm, seconds);
+    auto parameter = "order=" + std::to_string(order);
+    report("FMM", parameter.c_str(), seconds, direct_seconds,
+           relativeRmsError(actual, expected));
+  }
+
+  return 0;
+}
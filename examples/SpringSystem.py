@@ -23,8 +23,9 @@ def calc(step: float):
 
 
 def plot_error():
-    step = np.array([0.1 ** i for i in range(1, 6)])
-    errors = np.array([res[-1] for res in [calc(s) for s in step]])
+    # All the step sizes run in one process, see SpringSystemSweep.cpp.
+    subprocess.run(['SpringSystemSweep.exe'])
+    step, errors = np.loadtxt("sweep.txt", usecols=(0, 1), unpack=True)
     p_step = -np.log10(step)
     p_errors = -np.log10(errors)
     plt.plot(p_step, p_errors, label="Error", color="purple")
@@ -0,0 +1,52 @@
+//
+// Created by Renatus Madrigal on 7/01/2025.
+//
+
+// The error of the spring system of SpringSystem.cpp against the step size,
+// for all the step sizes at once. The table is written to sweep.txt, which
+// SpringSystem.py plots.
+
+#include "phosphorus/phosphorus.h"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numbers>
+
+using namespace phosphorus;
+
+int main() {
+  static constexpr auto k = 1.0;
+  static constexpr auto m = 1.0;
+  static constexpr auto v0 = 1.0;
+  const auto omega = std::sqrt(k / m);
+  const auto A = v0 / omega;
+
+  ParameterGrid grid;
+  grid.add("step", {1e-1, 1e-2, 1e-3, 1e-4, 1e-5});
+
+  auto table = EnsembleRunner(grid).run([&](const Parameters &parameters) {
+    const auto step = parameters["step"];
+    auto force = [](Cartesian3D pos, CommonParticle part) {
+      return Cartesian3D::Vector{-pos[0] * k * part.mass(), 0, 0};
+    };
+    auto system = FieldVerletIntegrator(LambdaField(force));
+    auto it = system.pushParticle(CommonParticle{m, 0}, Cartesian3D{0, 0, 0},
+                                  Vector{v0, 0, 0});
+
+    EnsembleMetrics metrics;
+    const auto n = static_cast<size_t>(2 * std::numbers::pi / (omega * step));
+    for (size_t i = 0; i <= n; ++i) {
+      const auto x = it->position[0];
+      const auto v = it->velocity[0];
+      const auto expected = A * std::sin(omega * step * i);
+      metrics.observe(x - expected, 0.5 * m * v * v + 0.5 * k * x * x);
+      system.step(step);
+    }
+    return metrics;
+  });
+
+  table.write(std::cout);
+  std::ofstream file("sweep.txt");
+  table.write(file);
+  return 0;
+}
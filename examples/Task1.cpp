@@ -40,7 +40,7 @@ int main(int argc, char *argv[]) {
   auto initial_velocity = Vector{v0, 0};
   auto particle = CommonParticle{m, 0};
 
-  auto it = system.pushParticle(particle, initial_position, initial_velocity);
+  system.pushParticle(particle, initial_position, initial_velocity);
 
   auto expect_position = [&](double time) {
     return Cartesian2D{A * sin(omega * time), 0};
@@ -55,17 +55,14 @@ int main(int argc, char *argv[]) {
   constexpr double pi = 3.14159265358979323846;
   auto n = static_cast<size_t>(2 * pi / (omega * step));
 
-  vector<double> time_points;
-  vector<double> positions;
+  TrajectoryRecorder recorder(system);
+  recorder.reserve(n + 1);
   vector<double> expected_positions;
-  vector<Cartesian2D> points;
 
   auto start = chrono::high_resolution_clock::now();
 
   for (auto i = 0; i <= n; ++i) {
-    time_points.emplace_back(i * step);
-    positions.emplace_back(it->position[0]);
-    points.emplace_back(it->position);
+    recorder.observe();
     expected_positions.emplace_back(expect_position(i * step)[0]);
     system.step(step);
   }
@@ -79,13 +76,18 @@ int main(int argc, char *argv[]) {
   // Only generate animation if step is significant
   if (step >= 0.005) {
     AnimateGenerator animator("SpringSystem", 4);
-    animator.generate("SpringSystem", points, 30);
+    animator.pushPoints(recorder.positions(0, 0), recorder.positions(0, 1));
+    animator.generate("SpringSystem", 30);
     cout << "Animation generated successfully!\n";
   }
 
   // verlet position - expected position
-  auto error = views::zip(positions, expected_positions) |
-               views::transform([](auto p) { return p.first - p.second; }) |
+  auto time_points = recorder.times();
+  auto positions = recorder.positions(0, 0);
+  auto error = views::iota(size_t{0}, positions.size()) |
+               views::transform([&](size_t i) {
+                 return positions[i] - expected_positions[i];
+               }) |
                ranges::to<vector<double>>();
 
   Gnuplot plotter;
@@ -57,13 +57,14 @@ int main(int argc, char *argv[]) {
   auto step = DAY / 2;                 // 1/4 of a day per step
   auto n = static_cast<int>(T / step); // One year in steps
 
-  vector<Cartesian2D> result;
+  TrajectoryRecorder recorder(system);
+  recorder.reserve(n);
   vector<double> energy;
 
   auto start = chrono::high_resolution_clock::now();
 
   for (auto i = 0; i < n; ++i) {
-    result.push_back(earth_it->position);
+    recorder.observe();
     auto potential_energy = -G * M * earth_it->particle.mass() /
                             earth_it->position.toCartesian().norm();
     auto kinetic_energy = 0.5 * earth_it->particle.mass() * earth_it->velocity *
@@ -78,20 +79,10 @@ int main(int argc, char *argv[]) {
   cout << format("Simulation completed in {} ms\n", duration);
 
   AnimateGenerator animator("Earth", 4);
-  animator.generate("EarthOrbit", result, 60);
+  animator.pushPoints(recorder.positions(0, 0), recorder.positions(0, 1));
+  animator.generate("EarthOrbit", 60);
   cout << "Animation generated: EarthOrbit\n";
 
-  vector<double> x = result |
-                     views::transform([](const auto &p) { return p[0]; }) |
-                     to<std::vector<double>>();
-  vector<double> y = result |
-                     views::transform([](const auto &p) { return p[1]; }) |
-                     to<std::vector<double>>();
-
-  vector<double> times = views::iota(0, n) |
-                         views::transform([step](int i) { return i * step; }) |
-                         to<std::vector<double>>();
-
   Gnuplot plotter;
   plotter
       .setFigureConfig({
@@ -102,8 +93,8 @@ int main(int argc, char *argv[]) {
           .grid = true,
       })
       .plot({
-          .x = x,
-          .y = y,
+          .x = recorder.positions(0, 0),
+          .y = recorder.positions(0, 1),
           .with = Gnuplot::PlotConfig::PlotType::Lines,
           .style = "lt 1 lw 2 notitle",
       })
@@ -120,7 +111,7 @@ int main(int argc, char *argv[]) {
   Gnuplot plotter2;
   plotter2.setFigureConfig({.grid = true})
       .plot({
-          .x = times,
+          .x = recorder.times(),
           .y = energy_deviation,
           .with = Gnuplot::PlotConfig::PlotType::Lines,
           .title = "Energy Deviation (%)",
@@ -5,12 +5,11 @@
 #include "phosphorus/phosphorus.h"
 #include <format>
 #include <iostream>
-#include <range/v3/all.hpp>
+#include <span>
 
 #define SCI_CONST static constexpr double
 
 using namespace phosphorus;
-using namespace ranges;
 using std::cout;
 using std::format;
 using std::string;
@@ -73,34 +72,42 @@ Config config2 = {
     .n = 730,
 };
 
+// A recorded column of positions, read in astronomical units.
+template <typename Column> struct InAU {
+  Column column;
+
+  [[nodiscard]] size_t size() const { return column.size(); }
+  void read(size_t offset, std::span<double> out) const {
+    column.read(offset, out);
+    for (auto &value : out) {
+      value /= Constants::AU;
+    }
+  }
+};
+
 int main() {
-  using IntegratorType = GravityIntegrator<Cartesian2D, CommonParticle>;
-  using Iter = IntegratorType::iterator;
   GravityIntegrator<Cartesian2D, CommonParticle> system;
 
   const Config &config = config1; // Change to config2 for the second test
   auto step = config.step;
   auto n = config.n;
 
-  vector<Iter> part_its;
   for (auto &&particle : config.particles) {
-    Iter it = system.pushParticle(particle.particle, particle.position,
-                                  particle.velocity);
-    part_its.push_back(it);
+    system.pushParticle(particle.particle, particle.position,
+                        particle.velocity);
   }
 
-  vector<vector<Cartesian2D>> result(config.particles.size());
+  TrajectoryRecorder recorder(system);
+  recorder.reserve(n);
 
   for (auto i = 0; i < n; ++i) {
-    for (auto &&[it, result_it] : views::zip(part_its, result)) {
-      result_it.push_back(it->position);
-    }
+    recorder.observe();
     system.step(step);
   }
 
   AnimateGenerator animator("ThreeBodySystem", 4);
-  for (auto &&result_it : result) {
-    animator.pushPoints(result_it);
+  for (size_t i = 0; i < config.particles.size(); ++i) {
+    animator.pushPoints(recorder.positions(i, 0), recorder.positions(i, 1));
   }
   try {
     animator.generate("ThreeBodySystem", 60);
@@ -115,22 +122,10 @@ int main() {
       .grid = true,
   });
 
-  vector<vector<double>> x_data(config.particles.size());
-  vector<vector<double>> y_data(config.particles.size());
-
-  for (auto &&[i, result_it] : views::enumerate(result)) {
-    x_data[i] =
-        result_it |
-        views::transform([](const auto &p) { return p[0] / Constants::AU; }) |
-        to<std::vector<double>>();
-    y_data[i] =
-        result_it |
-        views::transform([](const auto &p) { return p[1] / Constants::AU; }) |
-        to<std::vector<double>>();
-
+  for (size_t i = 0; i < config.particles.size(); ++i) {
     plot.plot({
-        .x = x_data[i],
-        .y = y_data[i],
+        .x = InAU{recorder.positions(i, 0)},
+        .y = InAU{recorder.positions(i, 1)},
         .with = Gnuplot::PlotConfig::PlotType::Lines,
         .title = format("Particle {} (AU)", i + 1),
     });
@@ -6,6 +6,7 @@
 #define PHOSPHORUS_INCLUDE_PHOSPHORUS_ANIMATE_H
 
 #include "phosphorus/Coordinate.h"
+#include "phosphorus/DataColumn.h"
 #include <boost/asio.hpp>
 #include <opencv2/videoio.hpp>
 #include <random>
@@ -32,12 +33,23 @@ public:
     point_list_.emplace_back(points);
   }
 
+  // Add a trajectory given by its coordinates, e.g. the columns of a
+  // TrajectoryRecorder or a TrajectoryFileReader. The columns must have the
+  // same size.
+  void pushPoints(DataColumn x, DataColumn y) {
+    column_list_.emplace_back(std::move(x), std::move(y));
+  }
+
   void generate(const std::string &filename, double time);
 
 private:
   void setup();
   void blockWorkflow();
   void generateDatafile(std::span<Cartesian2D> points);
+  void generateDatafile(const DataColumn &x, const DataColumn &y);
+  [[nodiscard]] size_t trajectoryCount() const {
+    return point_list_.size() + column_list_.size();
+  }
   void generateKeyframeBlock(int start, int end);
   void mergeBlock(const std::vector<cv::Mat> &keyframes, int start,
                   int end) const;
@@ -65,6 +77,7 @@ private:
   std::string current_temp_;
   std::unique_ptr<cv::VideoWriter> writer_;
   std::vector<std::span<Cartesian2D>> point_list_;
+  std::vector<std::pair<DataColumn, DataColumn>> column_list_;
   int interpolation_steps_ = 0; // Default interpolation steps
   double min_x = 0, max_x = 0, min_y = 0, max_y = 0, min_z = 0, max_z = 0;
 };
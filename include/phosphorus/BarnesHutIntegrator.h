@@ -0,0 +1,205 @@
+//
+// Created by Renatus Madrigal on 6/16/2025.
+//
+
+/**
+ * @file BarnesHutIntegrator.h
+ * @brief Verlet integrator with Barnes-Hut tree gravity.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_BARNESHUTINTEGRATOR_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_BARNESHUTINTEGRATOR_H
+
+#include "phosphorus/Parallel.h"
+#include "phosphorus/ScitificConstants.h"
+#include "phosphorus/SpatialTree.h"
+#include "phosphorus/VerletIntegrator.h"
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief Verlet integrator for particle simulation with Barnes-Hut gravity.
+ * @details Every force evaluation builds a quadtree (2D) or an octree (3D) over
+ * the particles. A cell whose size seen from a particle is smaller than the
+ * opening angle is replaced by its total mass at its center of mass, which
+ * brings the cost of a step down to O(N log N). An opening angle of 0 opens
+ * every cell, which reproduces the direct sum of GravityIntegrator.
+ *
+ * It takes the same template parameters as GravityIntegrator, so the two can
+ * be exchanged by changing the type.
+ * @tparam Coord The Cartesian coordinate system used for the simulation.
+ * @tparam ParticleType The Particle type to be integrated.
+ */
+template <typename Coord, typename ParticleType>
+class BarnesHutGravityIntegrator
+    : public BaseVerletIntegrator<
+          BarnesHutGravityIntegrator<Coord, ParticleType>, Coord,
+          ParticleType> {
+  using Base =
+      BaseVerletIntegrator<BarnesHutGravityIntegrator, Coord, ParticleType>;
+  friend Base;
+
+public:
+  using Base::Base;
+  using TimeType = typename Base::TimeType;
+  using CoordinateVec = typename Base::CoordinateVec;
+  using Vector = typename Base::Vector;
+  using iterator = typename Base::iterator;
+  using Scalar = typename Base::Scalar;
+  using Tree = SpatialTree<Base::kDimension, Scalar>;
+
+  static constexpr size_t kDimension = Base::kDimension;
+  static constexpr double kGravityConstant = Constants::G;
+  static constexpr double kDefaultOpeningAngle = 0.5;
+  static constexpr size_t kDefaultLeafSize = 8;
+
+  BarnesHutGravityIntegrator() = default;
+
+  explicit BarnesHutGravityIntegrator(double opening_angle,
+                                      const ParallelConfig &parallel = {})
+      : opening_angle_(opening_angle), parallel_(parallel) {}
+
+  /**
+   * @brief Set the opening angle theta.
+   * @details A cell of side s whose center of mass is at distance d is used
+   * as a whole when d > s / theta + delta, where delta is the offset between
+   * the center of mass and the center of the cell. Smaller angles are more
+   * accurate and more expensive.
+   */
+  void setOpeningAngle(double opening_angle) {
+    opening_angle_ = opening_angle;
+  }
+  [[nodiscard]] double openingAngle() const { return opening_angle_; }
+
+  /**
+   * @brief Set the number of particles below which a cell is not split.
+   */
+  void setLeafSize(size_t leaf_size) { leaf_size_ = leaf_size; }
+  [[nodiscard]] size_t leafSize() const { return leaf_size_; }
+
+  void setParallelConfig(const ParallelConfig &parallel) {
+    parallel_ = parallel;
+  }
+  [[nodiscard]] const ParallelConfig &parallelConfig() const {
+    return parallel_;
+  }
+
+  /**
+   * @brief The tree built by the last force evaluation.
+   */
+  [[nodiscard]] const Tree &tree() const { return tree_; }
+
+private:
+  using AccelerationSpan = typename Base::AccelerationSpan;
+  using Index = typename Tree::Index;
+
+  void computeAccelerationsImpl(AccelerationSpan acc) const {
+    const auto &storage = this->storage_;
+    const auto n = storage.size();
+    tree_.build(storage.positionComponents(), storage.masses(), leaf_size_,
+                parallel_);
+    if (n == 0) {
+      return;
+    }
+
+    const auto &nodes = tree_.nodes();
+    open_distance2_.resize(nodes.size());
+    parallelFor(parallel_, nodes.size(), [&](size_t k) {
+      const auto &node = nodes[k];
+      if (opening_angle_ <= 0) {
+        open_distance2_[k] = std::numeric_limits<Scalar>::infinity();
+        return;
+      }
+      Scalar offset2 = 0;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        auto d = node.com[axis] - node.center[axis];
+        offset2 += d * d;
+      }
+      auto distance = 2 * node.half_size / opening_angle_ + std::sqrt(offset2);
+      open_distance2_[k] = distance * distance;
+    });
+
+    // Neighbouring particles in tree order walk nearly the same cells, so the
+    // walk runs in tree order and scatters to the original indices.
+    const auto order = tree_.order();
+    const auto masses = tree_.masses().data();
+    std::array<const Scalar *, kDimension> positions;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      positions[axis] = tree_.positions(axis).data();
+    }
+
+    parallelFor(parallel_, n, [&](size_t target) {
+      Scalar pos[kDimension];
+      Scalar result[kDimension] = {};
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        pos[axis] = positions[axis][target];
+      }
+
+      auto interact = [&](const Scalar *source, Scalar mass) {
+        Scalar d[kDimension];
+        Scalar distance2 = 0;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          d[axis] = source[axis] - pos[axis];
+          distance2 += d[axis] * d[axis];
+        }
+        if (distance2 > 0) {
+          auto inv_distance = 1.0 / std::sqrt(distance2);
+          auto factor = kGravityConstant * mass * inv_distance * inv_distance *
+                        inv_distance;
+          for (size_t axis = 0; axis < kDimension; ++axis) {
+            result[axis] += factor * d[axis];
+          }
+        }
+      };
+
+      Index k = 0;
+      const auto node_count = static_cast<Index>(nodes.size());
+      while (k < node_count) {
+        const auto &node = nodes[k];
+        Scalar distance2 = 0;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          auto d = node.com[axis] - pos[axis];
+          distance2 += d * d;
+        }
+
+        if (distance2 > open_distance2_[k]) {
+          interact(node.com.data(), node.mass);
+          k += node.subtree_size;
+        } else if (node.isLeaf()) {
+          for (auto j = node.begin; j < node.end; ++j) {
+            if (j == target)
+              continue; // Skip self
+            Scalar source[kDimension];
+            for (size_t axis = 0; axis < kDimension; ++axis) {
+              source[axis] = positions[axis][j];
+            }
+            interact(source, masses[j]);
+          }
+          ++k;
+        } else {
+          ++k; // Open the cell: its first child follows it
+        }
+      }
+
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        acc[axis][order[target]] = result[axis];
+      }
+    });
+  }
+
+  double opening_angle_ = kDefaultOpeningAngle;
+  size_t leaf_size_ = kDefaultLeafSize;
+  ParallelConfig parallel_;
+
+  // Rebuilt on every force evaluation, kept to reuse the allocations.
+  mutable Tree tree_;
+  mutable std::vector<Scalar> open_distance2_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_BARNESHUTINTEGRATOR_H
@@ -0,0 +1,349 @@
+//
+// Created by Renatus Madrigal on 7/02/2025.
+//
+
+/**
+ * @file BatchIntegrator.h
+ * @brief Steps a batch of small, independent systems together, one system per
+ * SIMD lane.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_BATCHINTEGRATOR_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_BATCHINTEGRATOR_H
+
+#include "phosphorus/Coordinate.h"
+#include "phosphorus/Field.h"
+#include "phosphorus/Particle.h"
+#include "phosphorus/ParticleStorage.h"
+#include "phosphorus/SymplecticScheme.h"
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+namespace phosphorus {
+
+/**
+ * @brief Verlet integrator for kLanes copies of a small system in an external
+ * field, e.g. the members of a sweep of spring constants or step sizes.
+ * @details A system of one to three particles is too small for the loops of
+ * FieldVerletIntegrator to vectorize, and stepping many of them one after the
+ * other spends most of the time on loop overhead. Here the systems are laid
+ * out side by side instead: the particles are kept in a ParticleStorage in
+ * which particle p of system s is at index p * kLanes + s, so every component
+ * of a position, velocity or acceleration of a particle is a run of kLanes
+ * scalars, one per system. The kick and drift loops run over these runs with
+ * a constant trip count, and compile to straight vector code.
+ *
+ * Every system, or lane, has its own field, which is a copy of the same
+ * field or one of an array of fields, e.g. LambdaFields of one lambda with
+ * different captured constants, its own initial conditions and its own time
+ * step. The systems have the same particles, in the sense that a particle
+ * pushed into the batch is pushed into every lane; its state can then be
+ * changed lane by lane.
+ * @tparam Field The force field, as for FieldVerletIntegrator.
+ * @tparam Coord The coordinate system used for the simulation.
+ * @tparam ParticleType The type of the particles.
+ * @tparam kLanes The number of systems. 8 fills an AVX-512 register, or two
+ * AVX2 registers, of doubles.
+ * @tparam Scheme The splitting scheme of a step, see SymplecticScheme.h.
+ */
+template <typename Field, typename Coord, typename ParticleType,
+          size_t kLanes = 8, typename Scheme = VelocityVerlet>
+  requires IsCoordinateVec<Coord> && Massive<ParticleType> &&
+           SymplecticScheme<Scheme> && (kLanes > 0)
+class BatchFieldVerletIntegrator {
+public:
+  using TimeType = double;
+  using CoordinateVec = Coord;
+  using Vector = typename CoordinateVec::Vector;
+  using Scalar = typename CoordinateVec::Scalar;
+  using Storage = ParticleStorage<CoordinateVec, ParticleType>;
+  using SchemeType = Scheme;
+  using Fields = std::array<Field, kLanes>;
+  using LaneTimes = std::array<TimeType, kLanes>;
+
+  static constexpr size_t kDimension = CoordinateVec::dimension();
+
+  static constexpr size_t lanes() { return kLanes; }
+
+  /**
+   * @brief Every lane in a copy of the same field.
+   */
+  explicit BatchFieldVerletIntegrator(const Field &field)
+      : fields_(replicate(field, std::make_index_sequence<kLanes>{})) {}
+
+  /**
+   * @brief Lane s in fields[s].
+   */
+  explicit BatchFieldVerletIntegrator(const Fields &fields)
+      : fields_(fields) {}
+
+  [[nodiscard]] const Field &field(size_t lane) const {
+    return fields_.at(lane);
+  }
+
+  /**
+   * @brief Modify the field of a lane between steps, as
+   * FieldVerletIntegrator::modifyField.
+   * @return What func(field) returns.
+   */
+  template <typename Func>
+    requires std::invocable<Func, Field &>
+  decltype(auto) modifyField(size_t lane, Func &&func) {
+    auto &field = fields_.at(lane);
+    accelerations_valid_ = false;
+    return std::invoke(std::forward<Func>(func), field);
+  }
+
+  /**
+   * @brief Add a particle with the same state to every lane.
+   * @return The index of the particle in each system.
+   */
+  size_t pushParticle(const ParticleType &particle,
+                      const CoordinateVec &position, const Vector &velocity) {
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+      storage_.push(particle, position, velocity, Vector{});
+    }
+    accelerations_valid_ = false;
+    return count() - 1;
+  }
+
+  /**
+   * @brief The number of particles of each system.
+   */
+  [[nodiscard]] size_t count() const { return storage_.size() / kLanes; }
+
+  [[nodiscard]] CoordinateVec position(size_t particle, size_t lane) const {
+    return storage_.position(index(particle, lane));
+  }
+  [[nodiscard]] Vector velocity(size_t particle, size_t lane) const {
+    return storage_.velocity(index(particle, lane));
+  }
+  [[nodiscard]] const ParticleType &particle(size_t particle,
+                                             size_t lane) const {
+    return storage_.particle(index(particle, lane));
+  }
+
+  void setPosition(size_t particle, size_t lane,
+                   const CoordinateVec &position) {
+    storage_.setPosition(index(particle, lane), position);
+    accelerations_valid_ = false;
+  }
+  void setVelocity(size_t particle, size_t lane, const Vector &velocity) {
+    storage_.setVelocity(index(particle, lane), velocity);
+  }
+  void setParticle(size_t particle, size_t lane,
+                   const ParticleType &value) {
+    storage_.setParticle(index(particle, lane), value);
+    accelerations_valid_ = false;
+  }
+
+  /**
+   * @brief One component of the raw position or velocity of a particle in
+   * every lane.
+   */
+  [[nodiscard]] std::span<const Scalar, kLanes> positions(size_t particle,
+                                                          size_t axis) const {
+    return lanesOf(storage_.positions(axis), particle);
+  }
+  [[nodiscard]] std::span<const Scalar, kLanes>
+  velocities(size_t particle, size_t axis) const {
+    return lanesOf(storage_.velocities(axis), particle);
+  }
+
+  [[nodiscard]] const Storage &storage() const { return storage_; }
+
+  /**
+   * @brief Advance every lane by one step of the scheme, of the same dt.
+   */
+  void step(TimeType dt) {
+    LaneTimes steps;
+    steps.fill(dt);
+    step(steps);
+  }
+
+  /**
+   * @brief Advance lane s by one step of dt[s].
+   */
+  void step(const LaneTimes &dt) {
+    prepareStep();
+    if constexpr (std::same_as<Scheme, VelocityVerlet>) {
+      advance(dt);
+    } else {
+      advanceComposed(dt);
+    }
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+      times_[lane] += dt[lane];
+    }
+  }
+
+  /**
+   * @brief The simulation time of a lane, advanced by step.
+   */
+  [[nodiscard]] TimeType time(size_t lane) const { return times_.at(lane); }
+  [[nodiscard]] const LaneTimes &times() const { return times_; }
+
+  /**
+   * @brief The number of batched force evaluations since the construction,
+   * each of which covers every lane.
+   */
+  [[nodiscard]] size_t forceEvaluations() const { return force_evaluations_; }
+
+private:
+  template <size_t... kIndices>
+  static Fields replicate(const Field &field,
+                          std::index_sequence<kIndices...>) {
+    return {((void)kIndices, field)...};
+  }
+
+  [[nodiscard]] size_t index(size_t particle, size_t lane) const {
+    if (particle >= count() || lane >= kLanes) {
+      throw std::out_of_range("No such particle or lane");
+    }
+    return particle * kLanes + lane;
+  }
+
+  [[nodiscard]] std::span<const Scalar, kLanes>
+  lanesOf(std::span<const Scalar> components, size_t particle) const {
+    return components.subspan(index(particle, 0)).template first<kLanes>();
+  }
+
+  void prepareStep() {
+    const auto n = storage_.size();
+    for (auto &buffer : previous_acceleration_) {
+      if (buffer.size() < n) {
+        buffer.resize(n);
+      }
+    }
+    if (!accelerations_valid_) {
+      evaluateAccelerations();
+      accelerations_valid_ = true;
+    }
+  }
+
+  void evaluateAccelerations() {
+    const auto &storage = storage_;
+    const auto particles = storage.particles();
+    const auto masses = storage.masses();
+    std::array<const Scalar *, kDimension> x;
+    std::array<Scalar *, kDimension> a;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      x[axis] = storage.positions(axis).data();
+      a[axis] = storage_.accelerations(axis).data();
+    }
+    for (size_t p = 0; p < count(); ++p) {
+      const auto base = p * kLanes;
+      for (size_t lane = 0; lane < kLanes; ++lane) {
+        const auto i = base + lane;
+        Vector position;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          position[axis] = x[axis][i];
+        }
+        const auto force = fields_[lane].evaluate(
+            CoordinateVec::fromVector(position), particles[i]);
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          a[axis][i] = force[axis] / masses[i];
+        }
+      }
+    }
+    ++force_evaluations_;
+  }
+
+  // The same arithmetic as BaseVerletIntegrator, with the step of the lane.
+  void advance(const LaneTimes &dt) {
+    const auto n = count();
+
+    // Drift: x += v * dt + a * dt^2 / 2
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      auto x = storage_.positions(axis).data();
+      auto v = storage_.velocities(axis).data();
+      auto a = storage_.accelerations(axis).data();
+      auto prev = previous_acceleration_[axis].data();
+      for (size_t p = 0; p < n; ++p) {
+        const auto base = p * kLanes;
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+          const auto i = base + lane;
+          x[i] += v[i] * dt[lane] + 0.5 * a[i] * dt[lane] * dt[lane];
+          prev[i] = a[i];
+        }
+      }
+    }
+
+    evaluateAccelerations();
+
+    // Kick: v += (a_prev + a) * dt / 2
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      auto v = storage_.velocities(axis).data();
+      auto a = storage_.accelerations(axis).data();
+      auto prev = previous_acceleration_[axis].data();
+      for (size_t p = 0; p < n; ++p) {
+        const auto base = p * kLanes;
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+          const auto i = base + lane;
+          v[i] += 0.5 * (prev[i] + a[i]) * dt[lane];
+        }
+      }
+    }
+  }
+
+  void advanceComposed(const LaneTimes &dt) {
+    const auto n = count();
+    auto kick = [&](double coefficient) {
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        auto v = storage_.velocities(axis).data();
+        auto a = storage_.accelerations(axis).data();
+        for (size_t p = 0; p < n; ++p) {
+          const auto base = p * kLanes;
+          for (size_t lane = 0; lane < kLanes; ++lane) {
+            v[base + lane] += a[base + lane] * (coefficient * dt[lane]);
+          }
+        }
+      }
+    };
+    auto drift = [&](double coefficient) {
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        auto x = storage_.positions(axis).data();
+        auto v = storage_.velocities(axis).data();
+        for (size_t p = 0; p < n; ++p) {
+          const auto base = p * kLanes;
+          for (size_t lane = 0; lane < kLanes; ++lane) {
+            x[base + lane] += v[base + lane] * (coefficient * dt[lane]);
+          }
+        }
+      }
+    };
+
+    for (size_t stage = 0; stage < Scheme::kDrifts.size(); ++stage) {
+      kick(Scheme::kKicks[stage]);
+      drift(Scheme::kDrifts[stage]);
+      evaluateAccelerations();
+    }
+    kick(Scheme::kKicks.back());
+  }
+
+  Fields fields_;
+  Storage storage_;
+  std::array<AlignedVector<Scalar>, kDimension> previous_acceleration_;
+  LaneTimes times_{};
+  size_t force_evaluations_ = 0;
+  bool accelerations_valid_ = false;
+};
+
+template <typename Coord, typename ParticleType, typename Func>
+BatchFieldVerletIntegrator(LambdaField<Coord, ParticleType, Func>)
+    -> BatchFieldVerletIntegrator<LambdaField<Coord, ParticleType, Func>,
+                                  Coord, ParticleType>;
+
+template <typename Coord, typename ParticleType, typename Func, size_t kLanes>
+BatchFieldVerletIntegrator(
+    std::array<LambdaField<Coord, ParticleType, Func>, kLanes>)
+    -> BatchFieldVerletIntegrator<LambdaField<Coord, ParticleType, Func>,
+                                  Coord, ParticleType, kLanes>;
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_BATCHINTEGRATOR_H
@@ -0,0 +1,169 @@
+//
+// Created by Renatus Madrigal on 6/27/2025.
+//
+
+/**
+ * @file Checkpoint.h
+ * @brief A versioned binary file format for the state of a simulation.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_CHECKPOINT_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace phosphorus {
+
+/**
+ * @brief The version written by CheckpointWriter. Readers accept this and all
+ * earlier versions.
+ */
+inline constexpr std::uint32_t kCheckpointVersion = 1;
+
+/**
+ * @brief Thrown when a checkpoint cannot be written, read or restored.
+ */
+class CheckpointError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief Writes a checkpoint file as a sequence of tagged sections.
+ * @details The file starts with a 64 byte header: the magic "PHOSCKPT", the
+ * format version and a byte order mark. Every section is a header, holding a
+ * tag of up to 8 characters and the size of the data, padded to 64 bytes,
+ * then the data, padded to a multiple of 64 bytes. So the data of every
+ * section is aligned for any scalar type and for SIMD loads once mapped.
+ *
+ * The arrays of a section are written straight from their memory, one large
+ * write per array. The file is written under a temporary name, and commit
+ * syncs it to the disk before renaming it to its final name, so an
+ * interrupted write or a power loss never replaces an older checkpoint with a
+ * broken one.
+ */
+class CheckpointWriter {
+public:
+  static constexpr size_t kAlignment = 64;
+  static constexpr size_t kTagSize = 8;
+
+  explicit CheckpointWriter(std::filesystem::path path);
+  ~CheckpointWriter();
+
+  CheckpointWriter(const CheckpointWriter &) = delete;
+  CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+  /**
+   * @brief Append a section.
+   * @throws CheckpointError if a tag is longer than kTagSize, was already
+   * written, or the write fails.
+   */
+  void write(std::string_view tag, std::span<const std::byte> data);
+
+  template <typename T>
+    requires std::is_trivially_copyable_v<T>
+  void writeArray(std::string_view tag, std::span<const T> data) {
+    write(tag, std::as_bytes(data));
+  }
+
+  template <typename T>
+    requires std::is_trivially_copyable_v<T>
+  void writeValue(std::string_view tag, const T &value) {
+    writeArray(tag, std::span<const T>(&value, 1));
+  }
+
+  /**
+   * @brief Flush the file, sync it to the disk and move it to its final name.
+   */
+  void commit();
+
+private:
+  void writeBytes(const void *data, size_t size);
+
+  std::filesystem::path path_;
+  std::filesystem::path temporary_;
+  std::FILE *file_ = nullptr;
+  std::map<std::string, size_t, std::less<>> written_;
+};
+
+/**
+ * @brief Maps a checkpoint file into memory and gives access to its
+ * sections without copying them.
+ * @details On POSIX systems the file is mapped with mmap, so only the pages
+ * which are read are loaded, and they come straight from the page cache.
+ * Elsewhere, the file is read into memory in one call.
+ */
+class CheckpointReader {
+public:
+  explicit CheckpointReader(const std::filesystem::path &path);
+  ~CheckpointReader();
+
+  CheckpointReader(CheckpointReader &&) noexcept;
+  CheckpointReader &operator=(CheckpointReader &&) noexcept;
+
+  [[nodiscard]] std::uint32_t version() const { return version_; }
+
+  [[nodiscard]] bool contains(std::string_view tag) const {
+    return sections_.contains(tag);
+  }
+
+  /**
+   * @brief The data of a section.
+   * @throws CheckpointError if there is no such section.
+   */
+  [[nodiscard]] std::span<const std::byte> section(std::string_view tag) const;
+
+  /**
+   * @brief The data of a section, as an array of T.
+   * @throws CheckpointError if there is no such section, or its size is not a
+   * multiple of the size of T.
+   */
+  template <typename T>
+    requires std::is_trivially_copyable_v<T>
+  [[nodiscard]] std::span<const T> array(std::string_view tag) const {
+    const auto data = section(tag);
+    if (data.size() % sizeof(T) != 0) {
+      throw CheckpointError("Checkpoint section " + std::string(tag) +
+                            " has the wrong element size");
+    }
+    return {reinterpret_cast<const T *>(data.data()), data.size() / sizeof(T)};
+  }
+
+  /**
+   * @brief The data of a section which holds a single T.
+   */
+  template <typename T>
+    requires std::is_trivially_copyable_v<T>
+  [[nodiscard]] T value(std::string_view tag) const {
+    const auto data = section(tag);
+    if (data.size() != sizeof(T)) {
+      throw CheckpointError("Checkpoint section " + std::string(tag) +
+                            " has the wrong size");
+    }
+    T result;
+    std::memcpy(&result, data.data(), sizeof(T));
+    return result;
+  }
+
+private:
+  class Mapping;
+
+  std::unique_ptr<Mapping> mapping_;
+  std::uint32_t version_ = 0;
+  std::map<std::string, std::span<const std::byte>, std::less<>> sections_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_CHECKPOINT_H
@@ -0,0 +1,107 @@
+//
+// Created by Renatus Madrigal on 6/30/2025.
+//
+
+/**
+ * @file DataColumn.h
+ * @brief A column of values to plot, which does not need to be in memory.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_DATACOLUMN_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_DATACOLUMN_H
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <ranges>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief A source of values read in pieces, such as a column of a trajectory
+ * file.
+ */
+template <typename Source>
+concept DataColumnSource =
+    requires(const Source &source, size_t offset, std::span<double> out) {
+      { source.size() } -> std::convertible_to<size_t>;
+      source.read(offset, out);
+    };
+
+/**
+ * @brief A column of values, read block by block by its consumers, e.g. the
+ * x or y data of a Gnuplot plot.
+ * @details A column is a view: it refers to a contiguous range, such as a
+ * vector or a span, which must outlive it, or keeps a copy of a
+ * DataColumnSource, which is usually a view itself. Sources are only read one
+ * block at a time, so a column of a trajectory file is never loaded as a
+ * whole.
+ */
+class DataColumn {
+public:
+  static constexpr size_t kBlockSize = 4096;
+
+  DataColumn() = default;
+
+  template <std::ranges::contiguous_range Range>
+    requires std::convertible_to<const Range &, std::span<const double>>
+  DataColumn(const Range &values)
+      : size_(std::ranges::size(values)),
+        read_([values = std::span<const double>(values)](
+                  size_t offset, std::span<double> out) {
+          std::ranges::copy(values.subspan(offset, out.size()), out.begin());
+        }) {}
+
+  // A temporary container would be gone before the column is read.
+  template <std::ranges::contiguous_range Range>
+    requires(!std::ranges::borrowed_range<Range>) &&
+            std::convertible_to<const Range &, std::span<const double>>
+  DataColumn(Range &&values) = delete;
+
+  template <DataColumnSource Source>
+    requires(!std::ranges::contiguous_range<Source>)
+  DataColumn(Source source)
+      : size_(source.size()),
+        read_([source = std::move(source)](size_t offset,
+                                           std::span<double> out) {
+          source.read(offset, out);
+        }) {}
+
+  [[nodiscard]] size_t size() const { return size_; }
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+
+  /**
+   * @brief Copy the values from offset on into out.
+   */
+  void read(size_t offset, std::span<double> out) const {
+    if (!out.empty()) {
+      read_(offset, out);
+    }
+  }
+
+  /**
+   * @brief Call func with the values of the column, in blocks of up to
+   * kBlockSize values.
+   */
+  template <typename Func> void forEachBlock(Func &&func) const {
+    std::vector<double> buffer(std::min(size_, kBlockSize));
+    for (size_t offset = 0; offset < size_; offset += kBlockSize) {
+      const auto block =
+          std::span(buffer).first(std::min(kBlockSize, size_ - offset));
+      read(offset, block);
+      func(std::span<const double>(block));
+    }
+  }
+
+private:
+  size_t size_ = 0;
+  std::function<void(size_t, std::span<double>)> read_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_DATACOLUMN_H
@@ -0,0 +1,330 @@
+//
+// Created by Renatus Madrigal on 7/01/2025.
+//
+
+/**
+ * @file Ensemble.h
+ * @brief Runs many independent simulations over a grid of parameters, e.g.
+ * a sweep of step sizes, and collects one row of metrics for each.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_ENSEMBLE_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_ENSEMBLE_H
+
+#include "phosphorus/Parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <exception>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace phosphorus {
+
+class ParameterGrid;
+
+/**
+ * @brief The parameters of one member of an ensemble: one value of every axis
+ * of the grid. It refers to the grid, which must outlive it.
+ */
+class Parameters {
+public:
+  Parameters(const ParameterGrid &grid, size_t member)
+      : grid_(&grid), member_(member) {}
+
+  /// The index of the member, which is also its row in the results.
+  [[nodiscard]] size_t member() const { return member_; }
+
+  [[nodiscard]] double value(size_t axis) const;
+
+  /**
+   * @throws std::out_of_range if the grid has no such axis.
+   */
+  [[nodiscard]] double operator[](std::string_view name) const;
+
+private:
+  const ParameterGrid *grid_;
+  size_t member_;
+};
+
+/**
+ * @brief The Cartesian product of named lists of values.
+ * @details The members are numbered with the last axis varying fastest, so
+ * the members of a grid with the axes {k, step} are every step for the first
+ * k, then every step for the second k, and so on. A grid without axes has a
+ * single member.
+ */
+class ParameterGrid {
+public:
+  /**
+   * @brief Add an axis.
+   * @throws std::invalid_argument if there is already an axis of that name,
+   * or no values.
+   */
+  ParameterGrid &add(std::string name, std::vector<double> values) {
+    if (values.empty()) {
+      throw std::invalid_argument("Parameter " + name + " has no values");
+    }
+    if (std::ranges::find(names_, name) != names_.end()) {
+      throw std::invalid_argument("Parameter " + name + " is given twice");
+    }
+    names_.push_back(std::move(name));
+    values_.push_back(std::move(values));
+    return *this;
+  }
+
+  [[nodiscard]] size_t axes() const { return names_.size(); }
+
+  [[nodiscard]] size_t size() const {
+    size_t result = 1;
+    for (const auto &values : values_) {
+      result *= values.size();
+    }
+    return result;
+  }
+
+  [[nodiscard]] const std::vector<std::string> &names() const {
+    return names_;
+  }
+
+  [[nodiscard]] std::span<const double> values(size_t axis) const {
+    return values_.at(axis);
+  }
+
+  /**
+   * @throws std::out_of_range if there is no axis of that name.
+   */
+  [[nodiscard]] size_t axis(std::string_view name) const {
+    const auto it = std::ranges::find(names_, name);
+    if (it == names_.end()) {
+      throw std::out_of_range("No parameter " + std::string(name));
+    }
+    return static_cast<size_t>(it - names_.begin());
+  }
+
+  [[nodiscard]] Parameters at(size_t member) const {
+    if (member >= size()) {
+      throw std::out_of_range("No such ensemble member");
+    }
+    return {*this, member};
+  }
+
+  /**
+   * @brief The value of an axis for a member.
+   */
+  [[nodiscard]] double value(size_t member, size_t axis) const {
+    const auto &values = values_.at(axis);
+    for (auto later = axis + 1; later < values_.size(); ++later) {
+      member /= values_[later].size();
+    }
+    return values[member % values.size()];
+  }
+
+private:
+  std::vector<std::string> names_;
+  std::vector<std::vector<double>> values_;
+};
+
+inline double Parameters::value(size_t axis) const {
+  return grid_->value(member_, axis);
+}
+
+inline double Parameters::operator[](std::string_view name) const {
+  return value(grid_->axis(name));
+}
+
+/**
+ * @brief A table of doubles stored by column, with one row per member of an
+ * ensemble.
+ */
+class ResultTable {
+public:
+  ResultTable(std::vector<std::string> names, size_t rows)
+      : names_(std::move(names)),
+        columns_(names_.size(), std::vector<double>(rows)), rows_(rows) {}
+
+  [[nodiscard]] size_t rows() const { return rows_; }
+  [[nodiscard]] size_t columns() const { return columns_.size(); }
+
+  [[nodiscard]] const std::vector<std::string> &names() const {
+    return names_;
+  }
+
+  /**
+   * @throws std::out_of_range if there is no column of that name.
+   */
+  [[nodiscard]] size_t columnIndex(std::string_view name) const {
+    const auto it = std::ranges::find(names_, name);
+    if (it == names_.end()) {
+      throw std::out_of_range("No column " + std::string(name));
+    }
+    return static_cast<size_t>(it - names_.begin());
+  }
+
+  [[nodiscard]] std::span<double> column(size_t index) {
+    return columns_.at(index);
+  }
+
+  [[nodiscard]] std::span<const double> column(size_t index) const {
+    return columns_.at(index);
+  }
+
+  [[nodiscard]] std::span<const double> column(std::string_view name) const {
+    return column(columnIndex(name));
+  }
+
+  /**
+   * @brief Write the table as text: a commented header with the names of the
+   * columns, then one line per row, as numpy.loadtxt and gnuplot read it.
+   */
+  void write(std::ostream &out) const {
+    const auto precision = out.precision(17);
+    out << '#';
+    for (const auto &name : names_) {
+      out << ' ' << name;
+    }
+    out << '\n';
+    for (size_t row = 0; row < rows_; ++row) {
+      for (size_t index = 0; index < columns_.size(); ++index) {
+        out << (index == 0 ? "" : " ") << columns_[index][row];
+      }
+      out << '\n';
+    }
+    out.precision(precision);
+  }
+
+private:
+  std::vector<std::string> names_;
+  std::vector<std::vector<double>> columns_;
+  size_t rows_;
+};
+
+/**
+ * @brief The metrics of one run, reduced while it goes on.
+ * @details The energy drift is the largest deviation of the energy from the
+ * first one observed, relative to it unless it is zero.
+ */
+class EnsembleMetrics {
+public:
+  void observeError(double error) {
+    max_error_ = std::max(max_error_, std::abs(error));
+  }
+
+  void observeEnergy(double energy) {
+    if (energies_++ == 0) {
+      initial_energy_ = energy;
+    }
+    const auto scale =
+        initial_energy_ == 0 ? 1.0 : std::abs(initial_energy_);
+    energy_drift_ =
+        std::max(energy_drift_, std::abs(energy - initial_energy_) / scale);
+  }
+
+  void observe(double error, double energy) {
+    observeError(error);
+    observeEnergy(energy);
+  }
+
+  [[nodiscard]] double maxError() const { return max_error_; }
+  [[nodiscard]] double energyDrift() const { return energy_drift_; }
+
+private:
+  double max_error_ = 0;
+  double energy_drift_ = 0;
+  double initial_energy_ = 0;
+  size_t energies_ = 0;
+};
+
+/**
+ * @brief Runs one simulation for every member of a parameter grid, in
+ * parallel, and collects their metrics.
+ * @details The members run on the threads of the ParallelConfig, which hand
+ * them out one at a time, so short runs do not wait behind long ones, e.g.
+ * the small step sizes of a sweep. The integrators the members build should
+ * keep their own serial ParallelConfig, the default.
+ *
+ * The table holds a column for every axis of the grid, then max_error,
+ * energy_drift and seconds, the wall time of the member. Each member writes
+ * its own row, so the results do not depend on the number of threads.
+ */
+class EnsembleRunner {
+public:
+  /**
+   * @brief All the threads of OpenMP, handing out one member at a time.
+   */
+  static ParallelConfig defaultConfig() {
+    return {.num_threads = 0,
+            .schedule = ParallelConfig::Schedule::Dynamic,
+            .chunk_size = 1};
+  }
+
+  explicit EnsembleRunner(ParameterGrid grid,
+                          ParallelConfig config = defaultConfig())
+      : grid_(std::move(grid)), config_(config) {}
+
+  [[nodiscard]] const ParameterGrid &grid() const { return grid_; }
+
+  /**
+   * @brief Run member(parameters) for every member of the grid.
+   * @details member builds and runs a simulation, and returns its
+   * EnsembleMetrics. It is called concurrently, so it must not share mutable
+   * state between calls.
+   * @throws The exception of the first member which failed, once the others
+   * have finished.
+   */
+  template <typename Member>
+    requires std::convertible_to<
+        std::invoke_result_t<Member &, const Parameters &>, EnsembleMetrics>
+  ResultTable run(Member &&member) const {
+    auto names = grid_.names();
+    for (const auto *metric : {"max_error", "energy_drift", "seconds"}) {
+      names.emplace_back(metric);
+    }
+    const auto members = grid_.size();
+    const auto axes = grid_.axes();
+    ResultTable table(std::move(names), members);
+    std::vector<std::exception_ptr> errors(members);
+
+    parallelFor(config_, members, [&](size_t index) {
+      const auto parameters = grid_.at(index);
+      for (size_t axis = 0; axis < axes; ++axis) {
+        table.column(axis)[index] = parameters.value(axis);
+      }
+      // Exceptions must not leave an OpenMP region.
+      try {
+        const auto start = std::chrono::steady_clock::now();
+        const EnsembleMetrics metrics = member(parameters);
+        const std::chrono::duration<double> seconds =
+            std::chrono::steady_clock::now() - start;
+        table.column(axes)[index] = metrics.maxError();
+        table.column(axes + 1)[index] = metrics.energyDrift();
+        table.column(axes + 2)[index] = seconds.count();
+      } catch (...) {
+        errors[index] = std::current_exception();
+      }
+    });
+
+    for (const auto &error : errors) {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+    return table;
+  }
+
+private:
+  ParameterGrid grid_;
+  ParallelConfig config_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_ENSEMBLE_H
@@ -0,0 +1,145 @@
+//
+// Created by Renatus Madrigal on 6/18/2025.
+//
+
+/**
+ * @file FFT.h
+ * @brief Radix-2 fast Fourier transforms of lines and cubic grids.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_FFT_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_FFT_H
+
+#include "phosphorus/Parallel.h"
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <numbers>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief An in-place complex FFT of a fixed power-of-two length.
+ * @details The bit reversal permutation and the twiddle factors are computed
+ * once by the constructor, so a plan is meant to be reused for many lines.
+ * The forward transform is unnormalized, the inverse transform divides by the
+ * length, so inverse(forward(x)) == x.
+ * @tparam Scalar The floating point type.
+ */
+template <typename Scalar = double> class FFT {
+public:
+  using Complex = std::complex<Scalar>;
+
+  explicit FFT(size_t n = 1) : n_(n) {
+    if (n == 0 || (n & (n - 1)) != 0) {
+      throw std::invalid_argument("FFT length must be a power of two");
+    }
+    size_t bits = 0;
+    while ((size_t{1} << bits) < n) {
+      ++bits;
+    }
+    reversed_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      size_t r = 0;
+      for (size_t bit = 0; bit < bits; ++bit) {
+        r |= ((i >> bit) & 1) << (bits - 1 - bit);
+      }
+      reversed_[i] = r;
+    }
+    twiddles_.resize(n / 2);
+    for (size_t k = 0; k < n / 2; ++k) {
+      auto angle = -2 * std::numbers::pi_v<Scalar> * static_cast<Scalar>(k) /
+                   static_cast<Scalar>(n);
+      twiddles_[k] = {std::cos(angle), std::sin(angle)};
+    }
+  }
+
+  [[nodiscard]] size_t size() const { return n_; }
+
+  void forward(std::span<Complex> data) const { transform(data, false); }
+
+  void inverse(std::span<Complex> data) const {
+    transform(data, true);
+    const auto scale = Scalar{1} / static_cast<Scalar>(n_);
+    for (auto &value : data) {
+      value *= scale;
+    }
+  }
+
+private:
+  void transform(std::span<Complex> data, bool inverse) const {
+    for (size_t i = 0; i < n_; ++i) {
+      if (i < reversed_[i]) {
+        std::swap(data[i], data[reversed_[i]]);
+      }
+    }
+    for (size_t length = 2; length <= n_; length *= 2) {
+      const auto half = length / 2;
+      const auto stride = n_ / length;
+      for (size_t start = 0; start < n_; start += length) {
+        for (size_t k = 0; k < half; ++k) {
+          auto w = twiddles_[k * stride];
+          if (inverse) {
+            w = std::conj(w);
+          }
+          auto &even = data[start + k];
+          auto &odd = data[start + k + half];
+          auto t = w * odd;
+          odd = even - t;
+          even += t;
+        }
+      }
+    }
+  }
+
+  size_t n_;
+  std::vector<size_t> reversed_;
+  std::vector<Complex> twiddles_;
+};
+
+/**
+ * @brief Transform a cubic grid of n^kDimension points in place.
+ * @details The grid is stored in row-major order, the last axis being
+ * contiguous. The lines of every axis are independent and are transformed on
+ * the threads of the configuration.
+ * @param fft A plan whose size is the side of the grid.
+ */
+template <size_t kDimension, typename Scalar>
+void transformGrid(std::span<std::complex<Scalar>> grid, const FFT<Scalar> &fft,
+                   bool inverse, const ParallelConfig &parallel) {
+  using Complex = std::complex<Scalar>;
+  const auto n = fft.size();
+  const auto lines = grid.size() / n;
+  std::vector<std::vector<Complex>> buffers(
+      static_cast<size_t>(parallel.threads()), std::vector<Complex>(n));
+
+  size_t stride = 1;
+  for (size_t axis = kDimension; axis-- > 0; stride *= n) {
+    parallelForThreads(parallel, lines, [&](size_t line, int thread) {
+      // Split the line number into the indices before and after the axis.
+      const auto outer = line / stride;
+      const auto inner = line % stride;
+      const auto base = outer * stride * n + inner;
+      auto &buffer = buffers[thread];
+      for (size_t i = 0; i < n; ++i) {
+        buffer[i] = grid[base + i * stride];
+      }
+      if (inverse) {
+        fft.inverse(buffer);
+      } else {
+        fft.forward(buffer);
+      }
+      for (size_t i = 0; i < n; ++i) {
+        grid[base + i * stride] = buffer[i];
+      }
+    });
+  }
+}
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_FFT_H
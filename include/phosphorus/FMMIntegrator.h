@@ -0,0 +1,444 @@
+//
+// Created by Renatus Madrigal on 6/17/2025.
+//
+
+/**
+ * @file FMMIntegrator.h
+ * @brief Verlet integrator with fast multipole method gravity.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_FMMINTEGRATOR_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_FMMINTEGRATOR_H
+
+#include "phosphorus/Multipole.h"
+#include "phosphorus/Parallel.h"
+#include "phosphorus/ParticleStorage.h"
+#include "phosphorus/ScitificConstants.h"
+#include "phosphorus/SpatialTree.h"
+#include "phosphorus/VerletIntegrator.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief Verlet integrator for particle simulation with fast multipole method
+ * gravity.
+ * @details The force evaluation runs the usual passes of the FMM over the tree
+ * of SpatialTree:
+ *
+ * - Upward: the multipole of every leaf is computed from its particles and
+ *   translated to its ancestors, level by level from the bottom.
+ * - Interactions: a dual tree traversal pairs the cells. Well separated pairs
+ *   exchange their multipoles into local expansions, close pairs of leaves are
+ *   summed directly.
+ * - Downward: the local expansions are translated to the children, level by
+ *   level from the top, and evaluated at the particles of the leaves together
+ *   with the direct near field.
+ *
+ * Every pass runs over the independent cells of one level, or over all the
+ * target cells, on the threads of the ParallelConfig. The coefficients of all
+ * the cells live in one contiguous array in the depth-first order of the tree,
+ * so a subtree is a contiguous block of memory.
+ *
+ * The accuracy is controlled by the expansion order and by the opening angle
+ * theta: two cells are well separated when the sum of their radii is less
+ * than theta times the distance of their centers. The error decreases roughly
+ * as theta^(order + 1). The cost of a translation grows as order^(2D), so
+ * higher orders pay off with larger leaves. The result does not depend on the
+ * number of threads.
+ * @tparam Coord The Cartesian coordinate system used for the simulation.
+ * @tparam ParticleType The Particle type to be integrated.
+ */
+template <typename Coord, typename ParticleType>
+class FMMGravityIntegrator
+    : public BaseVerletIntegrator<FMMGravityIntegrator<Coord, ParticleType>,
+                                  Coord, ParticleType> {
+  using Base = BaseVerletIntegrator<FMMGravityIntegrator, Coord, ParticleType>;
+  friend Base;
+
+public:
+  using Base::Base;
+  using TimeType = typename Base::TimeType;
+  using CoordinateVec = typename Base::CoordinateVec;
+  using Vector = typename Base::Vector;
+  using iterator = typename Base::iterator;
+  using Scalar = typename Base::Scalar;
+  using Tree = SpatialTree<Base::kDimension, Scalar>;
+  using Expansion = CartesianExpansion<Base::kDimension, Scalar>;
+
+  static constexpr size_t kDimension = Base::kDimension;
+  static constexpr double kGravityConstant = Constants::G;
+  static constexpr size_t kDefaultOrder = 4;
+  static constexpr double kDefaultOpeningAngle = 0.5;
+  static constexpr size_t kDefaultLeafSize = 64;
+
+  FMMGravityIntegrator() = default;
+
+  explicit FMMGravityIntegrator(size_t order,
+                                double opening_angle = kDefaultOpeningAngle,
+                                const ParallelConfig &parallel = {})
+      : expansion_(order), opening_angle_(opening_angle),
+        parallel_(parallel) {}
+
+  /**
+   * @brief Set the order of the multipole and local expansions.
+   */
+  void setOrder(size_t order) { expansion_ = Expansion(order); }
+  [[nodiscard]] size_t order() const { return expansion_.order(); }
+
+  /**
+   * @brief Set the opening angle theta, in (0, 1).
+   */
+  void setOpeningAngle(double opening_angle) {
+    opening_angle_ = opening_angle;
+  }
+  [[nodiscard]] double openingAngle() const { return opening_angle_; }
+
+  /**
+   * @brief Set the number of particles below which a cell is not split.
+   */
+  void setLeafSize(size_t leaf_size) { leaf_size_ = leaf_size; }
+  [[nodiscard]] size_t leafSize() const { return leaf_size_; }
+
+  void setParallelConfig(const ParallelConfig &parallel) {
+    parallel_ = parallel;
+  }
+  [[nodiscard]] const ParallelConfig &parallelConfig() const {
+    return parallel_;
+  }
+
+  /**
+   * @brief The tree built by the last force evaluation.
+   */
+  [[nodiscard]] const Tree &tree() const { return tree_; }
+
+private:
+  using AccelerationSpan = typename Base::AccelerationSpan;
+  using Index = typename Tree::Index;
+  using Point = typename Expansion::Point;
+  using Pair = std::pair<Index, Index>; ///< (target, source)
+
+  /// The radius of a cell is at most the half diagonal of the cube.
+  static inline const Scalar kCellRadius = std::sqrt(Scalar(kDimension));
+
+  /**
+   * @brief A list of source cells for every target cell.
+   */
+  struct InteractionList {
+    std::vector<size_t> offsets;
+    std::vector<Index> sources;
+
+    [[nodiscard]] std::span<const Index> of(Index target) const {
+      return {sources.data() + offsets[target],
+              offsets[target + 1] - offsets[target]};
+    }
+  };
+
+  struct PairLists {
+    std::vector<Pair> far;
+    std::vector<Pair> near;
+  };
+
+  void computeAccelerationsImpl(AccelerationSpan acc) const {
+    const auto &storage = this->storage_;
+    tree_.build(storage.positionComponents(), storage.masses(), leaf_size_,
+                parallel_);
+    if (storage.empty()) {
+      return;
+    }
+
+    const auto &nodes = tree_.nodes();
+    const auto terms = expansion_.terms();
+    const auto threads = static_cast<size_t>(parallel_.threads());
+    scratch_.resize(threads);
+    for (auto &scratch : scratch_) {
+      scratch.resize(terms);
+    }
+    multipoles_.assign(nodes.size() * terms, 0);
+    locals_.assign(nodes.size() * terms, 0);
+    radii_.resize(nodes.size());
+    groupLevels();
+
+    upwardPass();
+    buildInteractionLists();
+    downwardPass();
+    evaluateLeaves(acc);
+  }
+
+  [[nodiscard]] std::span<Scalar> multipole(Index node) const {
+    const auto terms = expansion_.terms();
+    return {multipoles_.data() + node * terms, terms};
+  }
+
+  [[nodiscard]] std::span<Scalar> local(Index node) const {
+    const auto terms = expansion_.terms();
+    return {locals_.data() + node * terms, terms};
+  }
+
+  [[nodiscard]] Point offset(const Point &from, const Point &to) const {
+    Point result;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result[axis] = to[axis] - from[axis];
+    }
+    return result;
+  }
+
+  static Scalar norm2(const Point &x) {
+    Scalar result = 0;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result += x[axis] * x[axis];
+    }
+    return result;
+  }
+
+  static Scalar norm(const Point &x) { return std::sqrt(norm2(x)); }
+
+  void groupLevels() const {
+    const auto &nodes = tree_.nodes();
+    for (auto &level : levels_) {
+      level.clear();
+    }
+    leaves_.clear();
+    for (Index k = 0; k < nodes.size(); ++k) {
+      if (nodes[k].level >= levels_.size()) {
+        levels_.resize(nodes[k].level + 1);
+      }
+      levels_[nodes[k].level].push_back(k);
+      if (nodes[k].isLeaf()) {
+        leaves_.push_back(k);
+      }
+    }
+  }
+
+  void upwardPass() const {
+    const auto &nodes = tree_.nodes();
+    const auto masses = tree_.masses();
+    for (auto level = levels_.size(); level-- > 0;) {
+      const auto &cells = levels_[level];
+      parallelForThreads(parallel_, cells.size(), [&](size_t i, int thread) {
+        const auto k = cells[i];
+        const auto &node = nodes[k];
+        auto &scratch = scratch_[thread];
+        Scalar radius = 0;
+        if (node.isLeaf()) {
+          for (auto j = node.begin; j < node.end; ++j) {
+            Point position;
+            for (size_t axis = 0; axis < kDimension; ++axis) {
+              position[axis] = tree_.positions(axis)[j];
+            }
+            auto shift = offset(node.center, position);
+            expansion_.particleToMultipole(shift, masses[j], multipole(k),
+                                           scratch);
+            radius = std::max(radius, norm(shift));
+          }
+        } else {
+          tree_.forEachChild(k, [&](Index child) {
+            auto shift = offset(node.center, nodes[child].center);
+            expansion_.multipoleToMultipole(shift, multipole(child),
+                                            multipole(k), scratch);
+            radius = std::max(radius, norm(shift) + radii_[child]);
+          });
+        }
+        radii_[k] = std::min(radius, kCellRadius * node.half_size);
+      });
+    }
+  }
+
+  [[nodiscard]] bool wellSeparated(Index target, Index source) const {
+    const auto distance2 =
+        norm2(offset(tree_.node(source).center, tree_.node(target).center));
+    const auto radii = radii_[target] + radii_[source];
+    return radii * radii < opening_angle_ * opening_angle_ * distance2;
+  }
+
+  /**
+   * @brief Resolve one pair of cells, or split the larger one.
+   * @details split(target, source) is called for the pairs of children.
+   */
+  template <typename Split>
+  void visit(Index target, Index source, PairLists &lists,
+             Split &&split) const {
+    if (wellSeparated(target, source)) {
+      lists.far.emplace_back(target, source);
+      return;
+    }
+    const auto &a = tree_.node(target);
+    const auto &b = tree_.node(source);
+    if (a.isLeaf() && b.isLeaf()) {
+      lists.near.emplace_back(target, source);
+    } else if (b.isLeaf() ||
+               (!a.isLeaf() && radii_[target] >= radii_[source])) {
+      tree_.forEachChild(target, [&](Index child) { split(child, source); });
+    } else {
+      tree_.forEachChild(source, [&](Index child) { split(target, child); });
+    }
+  }
+
+  void traverse(Index target, Index source, PairLists &lists) const {
+    visit(target, source, lists, [&](Index child_target, Index child_source) {
+      traverse(child_target, child_source, lists);
+    });
+  }
+
+  void buildInteractionLists() const {
+    const auto threads = static_cast<size_t>(parallel_.threads());
+    pair_lists_.resize(threads);
+    for (auto &lists : pair_lists_) {
+      lists.far.clear();
+      lists.near.clear();
+    }
+
+    // Expand the top of the traversal until there is enough work for the
+    // threads, then finish every pending pair on its own.
+    std::vector<Pair> pending{{0, 0}};
+    while (!pending.empty() && pending.size() < 16 * threads && threads > 1) {
+      std::vector<Pair> next;
+      for (auto [target, source] : pending) {
+        visit(target, source, pair_lists_[0],
+              [&](Index a, Index b) { next.emplace_back(a, b); });
+      }
+      pending = std::move(next);
+    }
+
+    auto dynamic = parallel_;
+    dynamic.schedule = ParallelConfig::Schedule::Dynamic;
+    dynamic.chunk_size = 1;
+    parallelForThreads(dynamic, pending.size(), [&](size_t i, int thread) {
+      traverse(pending[i].first, pending[i].second, pair_lists_[thread]);
+    });
+
+    collect(&PairLists::far, far_);
+    collect(&PairLists::near, near_);
+  }
+
+  /**
+   * @brief Gather the pairs found by all the threads into lists by target.
+   * @details The sources of every target are sorted, so the order of the sums
+   * does not depend on which thread found a pair.
+   */
+  void collect(std::vector<Pair> PairLists::*member,
+               InteractionList &list) const {
+    const auto node_count = tree_.nodes().size();
+    list.offsets.assign(node_count + 1, 0);
+    for (const auto &lists : pair_lists_) {
+      for (auto [target, source] : lists.*member) {
+        ++list.offsets[target + 1];
+      }
+    }
+    for (size_t k = 0; k < node_count; ++k) {
+      list.offsets[k + 1] += list.offsets[k];
+    }
+    list.sources.resize(list.offsets.back());
+    std::vector<size_t> fill(list.offsets.begin(), list.offsets.end() - 1);
+    for (const auto &lists : pair_lists_) {
+      for (auto [target, source] : lists.*member) {
+        list.sources[fill[target]++] = source;
+      }
+    }
+    parallelFor(parallel_, node_count, [&](size_t k) {
+      std::sort(list.sources.begin() + list.offsets[k],
+                list.sources.begin() + list.offsets[k + 1]);
+    });
+  }
+
+  void downwardPass() const {
+    const auto &nodes = tree_.nodes();
+
+    auto dynamic = parallel_;
+    dynamic.schedule = ParallelConfig::Schedule::Dynamic;
+    parallelForThreads(dynamic, nodes.size(), [&](size_t k, int thread) {
+      for (auto source : far_.of(k)) {
+        expansion_.multipoleToLocal(
+            offset(nodes[source].center, nodes[k].center), multipole(source),
+            local(k), scratch_[thread]);
+      }
+    });
+
+    for (size_t level = 1; level < levels_.size(); ++level) {
+      const auto &cells = levels_[level];
+      parallelForThreads(parallel_, cells.size(), [&](size_t i, int thread) {
+        const auto k = cells[i];
+        const auto parent = nodes[k].parent;
+        expansion_.localToLocal(offset(nodes[parent].center, nodes[k].center),
+                                local(parent), local(k), scratch_[thread]);
+      });
+    }
+  }
+
+  void evaluateLeaves(AccelerationSpan acc) const {
+    const auto &nodes = tree_.nodes();
+    const auto order = tree_.order();
+    const auto masses = tree_.masses();
+    std::array<std::span<const Scalar>, kDimension> positions;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      positions[axis] = tree_.positions(axis);
+    }
+
+    auto dynamic = parallel_;
+    dynamic.schedule = ParallelConfig::Schedule::Dynamic;
+    parallelForThreads(dynamic, leaves_.size(), [&](size_t l, int thread) {
+      const auto k = leaves_[l];
+      const auto &node = nodes[k];
+      for (auto i = node.begin; i < node.end; ++i) {
+        Point position;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          position[axis] = positions[axis][i];
+        }
+        auto result = expansion_.localGradient(offset(node.center, position),
+                                               local(k), scratch_[thread]);
+
+        for (auto source : near_.of(k)) {
+          const auto &near = nodes[source];
+          for (auto j = near.begin; j < near.end; ++j) {
+            if (j == i)
+              continue; // Skip self
+            Scalar d[kDimension];
+            Scalar distance2 = 0;
+            for (size_t axis = 0; axis < kDimension; ++axis) {
+              d[axis] = positions[axis][j] - position[axis];
+              distance2 += d[axis] * d[axis];
+            }
+            if (distance2 > 0) {
+              auto inv_distance = 1 / std::sqrt(distance2);
+              auto factor =
+                  masses[j] * inv_distance * inv_distance * inv_distance;
+              for (size_t axis = 0; axis < kDimension; ++axis) {
+                result[axis] += factor * d[axis];
+              }
+            }
+          }
+        }
+
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          acc[axis][order[i]] = kGravityConstant * result[axis];
+        }
+      }
+    });
+  }
+
+  Expansion expansion_{kDefaultOrder};
+  double opening_angle_ = kDefaultOpeningAngle;
+  size_t leaf_size_ = kDefaultLeafSize;
+  ParallelConfig parallel_;
+
+  // Rebuilt on every force evaluation, kept to reuse the allocations.
+  mutable Tree tree_;
+  mutable AlignedVector<Scalar> multipoles_;
+  mutable AlignedVector<Scalar> locals_;
+  mutable std::vector<Scalar> radii_; ///< Radius around the center
+  mutable std::vector<std::vector<Index>> levels_;
+  mutable std::vector<Index> leaves_;
+  mutable std::vector<PairLists> pair_lists_;
+  mutable InteractionList far_;
+  mutable InteractionList near_;
+  mutable std::vector<AlignedVector<Scalar>> scratch_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_FMMINTEGRATOR_H
@@ -7,10 +7,13 @@
 
 #include "phosphorus/Coordinate.h"
 #include "phosphorus/Particle.h"
+#include "phosphorus/ParticleStorage.h"
 #include "phosphorus/SignalSlot.h"
 #include "phosphorus/TypeTraits.h"
+#include <cmath>
 #include <concepts>
 #include <functional>
+#include <span>
 #include <type_traits>
 
 namespace phosphorus {
@@ -32,38 +35,86 @@ class BaseField {
 public:
   using CoordinateVec = Coord;
   using Vector = typename CoordinateVec::Vector;
+  using Scalar = typename CoordinateVec::Scalar;
+
+  static constexpr size_t kDimension = CoordinateVec::dimension();
+
+  using ConstComponents = ComponentSpan<const Scalar, kDimension>;
+  using Components = ComponentSpan<Scalar, kDimension>;
 
   template <typename ParticleType>
   Vector evaluate(const CoordinateVec &pos,
                   const ParticleType &particle) const {
     return static_cast<const Impl *>(this)->evaluate(pos, particle);
   }
+
+  /**
+   * @brief Evaluate the forces on a batch of particles.
+   * @details The positions are the raw vectors of the coordinate system, one
+   * array per component, as kept by ParticleStorage. A field may provide a
+   * specialized evaluateBatchImpl with the same parameters, e.g. a loop over
+   * the arrays that the compiler can vectorize. Otherwise evaluate is called
+   * for every particle.
+   * @param positions The positions of the particles.
+   * @param particles The particles.
+   * @param forces The output forces, one element per particle.
+   */
+  template <typename ParticleType>
+  void evaluateBatch(ConstComponents positions,
+                     std::span<const ParticleType> particles,
+                     Components forces) const {
+    auto impl = static_cast<const Impl *>(this);
+    if constexpr (requires {
+                    impl->evaluateBatchImpl(positions, particles, forces);
+                  }) {
+      impl->evaluateBatchImpl(positions, particles, forces);
+    } else {
+      for (size_t i = 0; i < particles.size(); ++i) {
+        forces.set(i, impl->evaluate(CoordinateVec::fromVector(
+                                         positions.get(i)),
+                                     particles[i]));
+      }
+    }
+  }
 };
 
 template <typename Func, typename CoordType, typename ParticleType>
-concept ForceFunction = requires {
-  std::invocable<Func, const CoordType &, const ParticleType &>;
-  std::convertible_to<
-      std::invoke_result_t<Func, const CoordType &, const ParticleType &>,
-      typename CoordType::Vector>;
-};
+concept ForceFunction =
+    std::invocable<Func &, const CoordType &, const ParticleType &> &&
+    std::convertible_to<
+        std::invoke_result_t<Func &, const CoordType &, const ParticleType &>,
+        typename CoordType::Vector>;
 
 /**
  * @brief A force field that is defined by a lambda function.
+ * @details The callable is stored as its own type, so evaluate inlines it into
+ * the force loop. The deduction guide picks that type, e.g.
+ * LambdaField(force) is a LambdaField<Coord, ParticleType, decltype(force)>.
+ * Naming only the coordinate and particle types gives a std::function, which
+ * can hold any callable at the cost of an indirect call per particle.
+ *
+ * As with std::function, a mutable lambda may be called from the const
+ * evaluate.
  * @tparam Coord The coordinate system contains this field
  * @tparam ParticleType The type of the particle
+ * @tparam Func The type of the callable
  */
-template <typename Coord, typename ParticleType>
+template <typename Coord, typename ParticleType,
+          typename Func = std::function<typename Coord::Vector(
+              const Coord &, const ParticleType &)>>
   requires IsCoordinateVec<Coord>
-class LambdaField : public BaseField<LambdaField<Coord, ParticleType>, Coord> {
+class LambdaField
+    : public BaseField<LambdaField<Coord, ParticleType, Func>, Coord> {
 public:
   using Particle = ParticleType;
   using CoordinateVecType = Coord;
   using Vector = typename CoordinateVecType::Vector;
+  using Function = Func;
 
-  template <typename Func>
-    requires ForceFunction<Func, CoordinateVecType, ParticleType>
-  explicit LambdaField(Func &&force) : field_func_(std::forward<Func>(force)) {}
+  template <typename F>
+    requires ForceFunction<F, CoordinateVecType, ParticleType> &&
+             std::constructible_from<Func, F>
+  explicit LambdaField(F &&force) : field_func_(std::forward<F>(force)) {}
 
   Vector evaluate(const CoordinateVecType &coord,
                   const ParticleType &particle) const {
@@ -71,21 +122,19 @@ public:
   }
 
 private:
-  std::function<Vector(const CoordinateVecType &, const ParticleType &)>
-      field_func_;
+  mutable Func field_func_;
 };
 
 template <typename Func>
 LambdaField(Func) -> LambdaField<
-    std::remove_cv_t<typename function_traits<Func>::first_argument_type>,
-    std::remove_cv_t<typename function_traits<Func>::second_argument_type>>;
+    typename function_traits<Func>::first_argument_type,
+    typename function_traits<Func>::second_argument_type, Func>;
 
-// TODO: We may need a more general composite field that can be modified.
-// Currently, the type of the field is fixed, and we cannot change it.
-// Thus, we must redefine the field type every time we want to change it.
-// This leads to a lot of memory allocation and deallocation.
 /**
  * @brief A composite field that is the sum of two fields.
+ * @details The operands are held by reference, so they must outlive the sum.
+ * For a sum which owns its components and can change at run time, see
+ * FieldSet.
  * @tparam LHS The LHS Field
  * @tparam RHS The RHS Field
  */
@@ -106,9 +155,34 @@ public:
     return lhs_.evaluate(coord, particle) + rhs_.evaluate(coord, particle);
   }
 
+  template <typename ParticleType>
+  void evaluateBatchImpl(typename CompositeField::ConstComponents positions,
+                         std::span<const ParticleType> particles,
+                         typename CompositeField::Components forces) const {
+    constexpr auto kDimension = CompositeField::kDimension;
+    const auto n = particles.size();
+    lhs_.evaluateBatch(positions, particles, forces);
+    // The right hand side goes through a scratch buffer, which is reused.
+    std::array<std::span<typename CompositeField::Scalar>, kDimension> rhs;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      scratch_[axis].resize(n);
+      rhs[axis] = scratch_[axis];
+    }
+    rhs_.evaluateBatch(positions, particles,
+                       typename CompositeField::Components(rhs));
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      for (size_t i = 0; i < n; ++i) {
+        forces[axis][i] += rhs[axis][i];
+      }
+    }
+  }
+
 private:
   const LHS &lhs_;
   const RHS &rhs_;
+  mutable std::array<AlignedVector<typename CompositeField::Scalar>,
+                     CompositeField::kDimension>
+      scratch_;
 };
 
 template <typename Field>
@@ -126,6 +200,18 @@ public:
     return -field_.evaluate(coord, particle);
   }
 
+  template <typename ParticleType>
+  void evaluateBatchImpl(typename NegativeField::ConstComponents positions,
+                         std::span<const ParticleType> particles,
+                         typename NegativeField::Components forces) const {
+    field_.evaluateBatch(positions, particles, forces);
+    for (size_t axis = 0; axis < NegativeField::kDimension; ++axis) {
+      for (auto &force : forces[axis]) {
+        force = -force;
+      }
+    }
+  }
+
 private:
   const Field &field_;
 };
@@ -149,6 +235,38 @@ auto operator-(const LHS &lhs, const RHS &rhs)
   return lhs + (-rhs);
 }
 
+namespace detail {
+
+/**
+ * @brief The batch forces of the Cartesian gravity fields, in plain loops over
+ * the component arrays.
+ * @param strength -G M of the central mass.
+ */
+template <typename Center, typename Scalar, size_t kDimension,
+          typename ParticleType>
+void pointMassForces(const Center &center, Scalar strength,
+                     ComponentSpan<const Scalar, kDimension> positions,
+                     std::span<const ParticleType> particles,
+                     ComponentSpan<Scalar, kDimension> forces) {
+  const auto n = particles.size();
+  for (size_t i = 0; i < n; ++i) {
+    Scalar d[kDimension];
+    Scalar distance2 = 0;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      d[axis] = positions[axis][i] - center[axis];
+      distance2 += d[axis] * d[axis];
+    }
+    const auto inv_distance = 1 / std::sqrt(distance2);
+    const auto factor = strength * static_cast<Scalar>(particles[i].mass()) *
+                        inv_distance * inv_distance * inv_distance;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      forces[axis][i] = factor * d[axis];
+    }
+  }
+}
+
+} // namespace detail
+
 /**
  * @brief A gravity field in Cartesian coordinates.
  */
@@ -174,6 +292,19 @@ public:
     return force * elem_r;
   }
 
+  /**
+   * @brief The forces on a batch of particles, in plain loops over the
+   * component arrays.
+   */
+  template <typename ParticleType>
+    requires Massive<ParticleType>
+  void evaluateBatchImpl(ConstComponents positions,
+                         std::span<const ParticleType> particles,
+                         Components forces) const {
+    detail::pointMassForces(center_.toCartesian(), -mass_ * G_, positions,
+                            particles, forces);
+  }
+
 private:
   static constexpr double G_SI = 6.67430e-11; // Gravitational constant
   double G_ = G_SI; // Gravitational constant in SI units
@@ -188,7 +319,7 @@ static_assert(IsField<CartesianGravityField>,
  * @brief A gravity field in Cartesian coordinates.
  */
 class Cartesian2DGravityField
-    : public BaseField<Cartesian2DGravityField, Cartesian3D> {
+    : public BaseField<Cartesian2DGravityField, Cartesian2D> {
 public:
   using CoordinateVecType = Cartesian2D;
   using Vector = CoordinateVecType::Vector;
@@ -210,6 +341,19 @@ public:
     return force * elem_r;
   }
 
+  /**
+   * @brief The forces on a batch of particles, in plain loops over the
+   * component arrays.
+   */
+  template <typename ParticleType>
+    requires Massive<ParticleType>
+  void evaluateBatchImpl(ConstComponents positions,
+                         std::span<const ParticleType> particles,
+                         Components forces) const {
+    detail::pointMassForces(center_.toCartesian(), -mass_ * G_, positions,
+                            particles, forces);
+  }
+
 private:
   static constexpr double G_SI = 6.67430e-11;
   const double G_ = G_SI;
@@ -0,0 +1,290 @@
+//
+// Created by Renatus Madrigal on 6/25/2025.
+//
+
+/**
+ * @file FieldSet.h
+ * @brief An owning sum of force fields which can be changed at run time.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_FIELDSET_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_FIELDSET_H
+
+#include "phosphorus/Coordinate.h"
+#include "phosphorus/Field.h"
+#include "phosphorus/ParticleStorage.h"
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief The sum of any number of component fields, owned by the set.
+ * @details Unlike CompositeField, the set keeps copies of its components, so
+ * it never refers to temporaries, and components can be added and removed
+ * between steps without changing the type of the field.
+ *
+ * The types a set can hold are fixed by Fields, and the components are grouped
+ * by type: every group is a contiguous array of one concrete field type, and
+ * its components are evaluated in a loop with no virtual calls. A batch is
+ * evaluated in tiles of kTileSize particles: for each tile, the batches of all
+ * the components are summed while the tile is in cache, so the particles are
+ * read once per evaluation rather than once per component.
+ * @tparam Coord The coordinate system of the components.
+ * @tparam Fields The types of the components, which must be distinct.
+ */
+template <typename Coord, typename... Fields>
+  requires IsCoordinateVec<Coord> &&
+           (std::same_as<typename Fields::CoordinateVec, Coord> && ...)
+class FieldSet : public BaseField<FieldSet<Coord, Fields...>, Coord> {
+  using Base = BaseField<FieldSet, Coord>;
+
+public:
+  using CoordinateVecType = Coord;
+  using Vector = typename CoordinateVecType::Vector;
+  using Scalar = typename CoordinateVecType::Scalar;
+  using ConstComponents = typename Base::ConstComponents;
+  using Components = typename Base::Components;
+
+  static constexpr size_t kDimension = Base::kDimension;
+  static constexpr size_t kTypes = sizeof...(Fields);
+  static constexpr size_t kTileSize = 256;
+
+  /**
+   * @brief The index of a field type in Fields.
+   */
+  template <typename Field>
+  static constexpr size_t kTypeIndex = [] {
+    constexpr std::array<bool, kTypes> matches{std::same_as<Field, Fields>...};
+    size_t index = 0;
+    while (index < kTypes && !matches[index]) {
+      ++index;
+    }
+    return index;
+  }();
+
+  static_assert(
+      []<size_t... I>(std::index_sequence<I...>) {
+        return ((kTypeIndex<Fields> == I) && ...);
+      }(std::index_sequence_for<Fields...>{}),
+      "The field types of a FieldSet must be distinct");
+
+  /**
+   * @brief Identifies a component for as long as it is in the set.
+   */
+  struct Handle {
+    std::uint32_t type = 0;
+    std::uint32_t id = 0;
+
+    bool operator==(const Handle &) const = default;
+  };
+
+  FieldSet() = default;
+
+  /**
+   * @brief Add a copy of a component field.
+   */
+  template <typename Field>
+    requires(kTypeIndex<std::remove_cvref_t<Field>> < kTypes)
+  Handle add(Field &&field) {
+    using Type = std::remove_cvref_t<Field>;
+    auto &group = std::get<kTypeIndex<Type>>(groups_);
+    group.fields.push_back(std::forward<Field>(field));
+    group.ids.push_back(next_id_);
+    return {static_cast<std::uint32_t>(kTypeIndex<Type>), next_id_++};
+  }
+
+  /**
+   * @brief Remove a component. The order of the other components of its type
+   * may change.
+   * @throws std::out_of_range if the component is not in the set.
+   */
+  void remove(Handle handle) {
+    visitGroup(handle.type, [&](auto &group) {
+      const auto index = indexIn(group, handle);
+      if (index + 1 != group.fields.size()) {
+        using Field = typename decltype(group.fields)::value_type;
+        if constexpr (std::is_move_assignable_v<Field>) {
+          group.fields[index] = std::move(group.fields.back());
+        } else {
+          // Fields such as a LambdaField of a lambda are not assignable, so
+          // they are rebuilt in place. A throwing move would leave a
+          // destroyed element in the vector.
+          static_assert(std::is_nothrow_move_constructible_v<Field>,
+                        "A field that is not assignable must be nothrow "
+                        "move constructible to be removed");
+          std::destroy_at(&group.fields[index]);
+          std::construct_at(&group.fields[index],
+                            std::move(group.fields.back()));
+        }
+        group.ids[index] = group.ids.back();
+      }
+      group.fields.pop_back();
+      group.ids.pop_back();
+    });
+  }
+
+  [[nodiscard]] bool contains(Handle handle) const {
+    if (handle.type >= kTypes) {
+      return false;
+    }
+    bool result = false;
+    visitGroup(handle.type, [&](const auto &group) {
+      result = std::ranges::find(group.ids, handle.id) != group.ids.end();
+    });
+    return result;
+  }
+
+  /**
+   * @brief A component, for modification in place.
+   * @throws std::out_of_range if the component is not a Field in the set.
+   */
+  template <typename Field> Field &get(Handle handle) {
+    auto &group = std::get<kTypeIndex<Field>>(groups_);
+    return group.fields[indexIn(group, handle)];
+  }
+  template <typename Field>
+  [[nodiscard]] const Field &get(Handle handle) const {
+    const auto &group = std::get<kTypeIndex<Field>>(groups_);
+    return group.fields[indexIn(group, handle)];
+  }
+
+  /**
+   * @brief All the components of one type.
+   */
+  template <typename Field> std::span<Field> components() {
+    return std::get<kTypeIndex<Field>>(groups_).fields;
+  }
+  template <typename Field>
+  [[nodiscard]] std::span<const Field> components() const {
+    return std::get<kTypeIndex<Field>>(groups_).fields;
+  }
+
+  /**
+   * @brief The number of components of one type.
+   */
+  template <typename Field> [[nodiscard]] size_t size() const {
+    return std::get<kTypeIndex<Field>>(groups_).fields.size();
+  }
+
+  /**
+   * @brief The number of components of all the types.
+   */
+  [[nodiscard]] size_t size() const {
+    return std::apply(
+        [](const auto &...groups) { return (groups.fields.size() + ... + 0); },
+        groups_);
+  }
+
+  [[nodiscard]] bool empty() const { return size() == 0; }
+
+  void clear() {
+    std::apply(
+        [](auto &...groups) {
+          (groups.fields.clear(), ...);
+          (groups.ids.clear(), ...);
+        },
+        groups_);
+  }
+
+  template <typename ParticleType>
+  Vector evaluate(const CoordinateVecType &coord,
+                  const ParticleType &particle) const {
+    Vector result{};
+    forEachGroup([&](const auto &group) {
+      for (const auto &field : group.fields) {
+        result += field.evaluate(coord, particle);
+      }
+    });
+    return result;
+  }
+
+  template <typename ParticleType>
+  void evaluateBatchImpl(ConstComponents positions,
+                         std::span<const ParticleType> particles,
+                         Components forces) const {
+    const auto n = particles.size();
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      std::ranges::fill(forces[axis], Scalar{0});
+      scratch_[axis].resize(std::min(n, kTileSize));
+    }
+
+    for (size_t begin = 0; begin < n; begin += kTileSize) {
+      const auto count = std::min(kTileSize, n - begin);
+      const auto tile_positions = positions.subspan(begin, count);
+      const auto tile_particles = particles.subspan(begin, count);
+      const auto tile_forces = forces.subspan(begin, count);
+      std::array<std::span<Scalar>, kDimension> scratch;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        scratch[axis] = std::span(scratch_[axis]).first(count);
+      }
+
+      forEachGroup([&](const auto &group) {
+        for (const auto &field : group.fields) {
+          field.evaluateBatch(tile_positions, tile_particles,
+                              Components(scratch));
+          for (size_t axis = 0; axis < kDimension; ++axis) {
+            auto force = tile_forces[axis].data();
+            auto component = scratch[axis].data();
+            for (size_t i = 0; i < count; ++i) {
+              force[i] += component[i];
+            }
+          }
+        }
+      });
+    }
+  }
+
+private:
+  template <typename Field> struct Group {
+    std::vector<Field> fields;
+    std::vector<std::uint32_t> ids;
+  };
+
+  template <typename Group>
+  static size_t indexIn(const Group &group, Handle handle) {
+    using Field = typename decltype(group.fields)::value_type;
+    const auto it = std::ranges::find(group.ids, handle.id);
+    if (handle.type != kTypeIndex<Field> || it == group.ids.end()) {
+      throw std::out_of_range("Field is not in the set");
+    }
+    return static_cast<size_t>(it - group.ids.begin());
+  }
+
+  template <typename Func> void forEachGroup(Func &&func) const {
+    std::apply([&](const auto &...groups) { (func(groups), ...); }, groups_);
+  }
+
+  template <typename Func> void visitGroup(std::uint32_t type, Func &&func) {
+    if (type >= kTypes) {
+      throw std::out_of_range("Field is not in the set");
+    }
+    [&]<size_t... I>(std::index_sequence<I...>) {
+      ((I == type ? func(std::get<I>(groups_)) : void()), ...);
+    }(std::index_sequence_for<Fields...>{});
+  }
+  template <typename Func>
+  void visitGroup(std::uint32_t type, Func &&func) const {
+    [&]<size_t... I>(std::index_sequence<I...>) {
+      ((I == type ? func(std::get<I>(groups_)) : void()), ...);
+    }(std::index_sequence_for<Fields...>{});
+  }
+
+  std::tuple<Group<Fields>...> groups_;
+  std::uint32_t next_id_ = 0;
+  mutable std::array<AlignedVector<Scalar>, kDimension> scratch_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_FIELDSET_H
@@ -6,6 +6,7 @@
 #define PHOSPHORUS_INCLUDE_PHOSPHORUS_GNUPLOT_H
 
 #include "phosphorus/Coordinate.h"
+#include "phosphorus/DataColumn.h"
 #include <iostream>
 #include <memory>
 #include <span>
@@ -75,8 +76,8 @@ public:
       }
     }
 
-    std::span<double> x{};                // x data
-    std::span<double> y{};                // y data
+    DataColumn x{};                       // x data
+    DataColumn y{};                       // y data
     int index = -1;                       // index of the data in the file
     std::pair<int, int> every{0, 0};      // every nth point to plot
     PlotType with = PlotType::None;       // line type
@@ -139,10 +140,10 @@ private:
 
   // TODO: Redesign this using range-like api
   static void generateDataBlock(const std::string &filename,
-                                std::span<double> x, std::span<double> y);
+                                const DataColumn &x, const DataColumn &y);
   static void generate3DDataBlock(const std::string &filename,
-                                  std::span<double> x, std::span<double> y,
-                                  std::span<double> z);
+                                  const DataColumn &x, const DataColumn &y,
+                                  const DataColumn &z);
   [[nodiscard]] std::string
   generatePlotCommand(const std::string &output) const;
   [[nodiscard]] std::string generateFigureCommand() const;
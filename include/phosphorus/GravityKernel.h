@@ -0,0 +1,89 @@
+//
+// Created by Renatus Madrigal on 6/21/2025.
+//
+
+/**
+ * @file GravityKernel.h
+ * @brief Direct summation kernels for Newtonian gravity.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_GRAVITYKERNEL_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_GRAVITYKERNEL_H
+
+#include "phosphorus/Parallel.h"
+#include "phosphorus/ParticleStorage.h"
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+namespace phosphorus {
+
+/**
+ * @brief Sum the accelerations and their time derivatives (jerks) of a subset
+ * of the particles over all the particles.
+ * @details The acceleration and the jerk of a pair are fused, since they share
+ * the distance and its powers:
+ *   a_i = sum_j G m_j r_ij / |r_ij|^3
+ *   j_i = sum_j G m_j (v_ij / |r_ij|^3 - 3 (r_ij . v_ij) r_ij / |r_ij|^5)
+ * with r_ij = x_j - x_i and v_ij = v_j - v_i. Only the targets are written,
+ * at their own indices, so every target is independent of the others and the
+ * results do not depend on the threads.
+ * @param positions The positions of all the particles.
+ * @param velocities The velocities of all the particles.
+ * @param masses The masses of all the particles.
+ * @param targets The indices of the particles to sum the forces on.
+ * @param acc The accelerations, indexed like the particles.
+ * @param jerk The jerks, indexed like the particles.
+ * @param gravity The gravitational constant.
+ * @param parallel The threads the targets are spread over.
+ */
+template <size_t kDimension, typename Scalar>
+void accelerationAndJerk(ComponentSpan<const Scalar, kDimension> positions,
+                         ComponentSpan<const Scalar, kDimension> velocities,
+                         std::span<const Scalar> masses,
+                         std::span<const std::uint32_t> targets,
+                         ComponentSpan<Scalar, kDimension> acc,
+                         ComponentSpan<Scalar, kDimension> jerk, Scalar gravity,
+                         const ParallelConfig &parallel) {
+  const auto n = masses.size();
+  parallelFor(parallel, targets.size(), [&](size_t k) {
+    const auto i = targets[k];
+    Scalar pos_i[kDimension], vel_i[kDimension];
+    Scalar acc_i[kDimension] = {}, jerk_i[kDimension] = {};
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      pos_i[axis] = positions[axis][i];
+      vel_i[axis] = velocities[axis][i];
+    }
+
+    for (size_t j = 0; j < n; ++j) {
+      Scalar d[kDimension], dv[kDimension];
+      Scalar distance_squared = 0, rv = 0;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        d[axis] = positions[axis][j] - pos_i[axis];
+        dv[axis] = velocities[axis][j] - vel_i[axis];
+        distance_squared += d[axis] * d[axis];
+        rv += d[axis] * dv[axis];
+      }
+      // This also skips the particle itself.
+      if (distance_squared > 0) {
+        auto inv_distance2 = 1 / distance_squared;
+        auto inv_distance = std::sqrt(inv_distance2);
+        auto factor = gravity * masses[j] * inv_distance * inv_distance2;
+        auto radial = 3 * rv * inv_distance2;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          acc_i[axis] += factor * d[axis];
+          jerk_i[axis] += factor * (dv[axis] - radial * d[axis]);
+        }
+      }
+    }
+
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      acc[axis][i] = acc_i[axis];
+      jerk[axis][i] = jerk_i[axis];
+    }
+  });
+}
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_GRAVITYKERNEL_H
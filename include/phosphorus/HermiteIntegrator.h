@@ -0,0 +1,353 @@
+//
+// Created by Renatus Madrigal on 6/23/2025.
+//
+
+/**
+ * @file HermiteIntegrator.h
+ * @brief Fourth-order Hermite integrator for collisional gravitational systems.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_HERMITEINTEGRATOR_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_HERMITEINTEGRATOR_H
+
+#include "phosphorus/Checkpoint.h"
+#include "phosphorus/GravityKernel.h"
+#include "phosphorus/Parallel.h"
+#include "phosphorus/VerletIntegrator.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief Fourth-order Hermite predictor-corrector integrator for gravity.
+ * @details Every force evaluation also computes the jerk (the time derivative
+ * of the acceleration) in the same pair loop, see accelerationAndJerk. A step
+ * predicts the positions and velocities with their Taylor series up to the
+ * jerk, evaluates the accelerations and jerks there, and corrects with the
+ * two-point Hermite interpolation:
+ *   v1 = v0 + (a0 + a1) dt / 2 + (j0 - j1) dt^2 / 12
+ *   x1 = x0 + (v0 + v1) dt / 2 + (a0 - a1) dt^2 / 12
+ * This is fourth-order accurate with one evaluation per step, where a Verlet
+ * step of the same cost is second-order.
+ *
+ * advanceTo chooses a shared step from Aarseth's criterion
+ *   dt = sqrt(eta (|a| |a''| + |a'|^2) / (|a'| |a'''| + |a''|^2))
+ * minimized over the particles, with the second and third derivatives taken
+ * from the interpolation of the last step.
+ *
+ * The step and advanceTo of BaseVerletIntegrator are hidden; the positions are
+ * Cartesian.
+ * @tparam Coord The Cartesian coordinate system used for the simulation.
+ * @tparam ParticleType The Particle type to be integrated.
+ */
+template <typename Coord, typename ParticleType>
+class HermiteGravityIntegrator
+    : public BaseVerletIntegrator<HermiteGravityIntegrator<Coord, ParticleType>,
+                                  Coord, ParticleType> {
+  using Base =
+      BaseVerletIntegrator<HermiteGravityIntegrator, Coord, ParticleType>;
+  friend Base;
+
+public:
+  using TimeType = typename Base::TimeType;
+  using CoordinateVec = typename Base::CoordinateVec;
+  using Vector = typename Base::Vector;
+  using iterator = typename Base::iterator;
+  using Scalar = typename Base::Scalar;
+
+  static constexpr size_t kDimension = Base::kDimension;
+  static constexpr double kGravityConstant =
+      GravityIntegrator<Coord, ParticleType>::kGravityConstant;
+
+  HermiteGravityIntegrator() = default;
+
+  explicit HermiteGravityIntegrator(const ParallelConfig &parallel)
+      : parallel_(parallel) {}
+
+  void setParallelConfig(const ParallelConfig &parallel) {
+    parallel_ = parallel;
+  }
+  [[nodiscard]] const ParallelConfig &parallelConfig() const {
+    return parallel_;
+  }
+
+  /**
+   * @brief Advance the system by one Hermite step.
+   * @param dt The time step.
+   */
+  void step(TimeType dt) {
+    prepare();
+    advance(dt);
+  }
+
+  /**
+   * @brief Advance the system to t_end with shared Aarseth time steps.
+   * @details The first step uses the simpler criterion eta_s |a| / |a'| with
+   * eta_s = eta / 10, since no higher derivatives are known yet. The last step
+   * is shortened to end exactly on t_end.
+   * @param t_end The time to advance to.
+   * @param eta The accuracy parameter, about 0.01 to 0.03 is usual.
+   * @return The number of steps taken.
+   */
+  size_t advanceTo(TimeType t_end, Scalar eta = 0.02) {
+    if (!(eta > 0)) {
+      throw std::invalid_argument("Accuracy parameter must be positive");
+    }
+    prepare();
+    size_t steps = 0;
+    while (this->time() < t_end) {
+      if (!(next_dt_ > 0)) {
+        next_dt_ = startingStep(eta / 10);
+      }
+      const auto remaining = t_end - this->time();
+      const bool last = next_dt_ >= remaining * (1 - 1e-12);
+      const auto dt = last ? remaining : next_dt_;
+      advance(dt);
+      const auto proposed = aarsethStep(dt, eta);
+      // A step shortened to hit t_end says little about the next one.
+      if (!last || proposed < next_dt_) {
+        next_dt_ = proposed;
+      }
+      ++steps;
+    }
+    return steps;
+  }
+
+  /**
+   * @brief The step advanceTo will try next, 0 before the first one.
+   */
+  [[nodiscard]] TimeType timeStep() const { return next_dt_; }
+
+  /**
+   * @brief The jerk of a particle.
+   */
+  [[nodiscard]] Vector jerk(size_t index) const {
+    Vector result{};
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result[axis] = jerk_[axis][index];
+    }
+    return result;
+  }
+
+private:
+  using AccelerationSpan = typename Base::AccelerationSpan;
+  using Array = typename Base::Storage::Array;
+  using Arrays = std::array<Array, kDimension>;
+
+  /**
+   * @brief The jerks and the derivatives of the last step, so a restored run
+   * takes the same steps as an uninterrupted one.
+   */
+  void saveCheckpointImpl(CheckpointWriter &writer) const {
+    writer.writeValue("nextdt", next_dt_);
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      writer.writeArray(this->checkpointTag("jerk", axis),
+                        std::span<const Scalar>(jerk_[axis]));
+      writer.writeArray(this->checkpointTag("snap", axis),
+                        std::span<const Scalar>(snap_[axis]));
+      writer.writeArray(this->checkpointTag("crackle", axis),
+                        std::span<const Scalar>(crackle_[axis]));
+    }
+  }
+
+  struct CheckpointState {
+    TimeType next_dt;
+    Arrays jerk;
+    Arrays snap;
+    Arrays crackle;
+  };
+
+  CheckpointState readCheckpointImpl(const CheckpointReader &reader,
+                                     size_t n) const {
+    CheckpointState state{reader.value<TimeType>("nextdt"), {}, {}, {}};
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      for (auto [name, array] : {std::pair{"jerk", &state.jerk[axis]},
+                                 std::pair{"snap", &state.snap[axis]},
+                                 std::pair{"crackle", &state.crackle[axis]}}) {
+        const auto tag = this->checkpointTag(name, axis);
+        const auto values = reader.array<Scalar>(tag);
+        // The arrays are empty before the first evaluation.
+        if (values.size() != n && !values.empty()) {
+          throw CheckpointError("Checkpoint section " + tag +
+                                " has the wrong length");
+        }
+        array->assign(values.begin(), values.end());
+      }
+    }
+    return state;
+  }
+
+  void restoreCheckpointImpl(CheckpointState &&state) noexcept {
+    const auto n = this->count();
+    next_dt_ = state.next_dt;
+    jerk_ = std::move(state.jerk);
+    snap_ = std::move(state.snap);
+    crackle_ = std::move(state.crackle);
+    // The restored accelerations and jerks are those of the current state.
+    initialized_ = n > 0 && jerk_.front().size() == n;
+    seen_changes_ = this->changeCount();
+  }
+
+  void computeAccelerationsImpl(AccelerationSpan acc) const {
+    const auto &storage = this->storage_;
+    const auto n = storage.size();
+    for (auto &array : jerk_) {
+      array.resize(n);
+    }
+    if (targets_.size() != n) {
+      targets_.resize(n);
+      std::iota(targets_.begin(), targets_.end(), std::uint32_t{0});
+    }
+    std::array<std::span<Scalar>, kDimension> jerk;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      jerk[axis] = jerk_[axis];
+    }
+    accelerationAndJerk<kDimension, Scalar>(
+        storage.positionComponents(), storage.velocityComponents(),
+        storage.masses(), targets_, acc,
+        ComponentSpan<Scalar, kDimension>(jerk), kGravityConstant, parallel_);
+  }
+
+  /**
+   * @brief Compute the initial forces and jerks if the particles changed.
+   */
+  void prepare() {
+    const auto n = this->count();
+    if (!initialized_ || seen_changes_ != this->changeCount()) {
+      this->evaluateAccelerations();
+      initialized_ = true;
+      seen_changes_ = this->changeCount();
+      next_dt_ = 0;
+    }
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      for (auto *array : {&old_position_[axis], &old_velocity_[axis],
+                          &old_acceleration_[axis], &old_jerk_[axis],
+                          &snap_[axis], &crackle_[axis]}) {
+        array->resize(n);
+      }
+    }
+  }
+
+  void advance(TimeType dt) {
+    auto &storage = this->storage_;
+    const auto n = storage.size();
+
+    // Predict in place, keeping the state at the start of the step.
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      auto x = storage.positions(axis).data();
+      auto v = storage.velocities(axis).data();
+      auto a = storage.accelerations(axis).data();
+      auto j = jerk_[axis].data();
+      for (size_t i = 0; i < n; ++i) {
+        old_position_[axis][i] = x[i];
+        old_velocity_[axis][i] = v[i];
+        old_acceleration_[axis][i] = a[i];
+        old_jerk_[axis][i] = j[i];
+        x[i] += dt * (v[i] + dt * (a[i] / 2 + dt * j[i] / 6));
+        v[i] += dt * (a[i] + dt * j[i] / 2);
+      }
+    }
+
+    this->evaluateAccelerations();
+
+    // Correct, and keep the higher derivatives of the interpolation for the
+    // time step criterion.
+    const auto dt2 = dt * dt;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      auto x = storage.positions(axis).data();
+      auto v = storage.velocities(axis).data();
+      auto a = storage.accelerations(axis).data();
+      auto j = jerk_[axis].data();
+      for (size_t i = 0; i < n; ++i) {
+        const auto x0 = old_position_[axis][i];
+        const auto v0 = old_velocity_[axis][i];
+        const auto a0 = old_acceleration_[axis][i];
+        const auto j0 = old_jerk_[axis][i];
+        v[i] = v0 + (a0 + a[i]) * dt / 2 + (j0 - j[i]) * dt2 / 12;
+        x[i] = x0 + (v0 + v[i]) * dt / 2 + (a0 - a[i]) * dt2 / 12;
+
+        if (dt > 0) {
+          const auto snap0 =
+              (-6 * (a0 - a[i]) - dt * (4 * j0 + 2 * j[i])) / dt2;
+          const auto crackle =
+              (12 * (a0 - a[i]) + 6 * dt * (j0 + j[i])) / (dt2 * dt);
+          snap_[axis][i] = snap0 + crackle * dt;
+          crackle_[axis][i] = crackle;
+        }
+      }
+    }
+    this->setTime(this->time() + dt);
+  }
+
+  [[nodiscard]] static Scalar norm(const Arrays &arrays, size_t i) {
+    Scalar result = 0;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result += arrays[axis][i] * arrays[axis][i];
+    }
+    return std::sqrt(result);
+  }
+
+  [[nodiscard]] Scalar accelerationNorm(size_t i) const {
+    Scalar result = 0;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      auto a = this->storage_.accelerations(axis)[i];
+      result += a * a;
+    }
+    return std::sqrt(result);
+  }
+
+  [[nodiscard]] TimeType startingStep(Scalar eta) const {
+    auto result = std::numeric_limits<TimeType>::infinity();
+    for (size_t i = 0; i < this->count(); ++i) {
+      auto jerk = norm(jerk_, i);
+      if (jerk > 0) {
+        result = std::min<TimeType>(result, eta * accelerationNorm(i) / jerk);
+      }
+    }
+    return result;
+  }
+
+  [[nodiscard]] TimeType aarsethStep(TimeType dt, Scalar eta) const {
+    auto result = std::numeric_limits<TimeType>::infinity();
+    for (size_t i = 0; i < this->count(); ++i) {
+      const auto a = accelerationNorm(i);
+      const auto j = norm(jerk_, i);
+      const auto s = norm(snap_, i);
+      const auto c = norm(crackle_, i);
+      const auto denominator = j * c + s * s;
+      if (denominator > 0) {
+        result = std::min<TimeType>(
+            result, std::sqrt(eta * (a * s + j * j) / denominator));
+      }
+    }
+    // Without any interaction there is nothing to resolve.
+    return std::isfinite(result) ? result : 2 * dt;
+  }
+
+  ParallelConfig parallel_;
+  bool initialized_ = false;
+  size_t seen_changes_ = 0;
+  TimeType next_dt_ = 0;
+
+  mutable Arrays jerk_;
+  mutable std::vector<std::uint32_t> targets_;
+  Arrays old_position_;
+  Arrays old_velocity_;
+  Arrays old_acceleration_;
+  Arrays old_jerk_;
+  Arrays snap_;
+  Arrays crackle_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_HERMITEINTEGRATOR_H
@@ -0,0 +1,322 @@
+//
+// Created by Renatus Madrigal on 6/24/2025.
+//
+
+/**
+ * @file MultiSpeciesIntegrator.h
+ * @brief Verlet integrator for systems of several particle types.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_MULTISPECIESINTEGRATOR_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_MULTISPECIESINTEGRATOR_H
+
+#include "phosphorus/Coordinate.h"
+#include "phosphorus/Parallel.h"
+#include "phosphorus/Particle.h"
+#include "phosphorus/ParticleStorage.h"
+#include "phosphorus/ScitificConstants.h"
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace phosphorus {
+
+/**
+ * @brief An interaction between a particle of type Target and one of type
+ * Source.
+ * @details forceOverDistance(target, source, r2) returns the force on the
+ * target divided by the distance, given the squared distance. The force is
+ * along x_target - x_source, so positive values are repulsive. A pair of
+ * types for which the call does not compile does not interact.
+ */
+template <typename Interaction, typename Target, typename Source>
+concept SpeciesInteraction =
+    requires(const Interaction &interaction, const Target &target,
+             const Source &source, double r2) {
+      {
+        interaction.forceOverDistance(target, source, r2)
+      } -> std::convertible_to<double>;
+    };
+
+/**
+ * @brief Newtonian gravity between all the species, plus the Coulomb force
+ * between the species which are Charged.
+ * @details Whether a pair of species is charged is decided at compile time,
+ * so e.g. a star type with only a mass never pays for the Coulomb term.
+ */
+struct GravityCoulombInteraction {
+  double gravity = Constants::G;
+  double coulomb = Constants::K;
+
+  template <Massive Target, Massive Source>
+  [[nodiscard]] double forceOverDistance(const Target &target,
+                                         const Source &source,
+                                         double r2) const {
+    const auto inv_distance = 1 / std::sqrt(r2);
+    const auto inv_cube = inv_distance * inv_distance * inv_distance;
+    auto result = -gravity * target.mass() * source.mass() * inv_cube;
+    if constexpr (Charged<Target> && Charged<Source>) {
+      result += coulomb * target.charge() * source.charge() * inv_cube;
+    }
+    return result;
+  }
+};
+
+/**
+ * @brief Velocity Verlet integrator for particles of several types.
+ * @details Every species has its own ParticleStorage, so its particle objects
+ * hold only the properties of that species, and the position, velocity and
+ * acceleration arrays of a species are contiguous. The force loop is unrolled
+ * at compile time over the pairs of species: for every target species, the
+ * sources of every species whose pair satisfies SpeciesInteraction are summed
+ * in a loop which is specialized for those two particle types. There is no
+ * run-time dispatch inside the loops.
+ *
+ * The particles of a species are addressed by their index within the species.
+ * @tparam Interaction The pair interaction, see SpeciesInteraction.
+ * @tparam Coord The Cartesian coordinate system used for the simulation.
+ * @tparam Species The particle types, which must be distinct.
+ */
+template <typename Interaction, typename Coord, typename... Species>
+  requires IsCoordinateVec<Coord> && (Massive<Species> && ...)
+class MultiSpeciesIntegrator {
+public:
+  using TimeType = double;
+  using CoordinateVec = Coord;
+  using Vector = typename CoordinateVec::Vector;
+  using Scalar = typename CoordinateVec::Scalar;
+
+  template <typename ParticleType>
+  using Storage = ParticleStorage<CoordinateVec, ParticleType>;
+
+  static constexpr size_t kDimension = CoordinateVec::dimension();
+  static constexpr size_t kSpecies = sizeof...(Species);
+
+  /**
+   * @brief The index of a particle type in Species.
+   */
+  template <typename ParticleType>
+  static constexpr size_t kSpeciesIndex = [] {
+    constexpr std::array<bool, kSpecies> matches{
+        std::same_as<ParticleType, Species>...};
+    size_t index = 0;
+    while (index < kSpecies && !matches[index]) {
+      ++index;
+    }
+    return index;
+  }();
+
+  static_assert(
+      []<size_t... I>(std::index_sequence<I...>) {
+        return ((kSpeciesIndex<Species> == I) && ...);
+      }(std::index_sequence_for<Species...>{}),
+      "The particle types of the species must be distinct");
+
+  MultiSpeciesIntegrator() = default;
+
+  explicit MultiSpeciesIntegrator(Interaction interaction,
+                                  const ParallelConfig &parallel = {})
+      : interaction_(std::move(interaction)), parallel_(parallel) {}
+
+  /**
+   * @brief Whether particles of type Target feel particles of type Source.
+   */
+  template <typename Target, typename Source>
+  static constexpr bool interacts() {
+    return SpeciesInteraction<Interaction, Target, Source>;
+  }
+
+  /**
+   * @brief Add a particle to the storage of its species.
+   * @return The index of the particle within its species.
+   */
+  template <typename ParticleType>
+    requires(kSpeciesIndex<ParticleType> < kSpecies)
+  size_t pushParticle(const ParticleType &particle,
+                      const CoordinateVec &position = CoordinateVec(),
+                      const Vector &velocity = Vector()) {
+    accelerations_valid_ = false;
+    return mutableStorage<ParticleType>().push(particle, position, velocity,
+                                               Vector());
+  }
+
+  /**
+   * @brief The particles of one species. They are changed through the setters
+   * below, which keep the cached accelerations up to date.
+   */
+  template <typename ParticleType>
+  [[nodiscard]] const Storage<ParticleType> &storage() const {
+    return std::get<kSpeciesIndex<ParticleType>>(storages_);
+  }
+
+  template <typename ParticleType>
+  void setPosition(size_t index, const CoordinateVec &position) {
+    mutableStorage<ParticleType>().setPosition(index, position);
+    accelerations_valid_ = false;
+  }
+  template <typename ParticleType>
+  void setVelocity(size_t index, const Vector &velocity) {
+    mutableStorage<ParticleType>().setVelocity(index, velocity);
+  }
+  template <typename ParticleType>
+  void setParticle(size_t index, const ParticleType &particle) {
+    mutableStorage<ParticleType>().setParticle(index, particle);
+    accelerations_valid_ = false;
+  }
+
+  /**
+   * @brief The number of particles of one species.
+   */
+  template <typename ParticleType> [[nodiscard]] size_t count() const {
+    return storage<ParticleType>().size();
+  }
+
+  /**
+   * @brief The number of particles of all the species.
+   */
+  [[nodiscard]] size_t count() const {
+    return std::apply(
+        [](const auto &...storages) { return (storages.size() + ... + 0); },
+        storages_);
+  }
+
+  [[nodiscard]] const Interaction &interaction() const { return interaction_; }
+
+  void setParallelConfig(const ParallelConfig &parallel) {
+    parallel_ = parallel;
+  }
+  [[nodiscard]] const ParallelConfig &parallelConfig() const {
+    return parallel_;
+  }
+
+  [[nodiscard]] TimeType time() const { return time_; }
+
+  /**
+   * @brief Advance all the species by one velocity Verlet step.
+   */
+  void step(TimeType dt) {
+    if (!accelerations_valid_) {
+      computeAccelerations();
+      accelerations_valid_ = true;
+    }
+
+    forEachSpecies([&](auto &storage, auto &previous) {
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        previous[axis].resize(storage.size());
+        auto x = storage.positions(axis).data();
+        auto v = storage.velocities(axis).data();
+        auto a = storage.accelerations(axis).data();
+        auto prev = previous[axis].data();
+        for (size_t i = 0; i < storage.size(); ++i) {
+          x[i] += v[i] * dt + 0.5 * a[i] * dt * dt;
+          prev[i] = a[i];
+        }
+      }
+    });
+
+    computeAccelerations();
+
+    forEachSpecies([&](auto &storage, auto &previous) {
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        auto v = storage.velocities(axis).data();
+        auto a = storage.accelerations(axis).data();
+        auto prev = previous[axis].data();
+        for (size_t i = 0; i < storage.size(); ++i) {
+          v[i] += 0.5 * (prev[i] + a[i]) * dt;
+        }
+      }
+    });
+    time_ += dt;
+  }
+
+private:
+  using Arrays = std::array<AlignedVector<Scalar>, kDimension>;
+
+  template <typename ParticleType> Storage<ParticleType> &mutableStorage() {
+    return std::get<kSpeciesIndex<ParticleType>>(storages_);
+  }
+
+  template <typename Func> void forEachSpecies(Func &&func) {
+    [&]<size_t... I>(std::index_sequence<I...>) {
+      (func(std::get<I>(storages_), previous_acceleration_[I]), ...);
+    }(std::make_index_sequence<kSpecies>{});
+  }
+
+  void computeAccelerations() {
+    [&]<size_t... T>(std::index_sequence<T...>) {
+      (computeAccelerationsOf<T>(), ...);
+    }(std::make_index_sequence<kSpecies>{});
+  }
+
+  /**
+   * @brief Sum the forces on every particle of the target species, over the
+   * sources of all the species it interacts with.
+   */
+  template <size_t T> void computeAccelerationsOf() {
+    using Target = std::tuple_element_t<T, std::tuple<Species...>>;
+    auto &targets = std::get<T>(storages_);
+    const auto target_particles = targets.particles();
+    const auto target_masses = targets.masses();
+    const auto positions = std::as_const(targets).positionComponents();
+    auto acc = targets.accelerationComponents();
+
+    parallelFor(parallel_, targets.size(), [&](size_t i) {
+      const auto &target = target_particles[i];
+      Scalar position[kDimension];
+      Scalar force[kDimension] = {};
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        position[axis] = positions[axis][i];
+      }
+
+      [&]<size_t... S>(std::index_sequence<S...>) {
+        (sumForces<T, S, Target>(target, position, force), ...);
+      }(std::make_index_sequence<kSpecies>{});
+
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        acc[axis][i] = force[axis] / target_masses[i];
+      }
+    });
+  }
+
+  template <size_t T, size_t S, typename Target>
+  void sumForces(const Target &target, const Scalar (&position)[kDimension],
+                 Scalar (&force)[kDimension]) const {
+    using Source = std::tuple_element_t<S, std::tuple<Species...>>;
+    if constexpr (interacts<Target, Source>()) {
+      const auto &sources = std::get<S>(storages_);
+      const auto source_particles = sources.particles();
+      const auto source_positions = sources.positionComponents();
+      for (size_t j = 0; j < sources.size(); ++j) {
+        Scalar d[kDimension];
+        Scalar r2 = 0;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          d[axis] = position[axis] - source_positions[axis][j];
+          r2 += d[axis] * d[axis];
+        }
+        // This also skips the particle itself.
+        if (r2 > 0) {
+          const auto factor =
+              interaction_.forceOverDistance(target, source_particles[j], r2);
+          for (size_t axis = 0; axis < kDimension; ++axis) {
+            force[axis] += factor * d[axis];
+          }
+        }
+      }
+    }
+  }
+
+  Interaction interaction_;
+  ParallelConfig parallel_;
+  std::tuple<Storage<Species>...> storages_;
+  std::array<Arrays, kSpecies> previous_acceleration_;
+  bool accelerations_valid_ = false;
+  TimeType time_ = 0;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_MULTISPECIESINTEGRATOR_H
@@ -0,0 +1,326 @@
+//
+// Created by Renatus Madrigal on 6/17/2025.
+//
+
+/**
+ * @file Multipole.h
+ * @brief Cartesian Taylor expansions of the 1/r kernel for the fast multipole
+ * method.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_MULTIPOLE_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_MULTIPOLE_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief The operators of a Cartesian fast multipole method for the kernel
+ * 1/|x - y|.
+ * @details Expansions are truncated after the terms of total degree order.
+ * A term is a multi-index n = (n_1, ..., n_kDimension) with |n| <= order, and
+ * every expansion is a flat array with one coefficient per term, ordered by
+ * degree. With the notation x^n = x_1^n_1 ... x_D^n_D and n! = n_1! ... n_D!:
+ *
+ * - The multipole of the masses m_j at y_j about the center z is
+ *   M_n = sum_j m_j (y_j - z)^n / n!.
+ * - The local expansion about the center z stores l_k, such that the
+ *   potential sum_j m_j / |x - y_j| is sum_k l_k (x - z)^k near z.
+ *
+ * All the tables used by the translations are built by the constructor, so
+ * one expansion object is shared by every cell of a tree.
+ * @tparam kDimension The number of spatial dimensions.
+ * @tparam Scalar The floating point type of the coefficients.
+ */
+template <size_t kDimension, typename Scalar = double>
+class CartesianExpansion {
+public:
+  using Index = std::uint32_t;
+  using Point = std::array<Scalar, kDimension>;
+
+  static constexpr Index kNone = std::numeric_limits<Index>::max();
+  static constexpr size_t kMaxOrder = 20;
+
+  explicit CartesianExpansion(size_t order = 4) : order_(order) {
+    if (order > kMaxOrder) {
+      throw std::invalid_argument("Expansion order is too high");
+    }
+    buildTerms();
+    buildTables();
+  }
+
+  [[nodiscard]] size_t order() const { return order_; }
+
+  /**
+   * @brief The number of coefficients of an expansion.
+   */
+  [[nodiscard]] size_t terms() const { return exponents_.size(); }
+
+  /**
+   * @brief Add a particle of the given mass at offset from the center to a
+   * multipole.
+   * @param scratch At least terms() scalars.
+   */
+  void particleToMultipole(const Point &offset, Scalar mass,
+                           std::span<Scalar> multipole,
+                           std::span<Scalar> scratch) const {
+    monomials(offset, scratch);
+    for (size_t n = 0; n < terms(); ++n) {
+      multipole[n] += mass * scratch[n];
+    }
+  }
+
+  /**
+   * @brief Add the multipole of a child cell to the multipole of its parent.
+   * @param shift The center of the child minus the center of the parent.
+   */
+  void multipoleToMultipole(const Point &shift, std::span<const Scalar> child,
+                            std::span<Scalar> parent,
+                            std::span<Scalar> scratch) const {
+    monomials(shift, scratch);
+    for (const auto &entry : shifts_) {
+      parent[entry.high] += child[entry.low] * scratch[entry.difference];
+    }
+  }
+
+  /**
+   * @brief Add the field of a multipole to a local expansion.
+   * @param separation The center of the local expansion minus the center of
+   * the multipole.
+   */
+  void multipoleToLocal(const Point &separation,
+                        std::span<const Scalar> multipole,
+                        std::span<Scalar> local,
+                        std::span<Scalar> scratch) const {
+    derivatives(separation, scratch);
+    for (const auto &entry : interactions_) {
+      local[entry.local] +=
+          entry.coefficient * multipole[entry.multipole] * scratch[entry.sum];
+    }
+  }
+
+  /**
+   * @brief Add the local expansion of a parent cell to the one of its child.
+   * @param shift The center of the child minus the center of the parent.
+   */
+  void localToLocal(const Point &shift, std::span<const Scalar> parent,
+                    std::span<Scalar> child,
+                    std::span<Scalar> scratch) const {
+    monomials(shift, scratch);
+    for (const auto &entry : shifts_) {
+      child[entry.low] +=
+          entry.coefficient * parent[entry.high] * scratch[entry.difference];
+    }
+  }
+
+  /**
+   * @brief The gradient of a local expansion at offset from its center.
+   */
+  [[nodiscard]] Point localGradient(const Point &offset,
+                                    std::span<const Scalar> local,
+                                    std::span<Scalar> scratch) const {
+    monomials(offset, scratch);
+    Point gradient{};
+    for (const auto &entry : gradient_) {
+      gradient[entry.axis] +=
+          entry.coefficient * local[entry.term] * scratch[entry.lower];
+    }
+    return gradient;
+  }
+
+  /**
+   * @brief The Taylor coefficients D^n (1 / |x|) / n! of the kernel at x.
+   */
+  void derivatives(const Point &x, std::span<Scalar> result) const {
+    Scalar r2 = 0;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      r2 += x[axis] * x[axis];
+    }
+    const auto inv_r2 = 1 / r2;
+    result[0] = std::sqrt(inv_r2);
+    // |k| r^2 a_k = -(2|k| - 1) sum_i x_i a_{k - e_i}
+    //               - (|k| - 1) sum_i a_{k - 2e_i}
+    for (size_t k = 1; k < terms(); ++k) {
+      const auto degree = static_cast<Scalar>(degree_[k]);
+      Scalar first = 0, second = 0;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        if (lower1_[k][axis] != kNone) {
+          first += x[axis] * result[lower1_[k][axis]];
+        }
+        if (lower2_[k][axis] != kNone) {
+          second += result[lower2_[k][axis]];
+        }
+      }
+      result[k] = -((2 * degree - 1) * first + (degree - 1) * second) *
+                  inv_r2 / degree;
+    }
+  }
+
+private:
+  using Exponents = std::array<Index, kDimension>;
+
+  struct Shift {
+    Index high;        ///< n
+    Index low;         ///< k <= n
+    Index difference;  ///< n - k
+    Scalar coefficient; ///< n! / k!
+  };
+
+  struct Interaction {
+    Index multipole;    ///< n
+    Index local;        ///< k
+    Index sum;          ///< n + k
+    Scalar coefficient; ///< (-1)^|n| (n + k)! / k!
+  };
+
+  struct Gradient {
+    Index term;         ///< k
+    Index lower;        ///< k - e_axis
+    Index axis;
+    Scalar coefficient; ///< k_axis (k - e_axis)!
+  };
+
+  /**
+   * @brief The scaled monomials x^n / n! of all the terms.
+   */
+  void monomials(const Point &x, std::span<Scalar> result) const {
+    result[0] = 1;
+    for (size_t n = 1; n < terms(); ++n) {
+      result[n] = result[step_parent_[n]] * x[step_axis_[n]] * step_scale_[n];
+    }
+  }
+
+  void buildTerms() {
+    size_t codes = 1;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      codes *= order_ + 1;
+    }
+    lookup_.assign(codes, kNone);
+    for (size_t degree = 0; degree <= order_; ++degree) {
+      for (size_t code = 0; code < codes; ++code) {
+        Exponents n{};
+        size_t rest = code, sum = 0;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          n[axis] = static_cast<Index>(rest % (order_ + 1));
+          rest /= order_ + 1;
+          sum += n[axis];
+        }
+        if (sum == degree) {
+          lookup_[code] = static_cast<Index>(exponents_.size());
+          exponents_.push_back(n);
+          degree_.push_back(static_cast<Index>(degree));
+        }
+      }
+    }
+  }
+
+  [[nodiscard]] Index find(const Exponents &n) const {
+    size_t code = 0, stride = 1, sum = 0;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      code += n[axis] * stride;
+      stride *= order_ + 1;
+      sum += n[axis];
+    }
+    return sum > order_ ? kNone : lookup_[code];
+  }
+
+  [[nodiscard]] Scalar factorial(const Exponents &n) const {
+    Scalar result = 1;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      for (Index i = 2; i <= n[axis]; ++i) {
+        result *= static_cast<Scalar>(i);
+      }
+    }
+    return result;
+  }
+
+  void buildTables() {
+    const auto count = terms();
+    step_parent_.assign(count, 0);
+    step_axis_.assign(count, 0);
+    step_scale_.assign(count, 1);
+    lower1_.assign(count, {});
+    lower2_.assign(count, {});
+
+    for (size_t k = 0; k < count; ++k) {
+      const auto &n = exponents_[k];
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        auto lower = n;
+        lower1_[k][axis] = kNone;
+        lower2_[k][axis] = kNone;
+        if (n[axis] >= 1) {
+          lower[axis] -= 1;
+          lower1_[k][axis] = find(lower);
+          gradient_.push_back({static_cast<Index>(k), lower1_[k][axis],
+                               static_cast<Index>(axis),
+                               n[axis] * factorial(lower)});
+        }
+        if (n[axis] >= 2) {
+          lower[axis] -= 1;
+          lower2_[k][axis] = find(lower);
+        }
+      }
+      for (size_t axis = 0; axis < kDimension && k > 0; ++axis) {
+        if (n[axis] > 0) {
+          step_parent_[k] = lower1_[k][axis];
+          step_axis_[k] = static_cast<Index>(axis);
+          step_scale_[k] = Scalar{1} / static_cast<Scalar>(n[axis]);
+          break;
+        }
+      }
+    }
+
+    for (size_t high = 0; high < count; ++high) {
+      for (size_t low = 0; low < count; ++low) {
+        const auto &n = exponents_[high];
+        const auto &k = exponents_[low];
+        Exponents difference{}, sum{};
+        bool contained = true;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          contained = contained && k[axis] <= n[axis];
+          difference[axis] = n[axis] - k[axis];
+          sum[axis] = n[axis] + k[axis];
+        }
+        if (contained) {
+          shifts_.push_back({static_cast<Index>(high), static_cast<Index>(low),
+                             find(difference), factorial(n) / factorial(k)});
+        }
+        if (auto index = find(sum); index != kNone) {
+          const auto sign = degree_[high] % 2 == 0 ? 1 : -1;
+          interactions_.push_back({static_cast<Index>(high),
+                                   static_cast<Index>(low), index,
+                                   sign * factorial(sum) / factorial(k)});
+        }
+      }
+    }
+  }
+
+  size_t order_;
+  std::vector<Exponents> exponents_;
+  std::vector<Index> degree_;
+  std::vector<Index> lookup_;
+
+  // x^n / n! = x^(n - e_axis) / (n - e_axis)! * x_axis / n_axis
+  std::vector<Index> step_parent_;
+  std::vector<Index> step_axis_;
+  std::vector<Scalar> step_scale_;
+
+  std::vector<Exponents> lower1_; ///< n - e_axis, or kNone
+  std::vector<Exponents> lower2_; ///< n - 2 e_axis, or kNone
+
+  std::vector<Shift> shifts_;
+  std::vector<Interaction> interactions_;
+  std::vector<Gradient> gradient_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_MULTIPOLE_H
@@ -0,0 +1,269 @@
+//
+// Created by Renatus Madrigal on 6/19/2025.
+//
+
+/**
+ * @file NeighborList.h
+ * @brief Cell lists and Verlet neighbor lists for short-range interactions.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_NEIGHBORLIST_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_NEIGHBORLIST_H
+
+#include "phosphorus/Parallel.h"
+#include "phosphorus/ParticleStorage.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief Particles binned into a regular grid of cells.
+ * @details The cells are at least as large as the requested width, so all the
+ * particles within that distance of a particle are in its own cell or in one
+ * of the 3^kDimension - 1 cells around it. The particles of every cell are
+ * stored contiguously, in increasing index order.
+ * @tparam kDimension The number of spatial dimensions.
+ * @tparam Scalar The type of the coordinates.
+ */
+template <size_t kDimension, typename Scalar = double> class CellList {
+public:
+  using Index = std::uint32_t;
+  using ConstComponents = ComponentSpan<const Scalar, kDimension>;
+  using Cell = std::array<size_t, kDimension>;
+
+  /**
+   * @brief Bin the particles into cells of at least the given width.
+   */
+  void build(ConstComponents positions, Scalar width) {
+    if (!(width > 0)) {
+      throw std::invalid_argument("Cell width must be positive");
+    }
+    const auto n = positions.size();
+    cell_of_.resize(n);
+    if (n == 0) {
+      cell_offsets_.assign(1, 0);
+      particles_.clear();
+      return;
+    }
+
+    std::array<Scalar, kDimension> extent;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      if (!std::ranges::all_of(positions[axis],
+                               [](Scalar x) { return std::isfinite(x); })) {
+        throw std::invalid_argument("Positions must be finite");
+      }
+      auto [lo, hi] =
+          std::minmax_element(positions[axis].begin(), positions[axis].end());
+      origin_[axis] = *lo;
+      extent[axis] = *hi - *lo;
+    }
+    // Sparse systems would get a huge grid of empty cells, so the cells are
+    // widened until there are at most about two per particle. The count is
+    // taken in floating point, as a distant particle can make the product of
+    // the sides overflow.
+    auto cells = [&](Scalar w) {
+      double count = 1;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        count *= std::floor(static_cast<double>(extent[axis] / w)) + 1;
+      }
+      return count;
+    };
+    width_ = width;
+    while (cells(width_) > static_cast<double>(2 * n + 1)) {
+      width_ *= 2;
+    }
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      shape_[axis] = static_cast<size_t>(extent[axis] / width_) + 1;
+    }
+
+    cell_offsets_.assign(cellCount() + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+      Cell cell;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        cell[axis] = std::min(
+            static_cast<size_t>((positions[axis][i] - origin_[axis]) / width_),
+            shape_[axis] - 1);
+      }
+      cell_of_[i] = static_cast<Index>(flatten(cell));
+      ++cell_offsets_[cell_of_[i] + 1];
+    }
+    for (size_t c = 0; c < cellCount(); ++c) {
+      cell_offsets_[c + 1] += cell_offsets_[c];
+    }
+    particles_.resize(n);
+    std::vector<size_t> fill(cell_offsets_.begin(), cell_offsets_.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+      particles_[fill[cell_of_[i]]++] = static_cast<Index>(i);
+    }
+  }
+
+  [[nodiscard]] size_t cellCount() const {
+    size_t count = 1;
+    for (auto side : shape_) {
+      count *= side;
+    }
+    return count;
+  }
+
+  [[nodiscard]] const Cell &shape() const { return shape_; }
+  [[nodiscard]] Scalar width() const { return width_; }
+
+  /**
+   * @brief The cell of a particle, as a flat index.
+   */
+  [[nodiscard]] size_t cellOf(size_t particle) const {
+    return cell_of_[particle];
+  }
+
+  /**
+   * @brief The particles in a cell.
+   */
+  [[nodiscard]] std::span<const Index> particles(size_t cell) const {
+    return {particles_.data() + cell_offsets_[cell],
+            cell_offsets_[cell + 1] - cell_offsets_[cell]};
+  }
+
+  /**
+   * @brief Call func(cell) for a cell and every existing cell around it.
+   */
+  template <typename Func>
+  void forEachAdjacentCell(size_t cell, Func &&func) const {
+    const auto center = unflatten(cell);
+    size_t combinations = 1;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      combinations *= 3;
+    }
+    for (size_t code = 0; code < combinations; ++code) {
+      Cell other;
+      bool inside = true;
+      auto rest = code;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        const auto offset = static_cast<std::ptrdiff_t>(rest % 3) - 1;
+        rest /= 3;
+        const auto index = static_cast<std::ptrdiff_t>(center[axis]) + offset;
+        inside = inside && index >= 0 &&
+                 index < static_cast<std::ptrdiff_t>(shape_[axis]);
+        other[axis] = static_cast<size_t>(index);
+      }
+      if (inside) {
+        func(flatten(other));
+      }
+    }
+  }
+
+private:
+  [[nodiscard]] size_t flatten(const Cell &cell) const {
+    size_t index = 0;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      index = index * shape_[axis] + cell[axis];
+    }
+    return index;
+  }
+
+  [[nodiscard]] Cell unflatten(size_t index) const {
+    Cell cell;
+    for (size_t axis = kDimension; axis-- > 0;) {
+      cell[axis] = index % shape_[axis];
+      index /= shape_[axis];
+    }
+    return cell;
+  }
+
+  std::array<Scalar, kDimension> origin_{};
+  Cell shape_{};
+  Scalar width_ = 0;
+  std::vector<Index> cell_of_;
+  std::vector<size_t> cell_offsets_{0};
+  std::vector<Index> particles_;
+};
+
+/**
+ * @brief For every particle, the other particles within a radius.
+ * @details The lists are built from a CellList and stored back to back, so the
+ * neighbors of a particle are one contiguous array. Every pair is listed for
+ * both of its particles, which lets a force loop write only to its own
+ * particle. The build runs on the threads of the configuration: one pass
+ * counts the neighbors, a second pass fills them in.
+ * @tparam kDimension The number of spatial dimensions.
+ * @tparam Scalar The type of the coordinates.
+ */
+template <size_t kDimension, typename Scalar = double> class NeighborList {
+public:
+  using Index = std::uint32_t;
+  using ConstComponents = ComponentSpan<const Scalar, kDimension>;
+
+  void build(ConstComponents positions, Scalar radius,
+             const ParallelConfig &parallel) {
+    const auto n = positions.size();
+    radius_ = radius;
+    cells_.build(positions, radius);
+    offsets_.assign(n + 1, 0);
+
+    const auto radius2 = radius * radius;
+    auto visit = [&](size_t i, auto &&emit) {
+      cells_.forEachAdjacentCell(cells_.cellOf(i), [&](size_t cell) {
+        for (auto j : cells_.particles(cell)) {
+          if (j == i) {
+            continue;
+          }
+          Scalar distance2 = 0;
+          for (size_t axis = 0; axis < kDimension; ++axis) {
+            auto d = positions[axis][i] - positions[axis][j];
+            distance2 += d * d;
+          }
+          if (distance2 <= radius2) {
+            emit(j);
+          }
+        }
+      });
+    };
+
+    parallelFor(parallel, n, [&](size_t i) {
+      size_t count = 0;
+      visit(i, [&](Index) { ++count; });
+      offsets_[i + 1] = count;
+    });
+    for (size_t i = 0; i < n; ++i) {
+      offsets_[i + 1] += offsets_[i];
+    }
+    neighbors_.resize(offsets_.back());
+    parallelFor(parallel, n, [&](size_t i) {
+      auto next = offsets_[i];
+      visit(i, [&](Index j) { neighbors_[next++] = j; });
+    });
+  }
+
+  [[nodiscard]] size_t size() const { return offsets_.size() - 1; }
+  [[nodiscard]] Scalar radius() const { return radius_; }
+
+  /**
+   * @brief The number of stored entries, twice the number of pairs.
+   */
+  [[nodiscard]] size_t entries() const { return neighbors_.size(); }
+
+  [[nodiscard]] std::span<const Index> neighbors(size_t particle) const {
+    return {neighbors_.data() + offsets_[particle],
+            offsets_[particle + 1] - offsets_[particle]};
+  }
+
+  [[nodiscard]] const CellList<kDimension, Scalar> &cells() const {
+    return cells_;
+  }
+
+private:
+  Scalar radius_ = 0;
+  CellList<kDimension, Scalar> cells_;
+  std::vector<size_t> offsets_{0};
+  std::vector<Index> neighbors_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_NEIGHBORLIST_H
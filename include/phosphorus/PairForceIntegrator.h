@@ -0,0 +1,225 @@
+//
+// Created by Renatus Madrigal on 6/19/2025.
+//
+
+/**
+ * @file PairForceIntegrator.h
+ * @brief Verlet integrator for short-range pair forces with a cutoff.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_PAIRFORCEINTEGRATOR_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_PAIRFORCEINTEGRATOR_H
+
+#include "phosphorus/NeighborList.h"
+#include "phosphorus/PairPotential.h"
+#include "phosphorus/Parallel.h"
+#include "phosphorus/VerletIntegrator.h"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief Verlet integrator for particles interacting through a pair potential
+ * which is cut off at a finite distance.
+ * @details The forces are summed over a Verlet neighbor list of radius
+ * cutoff + skin. The list stays valid until some particle has moved by more
+ * than half of the skin since it was built, because no pair can have closed
+ * in from beyond the list radius to within the cutoff before that. Until then
+ * the list is reused, and a step costs O(N) with the number of neighbors.
+ *
+ * A larger skin means fewer rebuilds but longer lists. About 10% to 30% of the
+ * cutoff is usual.
+ * @tparam Potential The pair potential, see PairPotential.
+ * @tparam Coord The Cartesian coordinate system used for the simulation.
+ * @tparam ParticleType The Particle type to be integrated.
+ */
+template <typename Potential, typename Coord, typename ParticleType>
+  requires PairPotential<Potential>
+class PairForceIntegrator
+    : public BaseVerletIntegrator<
+          PairForceIntegrator<Potential, Coord, ParticleType>, Coord,
+          ParticleType> {
+  using Base = BaseVerletIntegrator<PairForceIntegrator, Coord, ParticleType>;
+  friend Base;
+
+public:
+  using TimeType = typename Base::TimeType;
+  using CoordinateVec = typename Base::CoordinateVec;
+  using Vector = typename Base::Vector;
+  using iterator = typename Base::iterator;
+  using Scalar = typename Base::Scalar;
+  using List = NeighborList<Base::kDimension, Scalar>;
+
+  static constexpr size_t kDimension = Base::kDimension;
+
+  /**
+   * @param potential The pair potential.
+   * @param cutoff Pairs further apart than this do not interact.
+   * @param skin The extra radius of the neighbor list.
+   * @param parallel The threads used by the force loop and the list build.
+   */
+  PairForceIntegrator(Potential potential, Scalar cutoff, Scalar skin,
+                      const ParallelConfig &parallel = {})
+      : potential_(std::move(potential)), cutoff_(cutoff), skin_(skin),
+        parallel_(parallel) {
+    if (!(cutoff > 0) || skin < 0) {
+      throw std::invalid_argument(
+          "Cutoff must be positive and skin non-negative");
+    }
+  }
+
+  [[nodiscard]] const Potential &potential() const { return potential_; }
+  [[nodiscard]] Scalar cutoff() const { return cutoff_; }
+  [[nodiscard]] Scalar skin() const { return skin_; }
+
+  void setParallelConfig(const ParallelConfig &parallel) {
+    parallel_ = parallel;
+  }
+  [[nodiscard]] const ParallelConfig &parallelConfig() const {
+    return parallel_;
+  }
+
+  /**
+   * @brief The neighbor list used by the last force evaluation.
+   */
+  [[nodiscard]] const List &neighborList() const { return list_; }
+
+  /**
+   * @brief How many times the neighbor list has been built.
+   */
+  [[nodiscard]] size_t rebuildCount() const { return rebuilds_; }
+
+  /**
+   * @brief The total potential energy of the pairs within the cutoff.
+   * @details This is a query: if the neighbor list is out of date, a
+   * temporary one is built, and rebuildCount is unchanged.
+   */
+  [[nodiscard]] Scalar potentialEnergy() const {
+    const auto &storage = this->storage_;
+    const auto n = storage.size();
+    const auto cutoff2 = cutoff_ * cutoff_;
+    const List *list = &list_;
+    List fresh;
+    if (!listIsCurrent()) {
+      fresh.build(storage.positionComponents(), cutoff_ + skin_, parallel_);
+      list = &fresh;
+    }
+    std::vector<Scalar> energy(n);
+    parallelFor(parallel_, n, [&](size_t i) {
+      for (auto j : list->neighbors(i)) {
+        if (j > i) {
+          if (auto r2 = distance2(i, j); r2 < cutoff2) {
+            energy[i] += potential_.energy(r2);
+          }
+        }
+      }
+    });
+    Scalar total = 0;
+    for (auto value : energy) {
+      total += value;
+    }
+    return total;
+  }
+
+private:
+  using AccelerationSpan = typename Base::AccelerationSpan;
+
+  [[nodiscard]] Scalar distance2(size_t i, size_t j) const {
+    const auto &storage = this->storage_;
+    Scalar result = 0;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      auto d = storage.positions(axis)[i] - storage.positions(axis)[j];
+      result += d * d;
+    }
+    return result;
+  }
+
+  /**
+   * @brief Whether the neighbor list still holds every pair within the cutoff.
+   */
+  [[nodiscard]] bool listIsCurrent() const {
+    const auto half_skin = skin_ / 2;
+    return rebuilds_ != 0 && list_.size() == this->storage_.size() &&
+           maxDisplacement2() <= half_skin * half_skin;
+  }
+
+  /**
+   * @brief Rebuild the neighbor list if it may have missed a pair.
+   */
+  void updateList() const {
+    const auto &storage = this->storage_;
+    if (!listIsCurrent()) {
+      list_.build(storage.positionComponents(), cutoff_ + skin_, parallel_);
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        const auto positions = storage.positions(axis);
+        reference_[axis].assign(positions.begin(), positions.end());
+      }
+      ++rebuilds_;
+    }
+  }
+
+  /**
+   * @brief The largest squared distance moved since the list was built.
+   */
+  [[nodiscard]] Scalar maxDisplacement2() const {
+    const auto &storage = this->storage_;
+    std::vector<Scalar> largest(static_cast<size_t>(parallel_.threads()));
+    parallelForThreads(parallel_, storage.size(), [&](size_t i, int thread) {
+      Scalar moved2 = 0;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        auto d = storage.positions(axis)[i] - reference_[axis][i];
+        moved2 += d * d;
+      }
+      largest[thread] = std::max(largest[thread], moved2);
+    });
+    return *std::max_element(largest.begin(), largest.end());
+  }
+
+  void computeAccelerationsImpl(AccelerationSpan acc) const {
+    updateList();
+    const auto &storage = this->storage_;
+    const auto masses = storage.masses();
+    const auto cutoff2 = cutoff_ * cutoff_;
+    parallelFor(parallel_, storage.size(), [&](size_t i) {
+      Scalar position[kDimension];
+      Scalar result[kDimension] = {};
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        position[axis] = storage.positions(axis)[i];
+      }
+      for (auto j : list_.neighbors(i)) {
+        Scalar d[kDimension];
+        Scalar r2 = 0;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          d[axis] = position[axis] - storage.positions(axis)[j];
+          r2 += d[axis] * d[axis];
+        }
+        if (r2 < cutoff2) {
+          const auto factor = potential_.forceOverDistance(r2);
+          for (size_t axis = 0; axis < kDimension; ++axis) {
+            result[axis] += factor * d[axis];
+          }
+        }
+      }
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        acc[axis][i] = result[axis] / masses[i];
+      }
+    });
+  }
+
+  Potential potential_;
+  Scalar cutoff_;
+  Scalar skin_;
+  ParallelConfig parallel_;
+
+  mutable List list_;
+  mutable std::array<std::vector<Scalar>, kDimension> reference_;
+  mutable size_t rebuilds_ = 0;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_PAIRFORCEINTEGRATOR_H
@@ -0,0 +1,84 @@
+//
+// Created by Renatus Madrigal on 6/19/2025.
+//
+
+/**
+ * @file PairPotential.h
+ * @brief Short-range pair potentials for PairForceIntegrator.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_PAIRPOTENTIAL_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_PAIRPOTENTIAL_H
+
+#include <cmath>
+#include <concepts>
+
+namespace phosphorus {
+
+/**
+ * PairPotential is a concept that represents a central pair interaction.
+ * Both methods take the squared distance r2 of the pair, so the hot loop never
+ * needs a square root unless the potential does:
+ * - forceOverDistance(r2) returns F(r) / r, where F(r) = -dU/dr is the
+ *   repulsive magnitude of the force. The force on particle i from particle j
+ *   is then forceOverDistance(r2) * (x_i - x_j).
+ * - energy(r2) returns U(r).
+ */
+template <typename Potential>
+concept PairPotential = requires(const Potential p, double r2) {
+  { p.forceOverDistance(r2) } -> std::convertible_to<double>;
+  { p.energy(r2) } -> std::convertible_to<double>;
+};
+
+/**
+ * @brief The Lennard-Jones 12-6 potential,
+ * U(r) = 4 epsilon ((sigma / r)^12 - (sigma / r)^6).
+ */
+struct LennardJones {
+  double epsilon = 1; ///< Depth of the well
+  double sigma = 1;   ///< Distance at which the potential is zero
+
+  [[nodiscard]] double forceOverDistance(double r2) const {
+    const auto s2 = sigma * sigma / r2;
+    const auto s6 = s2 * s2 * s2;
+    return 24 * epsilon * (2 * s6 * s6 - s6) / r2;
+  }
+
+  [[nodiscard]] double energy(double r2) const {
+    const auto s2 = sigma * sigma / r2;
+    const auto s6 = s2 * s2 * s2;
+    return 4 * epsilon * (s6 * s6 - s6);
+  }
+};
+
+/**
+ * @brief A soft harmonic repulsion, U(r) = stiffness (range - r)^2 / 2 for
+ * r < range and 0 beyond.
+ * @details The potential and the force go to zero at the range, so it can be
+ * cut off there without an energy jump.
+ */
+struct SoftSpring {
+  double stiffness = 1; ///< Spring constant
+  double range = 1;     ///< Distance beyond which the particles do not touch
+
+  [[nodiscard]] double forceOverDistance(double r2) const {
+    // Coincident particles have no direction to push apart along.
+    if (r2 >= range * range || !(r2 > 0)) {
+      return 0;
+    }
+    const auto r = std::sqrt(r2);
+    return stiffness * (range - r) / r;
+  }
+
+  [[nodiscard]] double energy(double r2) const {
+    if (r2 >= range * range) {
+      return 0;
+    }
+    const auto overlap = range - std::sqrt(r2);
+    return 0.5 * stiffness * overlap * overlap;
+  }
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_PAIRPOTENTIAL_H
@@ -0,0 +1,153 @@
+//
+// Created by Renatus Madrigal on 6/15/2025.
+//
+
+/**
+ * @file Parallel.h
+ * @brief Thread configuration shared by the parallel force evaluations.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_PARALLEL_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace phosphorus {
+
+/**
+ * @brief How a parallel loop is executed.
+ * @details The default configuration is serial, so integrators which are
+ * already run on many threads (one system per thread) do not oversubscribe the
+ * machine unless asked to.
+ */
+struct ParallelConfig {
+  enum class Schedule {
+    Static,  ///< Contiguous blocks of iterations, decided up front.
+    Dynamic, ///< Chunks of iterations handed out on demand.
+  };
+
+  int num_threads = 1;                  ///< 1 is serial, 0 is OpenMP's default
+  Schedule schedule = Schedule::Static; ///< How iterations are partitioned
+  size_t chunk_size = 0;                ///< 0 lets the schedule choose
+  /// Require the rounding of the serial run. Most loops write only the
+  /// result of their own iteration and are deterministic anyway; the flag is
+  /// honored by the loops which combine partial results across threads, so
+  /// far only the symmetric kernel of GravityIntegrator, which then falls
+  /// back to the direct one.
+  bool deterministic = false;
+
+  /**
+   * @brief The number of threads the loop will actually use.
+   */
+  [[nodiscard]] int threads() const {
+#ifdef _OPENMP
+    return num_threads > 0 ? num_threads : omp_get_max_threads();
+#else
+    return 1;
+#endif
+  }
+
+  [[nodiscard]] bool serial() const { return threads() <= 1; }
+
+  static ParallelConfig serialConfig() { return {}; }
+};
+
+/**
+ * @brief Run body(i, thread) for every i in [0, n) according to the
+ * configuration.
+ * @details thread is the index of the executing thread in
+ * [0, config.threads()), which lets the body write to per-thread buffers.
+ */
+template <typename Func>
+void parallelForThreads(const ParallelConfig &config, size_t n, Func &&body) {
+#ifdef _OPENMP
+  if (!config.serial() && n > 1) {
+    const int threads = config.threads();
+    const auto count = static_cast<std::ptrdiff_t>(n);
+    const auto chunk = static_cast<int>(config.chunk_size);
+    const bool dynamic = config.schedule == ParallelConfig::Schedule::Dynamic;
+    const int dynamic_chunk = chunk > 0 ? chunk : 16;
+#pragma omp parallel num_threads(threads)
+    {
+      const int thread = omp_get_thread_num();
+      if (dynamic) {
+#pragma omp for schedule(dynamic, dynamic_chunk)
+        for (std::ptrdiff_t i = 0; i < count; ++i) {
+          body(static_cast<size_t>(i), thread);
+        }
+      } else if (chunk > 0) {
+#pragma omp for schedule(static, chunk)
+        for (std::ptrdiff_t i = 0; i < count; ++i) {
+          body(static_cast<size_t>(i), thread);
+        }
+      } else {
+#pragma omp for schedule(static)
+        for (std::ptrdiff_t i = 0; i < count; ++i) {
+          body(static_cast<size_t>(i), thread);
+        }
+      }
+    }
+    return;
+  }
+#endif
+  for (size_t i = 0; i < n; ++i) {
+    body(i, 0);
+  }
+}
+
+/**
+ * @brief Run body(i) for every i in [0, n) according to the configuration.
+ * @details Every iteration is run exactly once, so loops whose iterations are
+ * independent give the same result for any thread count and schedule.
+ */
+template <typename Func>
+void parallelFor(const ParallelConfig &config, size_t n, Func &&body) {
+  parallelForThreads(config, n, [&](size_t i, int) { body(i); });
+}
+
+/**
+ * @brief Sort [first, last) with the threads of the configuration.
+ * @details Every thread sorts one block, then neighbouring blocks are merged
+ * pairwise until a single block is left.
+ */
+template <typename RandomIt, typename Compare>
+void parallelSort(const ParallelConfig &config, RandomIt first, RandomIt last,
+                  Compare comp) {
+  const auto n = static_cast<size_t>(std::distance(first, last));
+  const auto blocks = static_cast<size_t>(config.threads());
+  if (blocks <= 1 || n < 2 * blocks) {
+    std::sort(first, last, comp);
+    return;
+  }
+
+  auto boundary = [&](size_t block) {
+    return first + static_cast<std::ptrdiff_t>(n * block / blocks);
+  };
+
+  parallelFor(config, blocks, [&](size_t block) {
+    std::sort(boundary(block), boundary(block + 1), comp);
+  });
+
+  for (size_t width = 1; width < blocks; width *= 2) {
+    const auto merges = (blocks + 2 * width - 1) / (2 * width);
+    parallelFor(config, merges, [&](size_t merge) {
+      const auto begin = merge * 2 * width;
+      const auto middle = std::min(begin + width, blocks);
+      const auto end = std::min(begin + 2 * width, blocks);
+      if (middle < end) {
+        std::inplace_merge(boundary(begin), boundary(middle), boundary(end),
+                           comp);
+      }
+    });
+  }
+}
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_PARALLEL_H
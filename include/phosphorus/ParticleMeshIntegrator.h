@@ -0,0 +1,416 @@
+//
+// Created by Renatus Madrigal on 6/18/2025.
+//
+
+/**
+ * @file ParticleMeshIntegrator.h
+ * @brief Verlet integrator with particle-mesh gravity.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_PARTICLEMESHINTEGRATOR_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_PARTICLEMESHINTEGRATOR_H
+
+#include "phosphorus/FFT.h"
+#include "phosphorus/Parallel.h"
+#include "phosphorus/ScitificConstants.h"
+#include "phosphorus/VerletIntegrator.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <numbers>
+#include <stdexcept>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief Verlet integrator for particle simulation with particle-mesh gravity.
+ * @details Every force evaluation
+ *
+ * 1. deposits the masses onto a cubic grid with the cloud-in-cell scheme,
+ * 2. solves the Poisson equation for the potential with FFTs,
+ * 3. differentiates the potential with central differences and interpolates
+ *    the accelerations back to the particles with the same cloud-in-cell
+ *    weights.
+ *
+ * The cost is O(N + M log M) for M grid cells, but forces are smoothed over
+ * about two cells, so the method suits near-uniform distributions rather than
+ * close encounters. Because deposition and interpolation use the same weights
+ * the forces between particles are antisymmetric, and momentum is conserved.
+ *
+ * Two boundaries are supported:
+ *
+ * - Isolated (the default): the box is fitted to the particles on every
+ *   evaluation and the grid is zero-padded to twice its size, which gives the
+ *   same physics as GravityIntegrator.
+ * - Periodic: the particles live in a fixed periodic box. Positions outside of
+ *   the box are folded into it, and the mean density does not attract.
+ *
+ * Deposition and interpolation run in parallel. Deposition walks the planes of
+ * the grid in two interleaved passes, so no two threads write the same cell,
+ * and the result does not depend on the number of threads.
+ * @tparam Coord The 3D Cartesian coordinate system used for the simulation.
+ * @tparam ParticleType The Particle type to be integrated.
+ */
+template <typename Coord, typename ParticleType>
+class ParticleMeshGravityIntegrator
+    : public BaseVerletIntegrator<
+          ParticleMeshGravityIntegrator<Coord, ParticleType>, Coord,
+          ParticleType> {
+  using Base =
+      BaseVerletIntegrator<ParticleMeshGravityIntegrator, Coord, ParticleType>;
+  friend Base;
+
+  static_assert(Base::kDimension == 3,
+                "Particle-mesh gravity is implemented for 3D only");
+
+public:
+  using Base::Base;
+  using TimeType = typename Base::TimeType;
+  using CoordinateVec = typename Base::CoordinateVec;
+  using Vector = typename Base::Vector;
+  using iterator = typename Base::iterator;
+  using Scalar = typename Base::Scalar;
+  using Complex = std::complex<Scalar>;
+
+  static constexpr size_t kDimension = Base::kDimension;
+  static constexpr double kGravityConstant = Constants::G;
+  static constexpr size_t kDefaultGridSize = 64;
+
+  enum class Boundary {
+    Isolated, ///< No images, the box follows the particles.
+    Periodic, ///< A fixed periodic box.
+  };
+
+  ParticleMeshGravityIntegrator() = default;
+
+  /**
+   * @brief Create an integrator with isolated boundaries.
+   * @param grid_size The number of cells along each axis, a power of two.
+   */
+  explicit ParticleMeshGravityIntegrator(size_t grid_size,
+                                         const ParallelConfig &parallel = {})
+      : parallel_(parallel) {
+    setGridSize(grid_size);
+  }
+
+  void setGridSize(size_t grid_size) {
+    if (grid_size < 4 || (grid_size & (grid_size - 1)) != 0) {
+      throw std::invalid_argument(
+          "Grid size must be a power of two and at least 4");
+    }
+    grid_size_ = grid_size;
+  }
+  [[nodiscard]] size_t gridSize() const { return grid_size_; }
+
+  /**
+   * @brief Use a periodic cubic box.
+   * @param origin The lowest corner of the box.
+   * @param size The side length of the box.
+   */
+  void setPeriodicBox(const Vector &origin, Scalar size) {
+    if (!(size > 0)) {
+      throw std::invalid_argument("Box size must be positive");
+    }
+    boundary_ = Boundary::Periodic;
+    origin_ = origin;
+    box_size_ = size;
+  }
+
+  /**
+   * @brief Use isolated boundaries, with a box fitted to the particles.
+   */
+  void setIsolated() { boundary_ = Boundary::Isolated; }
+
+  [[nodiscard]] Boundary boundary() const { return boundary_; }
+
+  /**
+   * @brief The lowest corner of the box. For isolated boundaries, the box of
+   * the last force evaluation.
+   */
+  [[nodiscard]] const Vector &boxOrigin() const { return origin_; }
+  [[nodiscard]] Scalar boxSize() const { return box_size_; }
+  [[nodiscard]] Scalar cellSize() const {
+    return box_size_ / static_cast<Scalar>(grid_size_);
+  }
+
+  void setParallelConfig(const ParallelConfig &parallel) {
+    parallel_ = parallel;
+  }
+  [[nodiscard]] const ParallelConfig &parallelConfig() const {
+    return parallel_;
+  }
+
+private:
+  using AccelerationSpan = typename Base::AccelerationSpan;
+
+  /// 1 / r averaged over a unit cube is 1 / kSelfDistance.
+  static constexpr Scalar kSelfDistance = 1 / 2.3800774;
+
+  /**
+   * @brief The cloud-in-cell stencil of a particle.
+   */
+  struct Stencil {
+    std::array<size_t, kDimension> low;  ///< Index of the lower cell
+    std::array<size_t, kDimension> high; ///< Index of the upper cell
+    std::array<Scalar, kDimension> weight; ///< Weight of the upper cell
+  };
+
+  [[nodiscard]] bool periodic() const {
+    return boundary_ == Boundary::Periodic;
+  }
+
+  /**
+   * @brief The side of the FFT grid, doubled for isolated boundaries.
+   */
+  [[nodiscard]] size_t meshSize() const {
+    return periodic() ? grid_size_ : 2 * grid_size_;
+  }
+
+  [[nodiscard]] size_t cell(size_t x, size_t y, size_t z) const {
+    const auto m = meshSize();
+    return (x * m + y) * m + z;
+  }
+
+  void computeAccelerationsImpl(AccelerationSpan acc) const {
+    const auto &storage = this->storage_;
+    const auto n = storage.size();
+    if (n == 0) {
+      return;
+    }
+    if (!periodic()) {
+      fitBox();
+    }
+
+    const auto m = meshSize();
+    prepareGreenFunction();
+    mesh_.assign(m * m * m, Complex{});
+    computeStencils();
+    deposit();
+
+    transformGrid<kDimension>(std::span<Complex>(mesh_), fft_, false,
+                              parallel_);
+    parallelFor(parallel_, mesh_.size(),
+                [&](size_t k) { mesh_[k] *= green_[k]; });
+    transformGrid<kDimension>(std::span<Complex>(mesh_), fft_, true,
+                              parallel_);
+
+    interpolate(acc);
+  }
+
+  /**
+   * @brief Fit the box to the particles, one empty cell on every side.
+   */
+  void fitBox() const {
+    const auto &storage = this->storage_;
+    Scalar extent = 0;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      const auto positions = storage.positions(axis);
+      auto [lo, hi] = std::minmax_element(positions.begin(), positions.end());
+      origin_[axis] = *lo;
+      extent = std::max(extent, *hi - *lo);
+    }
+    if (extent <= 0) {
+      extent = 1; // All the particles coincide
+    }
+    // Particles land in cells [1, N - 2], so the stencils and the central
+    // differences stay inside of the unpadded grid.
+    const auto h = extent / static_cast<Scalar>(grid_size_ - 3);
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      origin_[axis] -= h;
+    }
+    box_size_ = h * static_cast<Scalar>(grid_size_);
+  }
+
+  /**
+   * @brief The Green's function of the mesh for a unit cell size, in Fourier
+   * space.
+   */
+  void prepareGreenFunction() const {
+    const auto m = meshSize();
+    if (fft_.size() == m && green_.size() == m * m * m &&
+        green_boundary_ == boundary_) {
+      return;
+    }
+    fft_ = FFT<Scalar>(m);
+    green_.assign(m * m * m, 0);
+    green_boundary_ = boundary_;
+
+    if (periodic()) {
+      // Invert the Laplacian of the central differences, which is consistent
+      // with the gradient used for the forces.
+      const auto four_pi_g = 4 * std::numbers::pi_v<Scalar> * kGravityConstant;
+      parallelFor(parallel_, m, [&](size_t x) {
+        for (size_t y = 0; y < m; ++y) {
+          for (size_t z = 0; z < m; ++z) {
+            Scalar laplacian = 0;
+            for (auto i : {x, y, z}) {
+              auto s = std::sin(std::numbers::pi_v<Scalar> *
+                                static_cast<Scalar>(i) /
+                                static_cast<Scalar>(m));
+              laplacian += 4 * s * s;
+            }
+            green_[cell(x, y, z)] = laplacian > 0 ? -four_pi_g / laplacian : 0;
+          }
+        }
+      });
+      return;
+    }
+
+    // Sample -G / r on the doubled grid, with the offsets wrapped around, so
+    // the cyclic convolution of the padded grid is the open sum.
+    std::vector<Complex> kernel(m * m * m);
+    parallelFor(parallel_, m, [&](size_t x) {
+      auto wrap = [m](size_t i) {
+        return static_cast<Scalar>(std::min(i, m - i));
+      };
+      for (size_t y = 0; y < m; ++y) {
+        for (size_t z = 0; z < m; ++z) {
+          auto dx = wrap(x), dy = wrap(y), dz = wrap(z);
+          auto r = std::sqrt(dx * dx + dy * dy + dz * dz);
+          kernel[cell(x, y, z)] =
+              -kGravityConstant / (r > 0 ? r : kSelfDistance);
+        }
+      }
+    });
+    transformGrid<kDimension>(std::span<Complex>(kernel), fft_, false,
+                              parallel_);
+    // The kernel is real and even, so its transform is real.
+    parallelFor(parallel_, kernel.size(),
+                [&](size_t k) { green_[k] = kernel[k].real(); });
+  }
+
+  void computeStencils() const {
+    const auto &storage = this->storage_;
+    const auto n = storage.size();
+    const auto h = cellSize();
+    const auto size = static_cast<std::ptrdiff_t>(grid_size_);
+    stencils_.resize(n);
+    parallelFor(parallel_, n, [&](size_t i) {
+      auto &stencil = stencils_[i];
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        // Cell centers sit at half-integer coordinates.
+        auto u = (storage.positions(axis)[i] - origin_[axis]) / h - 0.5;
+        auto base = std::floor(u);
+        auto low = static_cast<std::ptrdiff_t>(base);
+        stencil.weight[axis] = u - base;
+        if (periodic()) {
+          low = ((low % size) + size) % size;
+          stencil.low[axis] = static_cast<size_t>(low);
+          stencil.high[axis] = static_cast<size_t>((low + 1) % size);
+        } else {
+          low = std::clamp<std::ptrdiff_t>(low, 0, size - 2);
+          stencil.low[axis] = static_cast<size_t>(low);
+          stencil.high[axis] = static_cast<size_t>(low + 1);
+        }
+      }
+    });
+  }
+
+  /**
+   * @brief Call func(cell, weight) for the eight cells of a stencil.
+   */
+  template <typename Func>
+  void forEachCorner(const Stencil &stencil, Func &&func) const {
+    for (size_t corner = 0; corner < 8; ++corner) {
+      std::array<size_t, kDimension> index;
+      Scalar weight = 1;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        const bool upper = (corner >> axis) & 1;
+        index[axis] = upper ? stencil.high[axis] : stencil.low[axis];
+        weight *= upper ? stencil.weight[axis] : 1 - stencil.weight[axis];
+      }
+      func(index, weight);
+    }
+  }
+
+  /**
+   * @brief Spread the masses over the grid.
+   * @details The particles are bucketed by the plane of their lower cell. A
+   * particle of plane p only writes to planes p and p + 1, so all the even
+   * planes can be deposited at once, and then all the odd ones.
+   */
+  void deposit() const {
+    const auto &storage = this->storage_;
+    const auto n = storage.size();
+    const auto masses = storage.masses();
+
+    bucket_offsets_.assign(grid_size_ + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+      ++bucket_offsets_[stencils_[i].low[0] + 1];
+    }
+    for (size_t p = 0; p < grid_size_; ++p) {
+      bucket_offsets_[p + 1] += bucket_offsets_[p];
+    }
+    buckets_.resize(n);
+    std::vector<size_t> fill(bucket_offsets_.begin(),
+                             bucket_offsets_.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+      buckets_[fill[stencils_[i].low[0]]++] = i;
+    }
+
+    for (size_t parity = 0; parity < 2; ++parity) {
+      parallelFor(parallel_, grid_size_ / 2, [&](size_t half) {
+        const auto plane = 2 * half + parity;
+        for (auto k = bucket_offsets_[plane]; k < bucket_offsets_[plane + 1];
+             ++k) {
+          const auto i = buckets_[k];
+          forEachCorner(stencils_[i], [&](const auto &index, Scalar weight) {
+            mesh_[cell(index[0], index[1], index[2])] += weight * masses[i];
+          });
+        }
+      });
+    }
+  }
+
+  void interpolate(AccelerationSpan acc) const {
+    const auto n = this->storage_.size();
+    const auto m = meshSize();
+    const auto h = cellSize();
+    // The Green's function is for unit cells: the potential scales as 1 / h,
+    // and the central difference divides by 2h once more.
+    const auto scale = -1 / (2 * h * h);
+
+    auto potential = [&](std::array<size_t, kDimension> index, size_t axis,
+                         bool up) {
+      index[axis] = up ? (index[axis] + 1) % m : (index[axis] + m - 1) % m;
+      return mesh_[cell(index[0], index[1], index[2])].real();
+    };
+
+    parallelFor(parallel_, n, [&](size_t i) {
+      Scalar result[kDimension] = {};
+      forEachCorner(stencils_[i], [&](const auto &index, Scalar weight) {
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          result[axis] += weight * (potential(index, axis, true) -
+                                    potential(index, axis, false));
+        }
+      });
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        acc[axis][i] = scale * result[axis];
+      }
+    });
+  }
+
+  size_t grid_size_ = kDefaultGridSize;
+  Boundary boundary_ = Boundary::Isolated;
+  ParallelConfig parallel_;
+
+  // Fitted to the particles for isolated boundaries.
+  mutable Vector origin_{};
+  mutable Scalar box_size_ = 1;
+
+  // Rebuilt on every force evaluation, kept to reuse the allocations.
+  mutable FFT<Scalar> fft_;
+  mutable std::vector<Scalar> green_;
+  mutable Boundary green_boundary_ = Boundary::Isolated;
+  mutable std::vector<Complex> mesh_;
+  mutable std::vector<Stencil> stencils_;
+  mutable std::vector<size_t> bucket_offsets_;
+  mutable std::vector<size_t> buckets_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_PARTICLEMESHINTEGRATOR_H
@@ -0,0 +1,333 @@
+//
+// Created by Renatus Madrigal on 6/14/2025.
+//
+
+/**
+ * @file ParticleStorage.h
+ * @brief Structure-of-arrays storage for the particles of an integrator.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_PARTICLESTORAGE_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_PARTICLESTORAGE_H
+
+#include "phosphorus/Coordinate.h"
+#include "phosphorus/Particle.h"
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief An allocator that returns memory aligned to kAlignment bytes.
+ * @details The hot loops of the integrators run over plain arrays of scalars.
+ * Aligning them to a cache line lets the compiler use aligned vector loads.
+ * @tparam T The value type.
+ * @tparam kAlignment The alignment in bytes, must be a power of two.
+ */
+template <typename T, size_t kAlignment = 64> class AlignedAllocator {
+  static_assert((kAlignment & (kAlignment - 1)) == 0,
+                "Alignment must be a power of two");
+  static_assert(kAlignment >= alignof(T), "Alignment is too small");
+
+public:
+  using value_type = T;
+
+  template <typename U> struct rebind {
+    using other = AlignedAllocator<U, kAlignment>;
+  };
+
+  AlignedAllocator() noexcept = default;
+
+  template <typename U>
+  explicit AlignedAllocator(const AlignedAllocator<U, kAlignment> &) noexcept {}
+
+  [[nodiscard]] T *allocate(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+      throw std::bad_array_new_length();
+    }
+    return static_cast<T *>(
+        ::operator new(n * sizeof(T), std::align_val_t{kAlignment}));
+  }
+
+  void deallocate(T *ptr, size_t) noexcept {
+    ::operator delete(ptr, std::align_val_t{kAlignment});
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, kAlignment> &) const noexcept {
+    return true;
+  }
+};
+
+template <typename T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+/**
+ * @brief A view of a vector quantity stored as one array per component.
+ * @tparam Scalar The scalar type, const-qualified for a read-only view.
+ * @tparam kDimension The number of components.
+ */
+template <typename Scalar, size_t kDimension> class ComponentSpan {
+public:
+  using Vector = phosphorus::Vector<kDimension, std::remove_const_t<Scalar>>;
+
+  ComponentSpan() = default;
+  explicit ComponentSpan(std::array<std::span<Scalar>, kDimension> components)
+      : components_(components) {}
+
+  /**
+   * @brief The array of one component.
+   */
+  std::span<Scalar> operator[](size_t axis) const { return components_[axis]; }
+
+  [[nodiscard]] size_t size() const {
+    return kDimension == 0 ? 0 : components_[0].size();
+  }
+
+  [[nodiscard]] Vector get(size_t index) const {
+    Vector result{};
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result[axis] = components_[axis][index];
+    }
+    return result;
+  }
+
+  void set(size_t index, const Vector &value) const
+    requires(!std::is_const_v<Scalar>)
+  {
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      components_[axis][index] = value[axis];
+    }
+  }
+
+  /**
+   * @brief The view of count elements starting at offset.
+   */
+  [[nodiscard]] ComponentSpan subspan(size_t offset, size_t count) const {
+    std::array<std::span<Scalar>, kDimension> result;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result[axis] = components_[axis].subspan(offset, count);
+    }
+    return ComponentSpan(result);
+  }
+
+private:
+  std::array<std::span<Scalar>, kDimension> components_{};
+};
+
+/**
+ * @brief Structure-of-arrays storage for particles.
+ * @details Every component of the position, velocity and acceleration lives in
+ * its own contiguous, aligned array, and so does the mass. The particle objects
+ * themselves are kept in a separate array, so the properties which are not used
+ * by the force loops (e.g. the charge) are never pulled through the cache.
+ * Positions are stored as the raw vectors of the coordinate system.
+ * @tparam Coord The coordinate system.
+ * @tparam ParticleType The type of the particle.
+ */
+template <typename Coord, typename ParticleType>
+  requires IsCoordinateVec<Coord> && Massive<ParticleType>
+class ParticleStorage {
+public:
+  using CoordinateVec = Coord;
+  using Vector = typename CoordinateVec::Vector;
+  using Scalar = typename CoordinateVec::Scalar;
+  using Array = AlignedVector<Scalar>;
+
+  static constexpr size_t kDimension = CoordinateVec::dimension();
+
+  using Components = ComponentSpan<Scalar, kDimension>;
+  using ConstComponents = ComponentSpan<const Scalar, kDimension>;
+
+  [[nodiscard]] size_t size() const { return particles_.size(); }
+  [[nodiscard]] bool empty() const { return particles_.empty(); }
+
+  void reserve(size_t n) {
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      position_[axis].reserve(n);
+      velocity_[axis].reserve(n);
+      acceleration_[axis].reserve(n);
+    }
+    mass_.reserve(n);
+    particles_.reserve(n);
+  }
+
+  void clear() {
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      position_[axis].clear();
+      velocity_[axis].clear();
+      acceleration_[axis].clear();
+    }
+    mass_.clear();
+    particles_.clear();
+  }
+
+  /**
+   * @brief Resize to n particles. New particles are default constructed, at
+   * the origin and at rest.
+   */
+  void resize(size_t n) {
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      position_[axis].resize(n);
+      velocity_[axis].resize(n);
+      acceleration_[axis].resize(n);
+    }
+    particles_.resize(n);
+    mass_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      mass_[i] = particles_[i].mass();
+    }
+  }
+
+  /**
+   * @brief Append a particle to the storage.
+   * @return The index of the new particle.
+   */
+  size_t push(const ParticleType &particle, const CoordinateVec &position,
+              const Vector &velocity, const Vector &acceleration) {
+    auto raw_position = position.toVector();
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      position_[axis].push_back(raw_position[axis]);
+      velocity_[axis].push_back(velocity[axis]);
+      acceleration_[axis].push_back(acceleration[axis]);
+    }
+    mass_.push_back(particle.mass());
+    particles_.push_back(particle);
+    return particles_.size() - 1;
+  }
+
+  /**
+   * @brief Remove a particle by moving the last one into its place.
+   * @details O(1), but the last particle changes its index.
+   * @return The old index of the moved particle, which equals index when the
+   * removed particle was the last one.
+   */
+  size_t swapRemove(size_t index) {
+    const auto last = particles_.size() - 1;
+    if (index != last) {
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        position_[axis][index] = position_[axis][last];
+        velocity_[axis][index] = velocity_[axis][last];
+        acceleration_[axis][index] = acceleration_[axis][last];
+      }
+      mass_[index] = mass_[last];
+      particles_[index] = std::move(particles_[last]);
+    }
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      position_[axis].pop_back();
+      velocity_[axis].pop_back();
+      acceleration_[axis].pop_back();
+    }
+    mass_.pop_back();
+    particles_.pop_back();
+    return last;
+  }
+
+  // Per-particle access. These gather from (or scatter to) the arrays.
+
+  [[nodiscard]] CoordinateVec position(size_t index) const {
+    return CoordinateVec::fromVector(gather(position_, index));
+  }
+  [[nodiscard]] Vector velocity(size_t index) const {
+    return gather(velocity_, index);
+  }
+  [[nodiscard]] Vector acceleration(size_t index) const {
+    return gather(acceleration_, index);
+  }
+  [[nodiscard]] const ParticleType &particle(size_t index) const {
+    return particles_[index];
+  }
+  [[nodiscard]] Scalar mass(size_t index) const { return mass_[index]; }
+
+  void setPosition(size_t index, const CoordinateVec &position) {
+    scatter(position_, index, position.toVector());
+  }
+  void setVelocity(size_t index, const Vector &velocity) {
+    scatter(velocity_, index, velocity);
+  }
+  void setAcceleration(size_t index, const Vector &acceleration) {
+    scatter(acceleration_, index, acceleration);
+  }
+  void setParticle(size_t index, const ParticleType &particle) {
+    particles_[index] = particle;
+    mass_[index] = particle.mass();
+  }
+
+  // Component arrays for the hot loops.
+
+  std::span<Scalar> positions(size_t axis) { return position_[axis]; }
+  std::span<Scalar> velocities(size_t axis) { return velocity_[axis]; }
+  std::span<Scalar> accelerations(size_t axis) { return acceleration_[axis]; }
+  [[nodiscard]] std::span<const Scalar> positions(size_t axis) const {
+    return position_[axis];
+  }
+  [[nodiscard]] std::span<const Scalar> velocities(size_t axis) const {
+    return velocity_[axis];
+  }
+  [[nodiscard]] std::span<const Scalar> accelerations(size_t axis) const {
+    return acceleration_[axis];
+  }
+  [[nodiscard]] std::span<const Scalar> masses() const { return mass_; }
+  [[nodiscard]] std::span<const ParticleType> particles() const {
+    return particles_;
+  }
+
+  // All components of a vector quantity at once.
+
+  Components positionComponents() { return components<Scalar>(position_); }
+  Components velocityComponents() { return components<Scalar>(velocity_); }
+  Components accelerationComponents() {
+    return components<Scalar>(acceleration_);
+  }
+  [[nodiscard]] ConstComponents positionComponents() const {
+    return components<const Scalar>(position_);
+  }
+  [[nodiscard]] ConstComponents velocityComponents() const {
+    return components<const Scalar>(velocity_);
+  }
+  [[nodiscard]] ConstComponents accelerationComponents() const {
+    return components<const Scalar>(acceleration_);
+  }
+
+private:
+  using Arrays = std::array<Array, kDimension>;
+
+  template <typename T, typename Source>
+  static ComponentSpan<T, kDimension> components(Source &arrays) {
+    std::array<std::span<T>, kDimension> result;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result[axis] = arrays[axis];
+    }
+    return ComponentSpan<T, kDimension>(result);
+  }
+
+  static Vector gather(const Arrays &components, size_t index) {
+    Vector result{};
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result[axis] = components[axis][index];
+    }
+    return result;
+  }
+
+  static void scatter(Arrays &components, size_t index,
+                      const Vector &value) {
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      components[axis][index] = value[axis];
+    }
+  }
+
+  Arrays position_;
+  Arrays velocity_;
+  Arrays acceleration_;
+  Array mass_;
+  std::vector<ParticleType> particles_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_PARTICLESTORAGE_H
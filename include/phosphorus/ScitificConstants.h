@@ -16,6 +16,7 @@ constexpr double M = 1.989e30;    ///> Mass of the Sun in kg
 constexpr double AU = 1.496e11;   ///> Astronomical unit in meters
 constexpr double DAY = 86400;     ///> One day in seconds
 constexpr double YEAR = 365.25 * DAY; ///> One year in seconds
+constexpr double K = 8.9875517923e9; ///> Coulomb constant in N m^2 C^-2
 
 } // namespace Constants
 
@@ -0,0 +1,356 @@
+//
+// Created by Renatus Madrigal on 6/16/2025.
+//
+
+/**
+ * @file SpatialTree.h
+ * @brief A quadtree (2D) or octree (3D) over the particles of an integrator.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_SPATIALTREE_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_SPATIALTREE_H
+
+#include "phosphorus/Parallel.h"
+#include "phosphorus/ParticleStorage.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief A 2^kDimension-ary tree stored as a flat array of nodes.
+ * @details The particles are sorted along a Morton (Z-order) curve, so every
+ * node owns a contiguous range of the sorted particles. The nodes are stored in
+ * depth-first order: the first child of a node directly follows it, and the
+ * next sibling is found by skipping the subtree. This makes stackless traversal
+ * a linear walk through the array.
+ *
+ * The tree is built in parallel: the top levels are split serially into
+ * independent subtrees, which are built on the threads and then spliced into
+ * the node array.
+ * @tparam kDimension 2 for a quadtree, 3 for an octree.
+ * @tparam Scalar The type of the coordinates.
+ */
+template <size_t kDimension, typename Scalar = double> class SpatialTree {
+  static_assert(kDimension == 2 || kDimension == 3,
+                "SpatialTree supports quadtrees and octrees only");
+
+public:
+  using Key = std::uint64_t;
+  using Index = std::uint32_t;
+  using ConstComponents = ComponentSpan<const Scalar, kDimension>;
+
+  static constexpr size_t kChildren = size_t{1} << kDimension;
+  /// The number of levels a Morton key can describe.
+  static constexpr size_t kMaxDepth = 64 / kDimension;
+  static constexpr Index kNoParent = std::numeric_limits<Index>::max();
+
+  struct Node {
+    std::array<Scalar, kDimension> center{}; ///< Geometric center of the cell
+    std::array<Scalar, kDimension> com{};    ///< Center of mass
+    Scalar half_size = 0;                    ///< Half of the side length
+    Scalar mass = 0;                         ///< Total mass in the cell
+    Index begin = 0;           ///< First particle, in tree order
+    Index end = 0;             ///< One past the last particle, in tree order
+    Index subtree_size = 1;    ///< Nodes in the subtree, including this one
+    Index parent = kNoParent;  ///< The parent node, kNoParent for the root
+    Index level = 0;           ///< Depth of the node, 0 for the root
+
+    [[nodiscard]] bool isLeaf() const { return subtree_size == 1; }
+    [[nodiscard]] Index count() const { return end - begin; }
+  };
+
+  /**
+   * @brief Rebuild the tree over a new set of particles.
+   * @param positions The positions, one array per component.
+   * @param masses The masses of the particles.
+   * @param leaf_size A cell with at most this many particles is not split.
+   * @param parallel The threads used by the build.
+   */
+  void build(ConstComponents positions, std::span<const Scalar> masses,
+             size_t leaf_size, const ParallelConfig &parallel) {
+    const auto n = masses.size();
+    leaf_size_ = std::max<size_t>(leaf_size, 1);
+    nodes_.clear();
+    resize(n);
+    if (n == 0) {
+      return;
+    }
+
+    auto root = computeRootCell(positions, parallel);
+    computeKeys(positions, root, parallel);
+    parallelSort(parallel, keyed_.begin(), keyed_.end(),
+                 [](const auto &lhs, const auto &rhs) { return lhs < rhs; });
+
+    parallelFor(parallel, n, [&](size_t i) {
+      auto [key, index] = keyed_[i];
+      keys_[i] = key;
+      order_[i] = index;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        positions_[axis][i] = positions[axis][index];
+      }
+      masses_[i] = masses[index];
+    });
+
+    if (parallel.serial()) {
+      buildNode(nodes_, root, kNoParent, kMaxDepth + 1, {}, nullptr);
+      return;
+    }
+
+    // Split the top of the tree into enough subtrees to keep the threads busy.
+    size_t cut = 1;
+    while (cut < kMaxDepth &&
+           (size_t{1} << (cut * kDimension)) <
+               8 * static_cast<size_t>(parallel.threads())) {
+      ++cut;
+    }
+
+    std::vector<Cell> tasks;
+    collectTasks(root, cut, tasks);
+
+    std::vector<std::vector<Node>> parts(tasks.size());
+    auto dynamic = parallel;
+    dynamic.schedule = ParallelConfig::Schedule::Dynamic;
+    dynamic.chunk_size = 1;
+    parallelFor(dynamic, tasks.size(), [&](size_t task) {
+      buildNode(parts[task], tasks[task], kNoParent, kMaxDepth + 1, {},
+                nullptr);
+    });
+
+    size_t next_part = 0;
+    buildNode(nodes_, root, kNoParent, cut, parts, &next_part);
+  }
+
+  [[nodiscard]] const std::vector<Node> &nodes() const { return nodes_; }
+  [[nodiscard]] const Node &node(Index index) const { return nodes_[index]; }
+  [[nodiscard]] size_t size() const { return order_.size(); }
+  [[nodiscard]] bool empty() const { return nodes_.empty(); }
+
+  /**
+   * @brief The original index of every particle, in tree order.
+   */
+  [[nodiscard]] std::span<const Index> order() const { return order_; }
+
+  /**
+   * @brief The positions of the particles, in tree order.
+   */
+  [[nodiscard]] std::span<const Scalar> positions(size_t axis) const {
+    return positions_[axis];
+  }
+
+  /**
+   * @brief The masses of the particles, in tree order.
+   */
+  [[nodiscard]] std::span<const Scalar> masses() const { return masses_; }
+
+  /**
+   * @brief Call func(child_index) for every child of a node.
+   */
+  template <typename Func> void forEachChild(Index index, Func &&func) const {
+    const auto last = index + nodes_[index].subtree_size;
+    for (Index child = index + 1; child < last;
+         child += nodes_[child].subtree_size) {
+      func(child);
+    }
+  }
+
+private:
+  struct Cell {
+    Index begin = 0;
+    Index end = 0;
+    Index level = 0;
+    std::array<Scalar, kDimension> center{};
+    Scalar half_size = 0;
+  };
+
+  void resize(size_t n) {
+    keyed_.resize(n);
+    keys_.resize(n);
+    order_.resize(n);
+    for (auto &array : positions_) {
+      array.resize(n);
+    }
+    masses_.resize(n);
+  }
+
+  Cell computeRootCell(ConstComponents positions,
+                       const ParallelConfig &parallel) const {
+    const auto n = positions.size();
+    const auto threads = static_cast<size_t>(parallel.threads());
+    using Bounds = std::array<std::pair<Scalar, Scalar>, kDimension>;
+    Bounds initial;
+    initial.fill({std::numeric_limits<Scalar>::max(),
+                  std::numeric_limits<Scalar>::lowest()});
+    std::vector<Bounds> bounds(threads, initial);
+
+    parallelForThreads(parallel, n, [&](size_t i, int thread) {
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        auto &[lo, hi] = bounds[thread][axis];
+        lo = std::min(lo, positions[axis][i]);
+        hi = std::max(hi, positions[axis][i]);
+      }
+    });
+
+    Cell root{0, static_cast<Index>(n), 0, {}, 0};
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      auto lo = initial[axis].first;
+      auto hi = initial[axis].second;
+      for (const auto &bound : bounds) {
+        lo = std::min(lo, bound[axis].first);
+        hi = std::max(hi, bound[axis].second);
+      }
+      root.center[axis] = 0.5 * (lo + hi);
+      root.half_size = std::max(root.half_size, 0.5 * (hi - lo));
+    }
+    if (root.half_size <= 0) {
+      root.half_size = 1; // All the particles coincide
+    }
+    return root;
+  }
+
+  void computeKeys(ConstComponents positions, const Cell &root,
+                   const ParallelConfig &parallel) {
+    constexpr auto kCells = static_cast<Scalar>(Key{1} << (kMaxDepth - 1)) * 2;
+    constexpr auto kMaxCell = (Key{1} << (kMaxDepth - 1)) * 2 - 1;
+    const auto scale = kCells / (2 * root.half_size);
+
+    parallelFor(parallel, positions.size(), [&](size_t i) {
+      std::array<Key, kDimension> cell;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        auto offset = positions[axis][i] - (root.center[axis] - root.half_size);
+        auto scaled = std::max<Scalar>(offset * scale, 0);
+        cell[axis] = std::min(static_cast<Key>(scaled), kMaxCell);
+      }
+      // Interleave the bits, most significant level first. Within a level,
+      // bit d of the child digit is the bit of axis d.
+      Key key = 0;
+      for (size_t level = 0; level < kMaxDepth; ++level) {
+        for (size_t axis = kDimension; axis-- > 0;) {
+          key = (key << 1) | ((cell[axis] >> (kMaxDepth - 1 - level)) & 1);
+        }
+      }
+      keyed_[i] = {key, static_cast<Index>(i)};
+    });
+  }
+
+  [[nodiscard]] bool isLeafCell(const Cell &cell) const {
+    return cell.end - cell.begin <= leaf_size_ || cell.level >= kMaxDepth;
+  }
+
+  template <typename Func>
+  void forEachChildCell(const Cell &cell, Func &&func) const {
+    const auto shift = (kMaxDepth - 1 - cell.level) * kDimension;
+    const auto digit_of = [shift](Key key) {
+      return (key >> shift) & (kChildren - 1);
+    };
+    const auto child_half = 0.5 * cell.half_size;
+
+    auto begin = keys_.begin() + cell.begin;
+    const auto end = keys_.begin() + cell.end;
+    while (begin != end) {
+      const auto digit = digit_of(*begin);
+      auto child_end = std::partition_point(
+          begin, end, [&](Key key) { return digit_of(key) == digit; });
+
+      Cell child{static_cast<Index>(begin - keys_.begin()),
+                 static_cast<Index>(child_end - keys_.begin()),
+                 cell.level + 1,
+                 cell.center,
+                 child_half};
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        child.center[axis] += (digit >> axis) & 1 ? child_half : -child_half;
+      }
+      func(child);
+      begin = child_end;
+    }
+  }
+
+  void collectTasks(const Cell &cell, size_t cut,
+                    std::vector<Cell> &tasks) const {
+    if (isLeafCell(cell)) {
+      return;
+    }
+    if (cell.level == cut) {
+      tasks.push_back(cell);
+      return;
+    }
+    forEachChildCell(
+        cell, [&](const Cell &child) { collectTasks(child, cut, tasks); });
+  }
+
+  /**
+   * @brief Append the subtree of a cell to out in depth-first order.
+   * @details Non-leaf cells at level cut are not built here: the next
+   * pre-built part is spliced in instead.
+   */
+  void buildNode(std::vector<Node> &out, const Cell &cell, Index parent,
+                 size_t cut, std::span<std::vector<Node>> parts,
+                 size_t *next_part) const {
+    const auto self = static_cast<Index>(out.size());
+    const bool leaf = isLeafCell(cell);
+
+    if (!leaf && cell.level == cut) {
+      auto &part = parts[(*next_part)++];
+      for (auto node : part) {
+        node.parent = node.parent == kNoParent ? parent : node.parent + self;
+        out.push_back(node);
+      }
+      return;
+    }
+
+    Node node;
+    node.center = cell.center;
+    node.half_size = cell.half_size;
+    node.begin = cell.begin;
+    node.end = cell.end;
+    node.parent = parent;
+    node.level = cell.level;
+    out.push_back(node);
+
+    Scalar mass = 0;
+    std::array<Scalar, kDimension> moment{};
+    if (leaf) {
+      for (auto i = cell.begin; i < cell.end; ++i) {
+        mass += masses_[i];
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          moment[axis] += masses_[i] * positions_[axis][i];
+        }
+      }
+    } else {
+      forEachChildCell(cell, [&](const Cell &child) {
+        const auto child_index = out.size();
+        buildNode(out, child, self, cut, parts, next_part);
+        const auto &built = out[child_index];
+        mass += built.mass;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          moment[axis] += built.mass * built.com[axis];
+        }
+      });
+    }
+
+    auto &result = out[self];
+    result.mass = mass;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result.com[axis] = mass > 0 ? moment[axis] / mass : cell.center[axis];
+    }
+    result.subtree_size = static_cast<Index>(out.size() - self);
+  }
+
+  size_t leaf_size_ = 8;
+  std::vector<Node> nodes_;
+  std::vector<std::pair<Key, Index>> keyed_;
+  std::vector<Key> keys_;
+  std::vector<Index> order_;
+  std::array<AlignedVector<Scalar>, kDimension> positions_;
+  AlignedVector<Scalar> masses_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_SPATIALTREE_H
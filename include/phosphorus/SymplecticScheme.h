@@ -0,0 +1,123 @@
+//
+// Created by Renatus Madrigal on 6/22/2025.
+//
+
+/**
+ * @file SymplecticScheme.h
+ * @brief Symplectic splitting schemes for the Verlet integrators.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_SYMPLECTICSCHEME_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_SYMPLECTICSCHEME_H
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+
+namespace phosphorus {
+
+/**
+ * @brief A symplectic splitting scheme in kick-drift-...-kick form.
+ * @details One step of length dt runs
+ *   v += kKicks[0] dt a, x += kDrifts[0] dt v, (forces),
+ *   v += kKicks[1] dt a, ..., x += kDrifts[m-1] dt v, (forces),
+ *   v += kKicks[m] dt a.
+ * The forces are evaluated after every drift, so a step costs kDrifts.size()
+ * evaluations. The last kick uses the forces at the final positions, which are
+ * also the forces of the first kick of the next step.
+ */
+template <typename Scheme>
+concept SymplecticScheme = requires {
+  { Scheme::kOrder } -> std::convertible_to<size_t>;
+  { Scheme::kKicks.size() } -> std::convertible_to<size_t>;
+  { Scheme::kDrifts.size() } -> std::convertible_to<size_t>;
+} && Scheme::kKicks.size() == Scheme::kDrifts.size() + 1;
+
+/**
+ * @brief Second-order velocity Verlet, one force evaluation per step.
+ */
+struct VelocityVerlet {
+  static constexpr size_t kOrder = 2;
+  static constexpr std::array<double, 2> kKicks{0.5, 0.5};
+  static constexpr std::array<double, 1> kDrifts{1.0};
+};
+
+/**
+ * @brief Yoshida's fourth-order scheme, three Verlet steps of w1, w0, w1 times
+ * dt with w1 = 1 / (2 - 2^(1/3)) and w0 = 1 - 2 w1.
+ * @details The middle step goes backwards in time. Three force evaluations per
+ * step.
+ */
+struct Yoshida4 {
+  static constexpr double kW1 = 1.3512071919596578;
+  static constexpr double kW0 = -1.7024143839193153;
+
+  static constexpr size_t kOrder = 4;
+  static constexpr std::array<double, 4> kKicks{
+      kW1 / 2, (kW1 + kW0) / 2, (kW0 + kW1) / 2, kW1 / 2};
+  static constexpr std::array<double, 3> kDrifts{kW1, kW0, kW1};
+};
+
+/**
+ * @brief The fourth-order scheme of Forest and Ruth.
+ * @details It was found at the same time as Yoshida4 and is the same
+ * composition of three Verlet steps.
+ */
+using ForestRuth = Yoshida4;
+
+/**
+ * @brief Yoshida's sixth-order scheme (solution A), seven Verlet steps of
+ * w3, w2, w1, w0, w1, w2, w3 times dt.
+ * @details Seven force evaluations per step, so it pays off only at tight
+ * tolerances.
+ */
+struct Yoshida6 {
+  static constexpr double kW1 = -1.17767998417887;
+  static constexpr double kW2 = 0.235573213359357;
+  static constexpr double kW3 = 0.784513610477560;
+  static constexpr double kW0 = 1 - 2 * (kW1 + kW2 + kW3);
+
+  static constexpr size_t kOrder = 6;
+  static constexpr std::array<double, 8> kKicks{
+      kW3 / 2,         (kW3 + kW2) / 2, (kW2 + kW1) / 2, (kW1 + kW0) / 2,
+      (kW0 + kW1) / 2, (kW1 + kW2) / 2, (kW2 + kW3) / 2, kW3 / 2};
+  static constexpr std::array<double, 7> kDrifts{kW3, kW2, kW1, kW0,
+                                                 kW1, kW2, kW3};
+};
+
+/**
+ * @brief Omelyan, Mryglod and Folk's optimized second-order scheme, two force
+ * evaluations per step.
+ * @details Its error constant is smaller than that of two Verlet steps of
+ * dt / 2, which cost the same.
+ */
+struct Omelyan2 {
+  static constexpr double kLambda = 0.1931833275037836;
+
+  static constexpr size_t kOrder = 2;
+  static constexpr std::array<double, 3> kKicks{kLambda, 1 - 2 * kLambda,
+                                                kLambda};
+  static constexpr std::array<double, 2> kDrifts{0.5, 0.5};
+};
+
+/**
+ * @brief Omelyan, Mryglod and Folk's optimized fourth-order scheme (the
+ * extended Forest-Ruth-like PEFRL), four force evaluations per step.
+ * @details The error constant is much smaller than that of Yoshida4, which
+ * more than pays for the extra evaluation.
+ */
+struct Omelyan4 {
+  static constexpr double kXi = 0.1786178958448091;
+  static constexpr double kLambda = -0.2123418310626054;
+  static constexpr double kChi = -0.06626458266981849;
+
+  static constexpr size_t kOrder = 4;
+  static constexpr std::array<double, 5> kKicks{
+      kXi, kChi, 1 - 2 * (kChi + kXi), kChi, kXi};
+  static constexpr std::array<double, 4> kDrifts{
+      (1 - 2 * kLambda) / 2, kLambda, kLambda, (1 - 2 * kLambda) / 2};
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_SYMPLECTICSCHEME_H
@@ -0,0 +1,401 @@
+//
+// Created by Renatus Madrigal on 6/26/2025.
+//
+
+/**
+ * @file TabulatedField.h
+ * @brief A cache of an expensive field on a grid, answered by interpolation.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_TABULATEDFIELD_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_TABULATEDFIELD_H
+
+#include "phosphorus/Coordinate.h"
+#include "phosphorus/Field.h"
+#include "phosphorus/Particle.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief The force of a field is proportional to the mass of the particle,
+ * e.g. gravity.
+ */
+struct MassCoupling {
+  template <Massive ParticleType>
+  double operator()(const ParticleType &particle) const {
+    return particle.mass();
+  }
+};
+
+/**
+ * @brief The force of a field is proportional to the charge of the particle,
+ * e.g. an electrostatic field.
+ */
+struct ChargeCoupling {
+  template <Charged ParticleType>
+  double operator()(const ParticleType &particle) const {
+    return particle.charge();
+  }
+};
+
+/**
+ * @brief A field sampled on a grid over a box, and evaluated by multilinear
+ * interpolation of the samples.
+ * @details The table holds the force per unit coupling, sampled once with a
+ * reference particle, so a particle of any type gets the interpolated value
+ * times its coupling. This is exact for fields whose force is linear in one
+ * property of the particle, which is what the Coupling says.
+ *
+ * The box is split into tiles of the same size. A tile is sampled the first
+ * time a particle lands in it, so the memory and the sampling cost are only
+ * paid where particles actually go. A tile starts with cells_per_tile cells
+ * along every axis. The interpolation is then checked against the field at
+ * the midpoints of the cell edges, and if the error is larger than tolerance
+ * times the largest force sampled in the tile, the tile is resampled with
+ * twice as many cells, up to max_level times. Smooth regions get coarse tiles
+ * and regions of large curvature get fine ones. A tile which still misses the
+ * tolerance at max_level, or where the field is not finite, is dropped, and
+ * the positions in it are passed to the field itself.
+ *
+ * Positions outside the box are passed to the field itself too. Copies of a
+ * tabulated field share the table, and tiles are populated safely from
+ * several threads.
+ * @tparam Field The field to tabulate.
+ * @tparam ParticleType The type of the reference particle.
+ * @tparam Coupling The particle property the force is proportional to.
+ */
+template <typename Field, typename ParticleType,
+          typename Coupling = MassCoupling>
+  requires IsField<Field>
+class TabulatedField
+    : public BaseField<TabulatedField<Field, ParticleType, Coupling>,
+                       typename Field::CoordinateVec> {
+  using Base = BaseField<TabulatedField, typename Field::CoordinateVec>;
+
+public:
+  using CoordinateVecType = typename Field::CoordinateVec;
+  using Vector = typename CoordinateVecType::Vector;
+  using Scalar = typename CoordinateVecType::Scalar;
+  using ConstComponents = typename Base::ConstComponents;
+  using Components = typename Base::Components;
+
+  static constexpr size_t kDimension = Base::kDimension;
+
+  struct Options {
+    size_t tiles_per_axis = 8;
+    size_t cells_per_tile = 4;
+    size_t max_level = 3;
+    Scalar tolerance = 1e-4;
+  };
+
+  /**
+   * @param field The field to tabulate.
+   * @param lower The lower corner of the box, in the raw coordinates.
+   * @param upper The upper corner of the box.
+   * @param reference The particle the field is sampled with. Its coupling must
+   * not be zero.
+   * @param options The tiling and the error bound.
+   * @param coupling The particle property the force is proportional to.
+   */
+  TabulatedField(Field field, const Vector &lower, const Vector &upper,
+                 const ParticleType &reference, const Options &options = {},
+                 Coupling coupling = {})
+      : field_(std::move(field)), reference_(reference),
+        coupling_(std::move(coupling)), options_(options), lower_(lower),
+        table_(std::make_shared<Table>()) {
+    if (options.tiles_per_axis == 0 || options.cells_per_tile == 0) {
+      throw std::invalid_argument("The grid must have at least one cell");
+    }
+    if (!(options.tolerance > 0)) {
+      throw std::invalid_argument("Tolerance must be positive");
+    }
+    reference_coupling_ = coupling_(reference_);
+    if (reference_coupling_ == 0) {
+      throw std::invalid_argument("The reference particle must be coupled");
+    }
+    size_t tiles = 1;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      if (!(upper[axis] > lower[axis])) {
+        throw std::invalid_argument("The box must not be empty");
+      }
+      tile_size_[axis] = (upper[axis] - lower[axis]) /
+                         static_cast<Scalar>(options.tiles_per_axis);
+      tiles *= options.tiles_per_axis;
+    }
+    table_->tiles = std::make_unique<Tile[]>(tiles);
+    table_->count = tiles;
+  }
+
+  [[nodiscard]] const Field &field() const { return field_; }
+  [[nodiscard]] const Options &options() const { return options_; }
+
+  /**
+   * @brief The number of tiles which have been sampled so far.
+   */
+  [[nodiscard]] size_t populatedTiles() const {
+    return table_->populated.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief The number of grid nodes held so far, over all the tabulated
+   * tiles.
+   */
+  [[nodiscard]] size_t tabulatedNodes() const {
+    return table_->nodes.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief The number of sampled tiles which are not tabulated, because the
+   * interpolation missed the tolerance at max_level or the field was not
+   * finite there.
+   */
+  [[nodiscard]] size_t directTiles() const {
+    return table_->direct.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Sample every tile now, e.g. before timing a run.
+   */
+  void populate() const {
+    for (size_t index = 0; index < table_->count; ++index) {
+      tile(index);
+    }
+  }
+
+  template <typename P>
+  Vector evaluate(const CoordinateVecType &coord, const P &particle) const {
+    const auto position = coord.toVector();
+    Scalar local[kDimension];
+    size_t index = 0;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      const auto u = (position[axis] - lower_[axis]) / tile_size_[axis];
+      if (!(u >= 0 && u <= static_cast<Scalar>(options_.tiles_per_axis))) {
+        return field_.evaluate(coord, particle);
+      }
+      const auto t = std::min(static_cast<size_t>(u),
+                              options_.tiles_per_axis - 1);
+      index = index * options_.tiles_per_axis + t;
+      local[axis] = u - static_cast<Scalar>(t);
+    }
+    const auto &sampled = tile(index);
+    if (sampled.direct) {
+      return field_.evaluate(coord, particle);
+    }
+    return interpolate(sampled, local) * coupling_(particle);
+  }
+
+private:
+  struct Tile {
+    std::once_flag once;
+    std::atomic<bool> ready{false};
+    // The field itself answers in this tile.
+    bool direct = false;
+    size_t cells = 0;
+    // The force per unit coupling at every node, the components of a node
+    // next to each other.
+    std::vector<Scalar> values;
+  };
+
+  struct Table {
+    std::unique_ptr<Tile[]> tiles;
+    size_t count = 0;
+    std::atomic<size_t> populated{0};
+    std::atomic<size_t> nodes{0};
+    std::atomic<size_t> direct{0};
+  };
+
+  [[nodiscard]] static size_t power(size_t base) {
+    size_t result = 1;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result *= base;
+    }
+    return result;
+  }
+
+  /**
+   * @brief Interpolate within a tile at local coordinates in [0, 1].
+   */
+  [[nodiscard]] static Vector interpolate(const Tile &tile,
+                                          const Scalar (&local)[kDimension]) {
+    const auto cells = tile.cells;
+    const auto nodes = cells + 1;
+    size_t base = 0, strides[kDimension];
+    Scalar fraction[kDimension];
+    size_t stride = kDimension;
+    for (size_t axis = kDimension; axis-- > 0;) {
+      const auto x = local[axis] * static_cast<Scalar>(cells);
+      const auto cell = std::min(static_cast<size_t>(x), cells - 1);
+      fraction[axis] = x - static_cast<Scalar>(cell);
+      base += cell * stride;
+      strides[axis] = stride;
+      stride *= nodes;
+    }
+
+    // The weight of a corner is the product of one of these per axis.
+    Scalar weights[kDimension][2];
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      weights[axis][0] = 1 - fraction[axis];
+      weights[axis][1] = fraction[axis];
+    }
+    Scalar sum[kDimension] = {};
+    const auto *values = tile.values.data();
+    for (size_t corner = 0; corner < (size_t{1} << kDimension); ++corner) {
+      Scalar weight = 1;
+      auto offset = base;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        const auto bit = corner >> axis & 1;
+        weight *= weights[axis][bit];
+        offset += bit * strides[axis];
+      }
+      for (size_t component = 0; component < kDimension; ++component) {
+        sum[component] += weight * values[offset + component];
+      }
+    }
+    Vector result{};
+    for (size_t component = 0; component < kDimension; ++component) {
+      result[component] = sum[component];
+    }
+    return result;
+  }
+
+  /**
+   * @brief The tile of a flat index, sampled if this is its first use.
+   */
+  const Tile &tile(size_t index) const {
+    auto &tile = table_->tiles[index];
+    // Once the tile is sampled, skip the call_once, which is not inlined.
+    if (!tile.ready.load(std::memory_order_acquire)) {
+      std::call_once(tile.once, [&] {
+        sample(index, tile);
+        tile.ready.store(true, std::memory_order_release);
+      });
+    }
+    return tile;
+  }
+
+  void sample(size_t index, Tile &tile) const {
+    // The lower corner of the tile.
+    Vector origin{};
+    for (size_t axis = kDimension; axis-- > 0;) {
+      const auto t = index % options_.tiles_per_axis;
+      index /= options_.tiles_per_axis;
+      origin[axis] = lower_[axis] + static_cast<Scalar>(t) * tile_size_[axis];
+    }
+    auto at = [&](const Vector &local) {
+      auto position = origin;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        position[axis] += local[axis] * tile_size_[axis];
+      }
+      return field_.evaluate(CoordinateVecType::fromVector(position),
+                             reference_) /
+             reference_coupling_;
+    };
+
+    for (size_t level = 0;; ++level) {
+      const auto cells = options_.cells_per_tile << level;
+      const auto nodes = cells + 1;
+      tile.cells = cells;
+      tile.values.assign(power(nodes) * kDimension, 0);
+      Scalar largest = 0;
+      bool finite = true;
+      forEachPoint(nodes, [&](size_t flat, const size_t (&point)[kDimension]) {
+        Vector local{};
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          local[axis] = static_cast<Scalar>(point[axis]) / cells;
+        }
+        const auto value = at(local);
+        largest = std::max<Scalar>(largest, value.norm());
+        for (size_t component = 0; component < kDimension; ++component) {
+          tile.values[flat * kDimension + component] = value[component];
+          finite = finite && std::isfinite(value[component]);
+        }
+      });
+      // Refining does not remove a singularity from a tile.
+      const auto accepted = finite && fits(tile, at, largest);
+      if (accepted || !finite || level == options_.max_level) {
+        table_->populated.fetch_add(1, std::memory_order_relaxed);
+        if (accepted) {
+          table_->nodes.fetch_add(power(nodes), std::memory_order_relaxed);
+        } else {
+          tile.direct = true;
+          tile.values = {};
+          table_->direct.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+      }
+    }
+  }
+
+  /**
+   * @brief Whether the interpolation is within the tolerance at the midpoints
+   * of the cell edges.
+   * @details The error of multilinear interpolation is a sum over the axes of
+   * the second derivative along the axis. At the center of a cell these terms
+   * add up to the Laplacian, which vanishes for e.g. gravity, so the centers
+   * would hide the error. An edge midpoint sees one axis at a time.
+   */
+  template <typename Func>
+  [[nodiscard]] bool fits(const Tile &tile, const Func &at,
+                          Scalar largest) const {
+    const auto bound = options_.tolerance * largest;
+    const auto cells = static_cast<Scalar>(tile.cells);
+    bool result = true;
+    forEachPoint(tile.cells, [&](size_t, const size_t (&point)[kDimension]) {
+      for (size_t edge = 0; result && edge < kDimension; ++edge) {
+        Scalar local[kDimension];
+        Vector local_vector{};
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          const Scalar shift = axis == edge ? 0.5 : 0;
+          local[axis] = (static_cast<Scalar>(point[axis]) + shift) / cells;
+          local_vector[axis] = local[axis];
+        }
+        const auto error =
+            (interpolate(tile, local) - at(local_vector)).norm();
+        // A value which is not finite never fits.
+        result = error <= bound;
+      }
+    });
+    return result;
+  }
+
+  /**
+   * @brief Call func(flat, point) for every point of an n^kDimension grid, the
+   * last axis fastest.
+   */
+  template <typename Func> static void forEachPoint(size_t n, Func &&func) {
+    size_t point[kDimension] = {};
+    const auto total = power(n);
+    for (size_t flat = 0; flat < total; ++flat) {
+      func(flat, point);
+      for (size_t axis = kDimension; axis-- > 0;) {
+        if (++point[axis] < n) {
+          break;
+        }
+        point[axis] = 0;
+      }
+    }
+  }
+
+  Field field_;
+  ParticleType reference_;
+  Coupling coupling_;
+  Options options_;
+  Vector lower_;
+  Vector tile_size_{};
+  Scalar reference_coupling_ = 1;
+  std::shared_ptr<Table> table_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_TABULATEDFIELD_H
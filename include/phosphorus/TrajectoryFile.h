@@ -0,0 +1,345 @@
+//
+// Created by Renatus Madrigal on 6/29/2025.
+//
+
+/**
+ * @file TrajectoryFile.h
+ * @brief A compressed, chunked binary file format for trajectories which do
+ * not fit in memory.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_TRAJECTORYFILE_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_TRAJECTORYFILE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief The version written by TrajectoryFileWriter.
+ */
+inline constexpr std::uint32_t kTrajectoryFileVersion = 1;
+
+/**
+ * @brief Thrown when a trajectory file cannot be written or read.
+ */
+class TrajectoryFileError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief The options of TrajectoryFileWriter.
+ */
+struct TrajectoryFileOptions {
+  size_t chunk_samples = 1024; ///< Samples per chunk
+  double tolerance = 0;        ///< Largest error of a position, 0: lossless
+  int level = 1;               ///< Deflate level from 0 (store) to 9
+  size_t buffers = 4;          ///< Chunks which may wait for the writer
+};
+
+/**
+ * @brief Writes a trajectory file: the times of the samples and the positions
+ * of a fixed set of particles.
+ * @details The samples are grouped in chunks of Options::chunk_samples. A
+ * chunk is stored by column, one column for the times and one for every
+ * component of the position of every particle, and every column is encoded
+ * on its own, so a reader can decode a single column of a chunk:
+ * - The times, and the positions when no tolerance is given, are stored
+ *   losslessly: the bits of every value, taken as an integer, are replaced by
+ *   their difference from a linear extrapolation of the two values before.
+ * - With a tolerance, the positions are rounded to multiples of twice the
+ *   tolerance, and the multiples are stored in the same way. A column with
+ *   values which cannot be rounded, such as NaN, falls back to the lossless
+ *   encoding.
+ * For a smooth trajectory, the high bytes of the differences are mostly zero.
+ * The bytes are regrouped by significance, so the zeros are in long runs, and
+ * deflated at the given level. Level 0 stores the plain values, aligned for
+ * mapping.
+ *
+ * An index of the chunks at the end of the file makes any sample reachable
+ * without reading the chunks before it.
+ *
+ * The chunks are encoded and written by a background thread, so append only
+ * copies a sample into the chunk being filled. If the writer thread falls
+ * behind by Options::buffers chunks, append waits for it.
+ */
+class TrajectoryFileWriter {
+public:
+  using Options = TrajectoryFileOptions;
+
+  /**
+   * @throws TrajectoryFileError if the file cannot be created or an option
+   * is out of range.
+   */
+  TrajectoryFileWriter(const std::filesystem::path &path, size_t dimension,
+                       size_t particles, Options options = {});
+
+  /**
+   * @brief Closes the file, but ignores the errors: call close to see them.
+   */
+  ~TrajectoryFileWriter();
+
+  TrajectoryFileWriter(const TrajectoryFileWriter &) = delete;
+  TrajectoryFileWriter &operator=(const TrajectoryFileWriter &) = delete;
+
+  /**
+   * @brief Append a sample.
+   * @param time The time of the sample.
+   * @param positions The positions of all the particles, one after another.
+   * @throws TrajectoryFileError if the size of positions is wrong, the file is
+   * closed, or writing an earlier chunk failed. After a failed write, every
+   * later call throws again.
+   */
+  void append(double time, std::span<const double> positions);
+
+  /**
+   * @brief Write the last chunk and the index, and close the file.
+   * @throws TrajectoryFileError if writing failed, now or earlier, on every
+   * call.
+   */
+  void close();
+
+  [[nodiscard]] size_t samples() const;
+
+private:
+  class Impl;
+
+  std::unique_ptr<Impl> impl_;
+};
+
+/**
+ * @brief Reads a trajectory file written by TrajectoryFileWriter.
+ * @details The file is mapped into memory, see CheckpointReader, and only the
+ * header and the index are read when it is opened. A column of a chunk is
+ * decoded when it is first asked for, and kept in a cache of decoded columns
+ * of a bounded size, least recently used first out. The columns of a file
+ * written at level 0 are not decoded at all: their values are read straight
+ * from the mapping, so they page in as they are touched.
+ *
+ * The Column views read across the chunks of a column and can be passed to
+ * Gnuplot and AnimateGenerator as a DataColumn, so a run far larger than the
+ * memory can be plotted without loading or parsing it.
+ */
+class TrajectoryFileReader {
+public:
+  static constexpr size_t kDefaultCacheSize = size_t{64} << 20;
+
+  /**
+   * @param cache_size The number of bytes of decoded columns to keep.
+   * @throws TrajectoryFileError if the file is missing, damaged, or was not
+   * closed.
+   */
+  explicit TrajectoryFileReader(const std::filesystem::path &path,
+                                size_t cache_size = kDefaultCacheSize);
+  ~TrajectoryFileReader();
+
+  TrajectoryFileReader(TrajectoryFileReader &&) noexcept;
+  TrajectoryFileReader &operator=(TrajectoryFileReader &&) noexcept;
+
+  [[nodiscard]] std::uint32_t version() const;
+  [[nodiscard]] size_t dimension() const;
+  [[nodiscard]] size_t particles() const;
+  [[nodiscard]] double tolerance() const;
+  [[nodiscard]] size_t samples() const;
+  [[nodiscard]] size_t chunks() const;
+
+  /**
+   * @brief The index of the first sample of a chunk, and its number of
+   * samples.
+   */
+  [[nodiscard]] size_t chunkBegin(size_t chunk) const;
+  [[nodiscard]] size_t chunkSize(size_t chunk) const;
+
+  /**
+   * @brief The chunk which holds a sample.
+   */
+  [[nodiscard]] size_t chunkOf(size_t sample) const;
+
+  /**
+   * @brief The column of the times, and of one component of the positions of
+   * a particle.
+   */
+  static constexpr size_t kTimeColumn = 0;
+  [[nodiscard]] size_t column(size_t particle, size_t axis) const;
+
+  /**
+   * @brief Decode a column of a chunk into out, which must hold
+   * chunkSize(chunk) values. The cache is not used.
+   */
+  void readColumn(size_t chunk, size_t column, std::span<double> out) const;
+  [[nodiscard]] std::vector<double> readColumn(size_t chunk,
+                                               size_t column) const;
+
+  /**
+   * @brief The values of a column of a chunk, and what keeps them alive: the
+   * decoded values stay valid after they are evicted from the cache, for as
+   * long as the owner is held. Values in the mapping have no owner and stay
+   * valid as long as the reader.
+   */
+  struct ChunkValues {
+    std::span<const double> values;
+    std::shared_ptr<const void> owner;
+  };
+
+  /**
+   * @brief The values of a column of a chunk, from the cache or the mapping.
+   */
+  [[nodiscard]] ChunkValues chunkValues(size_t chunk, size_t column) const;
+
+  /**
+   * @brief A view of all the samples of one column, across the chunks. It
+   * refers to the reader, which must outlive it.
+   */
+  class Column {
+  public:
+    Column(const TrajectoryFileReader &reader, size_t column)
+        : reader_(&reader), column_(column) {}
+
+    [[nodiscard]] size_t size() const { return reader_->samples(); }
+
+    [[nodiscard]] double operator[](size_t sample) const {
+      const auto chunk = reader_->chunkOf(sample);
+      return reader_->chunkValues(chunk, column_)
+          .values[sample - reader_->chunkBegin(chunk)];
+    }
+
+    /**
+     * @brief The values of the column in one chunk.
+     */
+    [[nodiscard]] ChunkValues chunk(size_t chunk) const {
+      return reader_->chunkValues(chunk, column_);
+    }
+
+    /**
+     * @brief Copy the values of the samples from offset on into out.
+     * @throws std::out_of_range if there are not enough samples.
+     */
+    void read(size_t offset, std::span<double> out) const {
+      if (offset > size() || out.size() > size() - offset) {
+        throw std::out_of_range("No such sample");
+      }
+      while (!out.empty()) {
+        const auto chunk = reader_->chunkOf(offset);
+        const auto values = reader_->chunkValues(chunk, column_).values.subspan(
+            offset - reader_->chunkBegin(chunk));
+        const auto count = std::min(values.size(), out.size());
+        std::copy_n(values.begin(), count, out.begin());
+        out = out.subspan(count);
+        offset += count;
+      }
+    }
+
+  private:
+    const TrajectoryFileReader *reader_;
+    size_t column_;
+  };
+
+  [[nodiscard]] Column times() const { return {*this, kTimeColumn}; }
+  [[nodiscard]] Column positions(size_t particle, size_t axis) const {
+    return {*this, column(particle, axis)};
+  }
+
+private:
+  class Impl;
+
+  std::unique_ptr<Impl> impl_;
+};
+
+/**
+ * @brief Streams the positions of some particles of an integrator to a
+ * trajectory file every few steps.
+ * @details The counterpart of TrajectoryRecorder for runs which do not fit in
+ * memory. A recorded particle which has been removed from the integrator is
+ * recorded as NaN.
+ * @tparam Integrator The integrator, a BaseVerletIntegrator.
+ */
+template <typename Integrator> class TrajectoryWriter {
+public:
+  using Handle = typename Integrator::Handle;
+  using Options = TrajectoryFileOptions;
+
+  static constexpr size_t kDimension = Integrator::kDimension;
+
+  /**
+   * @brief Record the given particles, every given number of steps.
+   */
+  TrajectoryWriter(const Integrator &system, const std::filesystem::path &path,
+                   std::span<const Handle> particles, Options options = {},
+                   size_t every = 1)
+      : system_(&system), particles_(particles.begin(), particles.end()),
+        positions_(particles_.size() * kDimension), every_(every),
+        file_(path, kDimension, particles_.size(), options) {
+    if (every_ == 0) {
+      throw TrajectoryFileError("Trajectories must be recorded every step or "
+                                "less often");
+    }
+  }
+
+  /**
+   * @brief Record all the particles which are in the integrator now.
+   */
+  TrajectoryWriter(const Integrator &system, const std::filesystem::path &path,
+                   Options options = {}, size_t every = 1)
+      : TrajectoryWriter(system, path, handlesOf(system), options, every) {}
+
+  /**
+   * @brief Count a step, and record it if it is one in every `every`. Call
+   * this once before the first step and after every step.
+   */
+  void observe() {
+    if (observed_++ % every_ == 0) {
+      record();
+    }
+  }
+
+  /**
+   * @brief Record the current state, whatever the step.
+   */
+  void record() {
+    const auto &storage = system_->storage();
+    for (size_t p = 0; p < particles_.size(); ++p) {
+      const auto contained = system_->contains(particles_[p]);
+      const auto index = contained ? system_->indexOf(particles_[p]) : 0;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        positions_[p * kDimension + axis] =
+            contained ? storage.positions(axis)[index]
+                      : std::numeric_limits<double>::quiet_NaN();
+      }
+    }
+    file_.append(system_->time(), positions_);
+  }
+
+  void close() { file_.close(); }
+
+  [[nodiscard]] size_t samples() const { return file_.samples(); }
+
+private:
+  static std::vector<Handle> handlesOf(const Integrator &system) {
+    std::vector<Handle> result;
+    result.reserve(system.count());
+    for (size_t i = 0; i < system.count(); ++i) {
+      result.push_back(system.handleOf(i));
+    }
+    return result;
+  }
+
+  const Integrator *system_;
+  std::vector<Handle> particles_;
+  std::vector<double> positions_;
+  size_t every_;
+  size_t observed_ = 0;
+  TrajectoryFileWriter file_;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_TRAJECTORYFILE_H
@@ -0,0 +1,373 @@
+//
+// Created by Renatus Madrigal on 6/28/2025.
+//
+
+/**
+ * @file TrajectoryRecorder.h
+ * @brief Records the positions of selected particles of an integrator over
+ * time, in columns which can be plotted without copying them.
+ */
+
+#ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_TRAJECTORYRECORDER_H
+#define PHOSPHORUS_INCLUDE_PHOSPHORUS_TRAJECTORYRECORDER_H
+
+#include "phosphorus/ParticleStorage.h"
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace phosphorus {
+
+/**
+ * @brief Samples the positions of some particles of an integrator every few
+ * steps.
+ * @details The samples are stored by column: one array for the times and one
+ * array for every component of the position of every recorded particle. The
+ * columns are split into chunks which are allocated once and never moved, so
+ * recording a long run costs one allocation per chunk instead of the copies
+ * of a growing vector, and the spans handed out stay valid while recording
+ * goes on.
+ *
+ * times() and positions(particle, axis) are views of a column across all
+ * the chunks, which can be passed to Gnuplot or AnimateGenerator as a
+ * DataColumn. A column of a single chunk is a plain span of scalars. Reserve
+ * the number of samples before the run, or compact the chunks after it, to
+ * get every column in one span.
+ *
+ * A recorded particle which has been removed from the integrator is recorded
+ * as NaN.
+ * @tparam Integrator The integrator, a BaseVerletIntegrator.
+ */
+template <typename Integrator> class TrajectoryRecorder {
+public:
+  using Handle = typename Integrator::Handle;
+  using CoordinateVec = typename Integrator::CoordinateVec;
+  using Scalar = typename Integrator::Scalar;
+
+  static constexpr size_t kDimension = Integrator::kDimension;
+
+  struct Options {
+    size_t every = 1;         ///< Record one step in every this many
+    size_t chunk_size = 4096; ///< Samples per chunk allocated while recording
+  };
+
+  /**
+   * @brief Record the given particles.
+   * @throws std::invalid_argument if an option is zero.
+   */
+  TrajectoryRecorder(const Integrator &system,
+                     std::span<const Handle> particles, Options options = {})
+      : system_(&system), particles_(particles.begin(), particles.end()),
+        options_(options) {
+    if (options_.every == 0 || options_.chunk_size == 0) {
+      throw std::invalid_argument("Recorder options must be positive");
+    }
+  }
+
+  /**
+   * @brief Record all the particles which are in the integrator now.
+   */
+  explicit TrajectoryRecorder(const Integrator &system, Options options = {})
+      : TrajectoryRecorder(system, handlesOf(system), options) {}
+
+  /**
+   * @brief Allocate room for the given total number of samples, so no
+   * allocation happens while they are recorded.
+   */
+  void reserve(size_t samples) {
+    const auto capacity = this->capacity();
+    if (samples > capacity) {
+      allocate(samples - capacity);
+    }
+  }
+
+  /**
+   * @brief Count a step, and record it if it is one in every
+   * Options::every. Call this once before the first step and after every
+   * step.
+   */
+  void observe() {
+    if (observed_++ % options_.every == 0) {
+      record();
+    }
+  }
+
+  /**
+   * @brief Record the current state, whatever the step.
+   */
+  void record() {
+    if (current_ == chunks_.size()) {
+      allocate(options_.chunk_size);
+    }
+    auto &chunk = chunks_[current_];
+    const auto row = chunk.size;
+    chunk.column(0)[row] = system_->time();
+    for (size_t p = 0; p < particles_.size(); ++p) {
+      const auto handle = particles_[p];
+      if (system_->contains(handle)) {
+        const auto index = system_->indexOf(handle);
+        const auto &storage = system_->storage();
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          chunk.column(columnOf(p, axis))[row] =
+              storage.positions(axis)[index];
+        }
+      } else {
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          chunk.column(columnOf(p, axis))[row] =
+              std::numeric_limits<Scalar>::quiet_NaN();
+        }
+      }
+    }
+    ++samples_;
+    if (++chunk.size == chunk.capacity) {
+      ++current_;
+    }
+  }
+
+  /**
+   * @brief Copy all the samples into a single chunk, for when a column is
+   * needed in one span. Spans taken before are invalidated.
+   */
+  void compact() {
+    if (chunks() <= 1) {
+      return;
+    }
+    Chunk merged(columns(), samples_);
+    for (const auto &chunk : chunks_) {
+      for (size_t column = 0; column < columns(); ++column) {
+        std::ranges::copy(chunk.column(column).first(chunk.size),
+                          merged.column(column).begin() + merged.size);
+      }
+      merged.size += chunk.size;
+    }
+    chunks_.clear();
+    chunks_.push_back(std::move(merged));
+    current_ = chunks_.front().size == chunks_.front().capacity ? 1 : 0;
+  }
+
+  /**
+   * @brief Drop all the samples and restart the count of steps.
+   */
+  void clear() {
+    chunks_.clear();
+    current_ = 0;
+    samples_ = 0;
+    observed_ = 0;
+  }
+
+  [[nodiscard]] std::span<const Handle> particles() const {
+    return particles_;
+  }
+  [[nodiscard]] size_t samples() const { return samples_; }
+  [[nodiscard]] bool empty() const { return samples_ == 0; }
+
+  /**
+   * @brief The number of chunks which hold samples.
+   */
+  [[nodiscard]] size_t chunks() const {
+    const auto partial = current_ < chunks_.size() && chunks_[current_].size;
+    return current_ + (partial ? 1 : 0);
+  }
+
+  /**
+   * @brief The number of samples the allocated chunks can hold.
+   */
+  [[nodiscard]] size_t capacity() const {
+    size_t result = 0;
+    for (const auto &chunk : chunks_) {
+      result += chunk.capacity;
+    }
+    return result;
+  }
+
+  /**
+   * @brief A view of one column over all the samples, whichever chunks they
+   * are in. It stays valid while recording goes on, and across compact.
+   */
+  class Column {
+  public:
+    Column(const TrajectoryRecorder &recorder, size_t column)
+        : recorder_(&recorder), column_(column) {}
+
+    [[nodiscard]] size_t size() const { return recorder_->samples(); }
+
+    [[nodiscard]] Scalar operator[](size_t sample) const {
+      const auto [chunk, row] = recorder_->locate(sample);
+      return recorder_->chunks_[chunk].column(column_)[row];
+    }
+
+    /**
+     * @brief The values of the column in one chunk.
+     */
+    [[nodiscard]] std::span<const Scalar> chunk(size_t chunk) const {
+      return recorder_->column(chunk, column_);
+    }
+
+    /**
+     * @brief Copy the values of the samples from offset on into out.
+     * @throws std::out_of_range if there are not enough samples.
+     */
+    void read(size_t offset, std::span<double> out) const {
+      if (offset > size() || out.size() > size() - offset) {
+        throw std::out_of_range("No such sample");
+      }
+      for (const auto &chunk : recorder_->chunks_) {
+        if (out.empty()) {
+          break;
+        }
+        if (offset >= chunk.size) {
+          offset -= chunk.size;
+          continue;
+        }
+        const auto values =
+            chunk.column(column_).first(chunk.size).subspan(offset);
+        const auto count = std::min(values.size(), out.size());
+        std::copy_n(values.begin(), count, out.begin());
+        out = out.subspan(count);
+        offset = 0;
+      }
+    }
+
+  private:
+    const TrajectoryRecorder *recorder_;
+    size_t column_;
+  };
+
+  /**
+   * @brief The times of all the samples.
+   */
+  [[nodiscard]] Column times() const { return {*this, 0}; }
+
+  /**
+   * @brief One component of the positions of a recorded particle, given by
+   * its index in particles(), at all the samples.
+   */
+  [[nodiscard]] Column positions(size_t particle, size_t axis) const {
+    return {*this, columnOf(particle, axis)};
+  }
+
+  /**
+   * @brief The times of the samples in a chunk.
+   */
+  std::span<Scalar> times(size_t chunk) { return column(chunk, 0); }
+  [[nodiscard]] std::span<const Scalar> times(size_t chunk) const {
+    return column(chunk, 0);
+  }
+
+  /**
+   * @brief One component of the positions of a recorded particle in a chunk.
+   */
+  std::span<Scalar> positions(size_t particle, size_t axis, size_t chunk) {
+    return column(chunk, columnOf(particle, axis));
+  }
+  [[nodiscard]] std::span<const Scalar> positions(size_t particle, size_t axis,
+                                                  size_t chunk) const {
+    return column(chunk, columnOf(particle, axis));
+  }
+
+  /**
+   * @brief The time of a sample, counting across the chunks.
+   */
+  [[nodiscard]] Scalar time(size_t sample) const {
+    const auto [chunk, row] = locate(sample);
+    return chunks_[chunk].column(0)[row];
+  }
+
+  /**
+   * @brief The position of a recorded particle at a sample.
+   */
+  [[nodiscard]] CoordinateVec position(size_t particle, size_t sample) const {
+    const auto [chunk, row] = locate(sample);
+    CoordinateVec result;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result[axis] = chunks_[chunk].column(columnOf(particle, axis))[row];
+    }
+    return result;
+  }
+
+private:
+  // The columns of a chunk share one allocation, one after another.
+  struct Chunk {
+    Chunk(size_t columns, size_t capacity)
+        : data(columns * capacity), capacity(capacity) {}
+
+    [[nodiscard]] std::span<Scalar> column(size_t index) {
+      return std::span(data).subspan(index * capacity, capacity);
+    }
+    [[nodiscard]] std::span<const Scalar> column(size_t index) const {
+      return std::span(data).subspan(index * capacity, capacity);
+    }
+
+    AlignedVector<Scalar> data;
+    size_t capacity;
+    size_t size = 0;
+  };
+
+  static std::vector<Handle> handlesOf(const Integrator &system) {
+    std::vector<Handle> result;
+    result.reserve(system.count());
+    for (size_t i = 0; i < system.count(); ++i) {
+      result.push_back(system.handleOf(i));
+    }
+    return result;
+  }
+
+  [[nodiscard]] size_t columns() const {
+    return 1 + particles_.size() * kDimension;
+  }
+
+  [[nodiscard]] size_t columnOf(size_t particle, size_t axis) const {
+    if (particle >= particles_.size() || axis >= kDimension) {
+      throw std::out_of_range("No such recorded particle or axis");
+    }
+    return 1 + particle * kDimension + axis;
+  }
+
+  std::span<Scalar> column(size_t chunk, size_t index) {
+    if (chunk >= chunks_.size()) {
+      return {};
+    }
+    return chunks_[chunk].column(index).first(chunks_[chunk].size);
+  }
+  [[nodiscard]] std::span<const Scalar> column(size_t chunk,
+                                               size_t index) const {
+    if (chunk >= chunks_.size()) {
+      return {};
+    }
+    return chunks_[chunk].column(index).first(chunks_[chunk].size);
+  }
+
+  [[nodiscard]] std::pair<size_t, size_t> locate(size_t sample) const {
+    if (sample >= samples_) {
+      throw std::out_of_range("No such sample");
+    }
+    size_t chunk = 0;
+    while (sample >= chunks_[chunk].size) {
+      sample -= chunks_[chunk].size;
+      ++chunk;
+    }
+    return {chunk, sample};
+  }
+
+  void allocate(size_t capacity) {
+    chunks_.emplace_back(columns(), capacity);
+  }
+
+  const Integrator *system_;
+  std::vector<Handle> particles_;
+  Options options_;
+  // Only the chunk at current_ is being filled: those before it are full, and
+  // those after it have been reserved but are still empty.
+  std::vector<Chunk> chunks_;
+  size_t current_ = 0;
+  size_t samples_ = 0;
+  size_t observed_ = 0;
+};
+
+} // namespace phosphorus
+
+#endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_TRAJECTORYRECORDER_H
@@ -5,6 +5,8 @@
 #ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_TYPETRAITS_H
 #define PHOSPHORUS_INCLUDE_PHOSPHORUS_TYPETRAITS_H
 
+#include <cstddef>
+#include <tuple>
 #include <type_traits>
 
 // This contains some enhanced type traits for the Phosphorus library.
@@ -12,29 +14,84 @@
 
 namespace phosphorus {
 
-template <typename T>
-struct function_traits : function_traits<decltype(&T::operator())> {};
+namespace detail {
 
-// TODO: Implement a general case for function traits
+// The named argument types, for the first two arguments which exist.
+template <typename... Args> struct function_arguments {};
 
-template <typename ClassType, typename ReturnType>
-struct function_traits<ReturnType (ClassType::*)()> {
-  using result_type = ReturnType;
-};
-
-template <typename ClassType, typename ReturnType, typename Arg1>
-struct function_traits<ReturnType (ClassType::*)(Arg1)> {
+template <typename Arg1, typename... Args>
+struct function_arguments<Arg1, Args...> {
   using first_argument_type = std::remove_cvref_t<Arg1>;
-  using result_type = ReturnType;
 };
 
-template <typename ClassType, typename ReturnType, typename Arg1, typename Arg2>
-struct function_traits<ReturnType (ClassType::*)(Arg1, Arg2) const> {
+template <typename Arg1, typename Arg2, typename... Args>
+struct function_arguments<Arg1, Arg2, Args...> {
   using first_argument_type = std::remove_cvref_t<Arg1>;
   using second_argument_type = std::remove_cvref_t<Arg2>;
+};
+
+} // namespace detail
+
+/**
+ * @brief The result and argument types of a callable.
+ * @details Works for function types, function pointers and references, member
+ * function pointers with any cv, reference and noexcept qualifiers, and class
+ * types with a single, non-template operator(), such as non-generic lambdas,
+ * mutable or not. The argument types have their references and cv qualifiers
+ * removed.
+ */
+template <typename T>
+struct function_traits
+    : function_traits<decltype(&std::remove_cvref_t<T>::operator())> {};
+
+template <typename ReturnType, typename... Args>
+struct function_traits<ReturnType(Args...)>
+    : detail::function_arguments<Args...> {
   using result_type = ReturnType;
+  using argument_types = std::tuple<std::remove_cvref_t<Args>...>;
+  static constexpr size_t arity = sizeof...(Args);
+
+  template <size_t I>
+  using argument_type = std::tuple_element_t<I, argument_types>;
 };
 
+template <typename ReturnType, typename... Args>
+struct function_traits<ReturnType(Args...) noexcept>
+    : function_traits<ReturnType(Args...)> {};
+
+template <typename Func>
+struct function_traits<Func *> : function_traits<Func> {};
+
+template <typename Func>
+  requires std::is_function_v<Func>
+struct function_traits<Func &> : function_traits<Func> {};
+
+template <typename ClassType, typename Func>
+struct function_traits<Func ClassType::*>
+    : function_traits<std::remove_cvref_t<Func>> {};
+
+// The qualifiers of a member function are part of its type, and
+// std::remove_cvref_t does not remove them.
+#define PHOSPHORUS_MEMBER_FUNCTION_TRAITS(QUALIFIERS)                          \
+  template <typename ReturnType, typename... Args>                             \
+  struct function_traits<ReturnType(Args...) QUALIFIERS>                       \
+      : function_traits<ReturnType(Args...)> {};
+
+PHOSPHORUS_MEMBER_FUNCTION_TRAITS(const)
+PHOSPHORUS_MEMBER_FUNCTION_TRAITS(const noexcept)
+PHOSPHORUS_MEMBER_FUNCTION_TRAITS(&)
+PHOSPHORUS_MEMBER_FUNCTION_TRAITS(& noexcept)
+PHOSPHORUS_MEMBER_FUNCTION_TRAITS(const &)
+PHOSPHORUS_MEMBER_FUNCTION_TRAITS(const & noexcept)
+PHOSPHORUS_MEMBER_FUNCTION_TRAITS(&&)
+PHOSPHORUS_MEMBER_FUNCTION_TRAITS(&& noexcept)
+PHOSPHORUS_MEMBER_FUNCTION_TRAITS(const &&)
+PHOSPHORUS_MEMBER_FUNCTION_TRAITS(const && noexcept)
+PHOSPHORUS_MEMBER_FUNCTION_TRAITS(volatile)
+PHOSPHORUS_MEMBER_FUNCTION_TRAITS(const volatile)
+
+#undef PHOSPHORUS_MEMBER_FUNCTION_TRAITS
+
 } // namespace phosphorus
 
 #endif // PHOSPHORUS_INCLUDE_PHOSPHORUS_TYPETRAITS_H
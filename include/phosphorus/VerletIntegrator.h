@@ -10,78 +10,117 @@
 #ifndef PHOSPHORUS_INCLUDE_PHOSPHORUS_VERLETINTEGRATOR_H
 #define PHOSPHORUS_INCLUDE_PHOSPHORUS_VERLETINTEGRATOR_H
 
+#include "phosphorus/Checkpoint.h"
 #include "phosphorus/Coordinate.h"
 #include "phosphorus/Field.h"
+#include "phosphorus/GravityKernel.h"
+#include "phosphorus/Parallel.h"
 #include "phosphorus/Particle.h"
+#include "phosphorus/ParticleStorage.h"
+#include "phosphorus/SymplecticScheme.h"
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
 #include <iterator>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace phosphorus {
 
-// TODO: Currently the Verlet integrator only supports same particle type
+// The Verlet integrators hold a single particle type. Systems of several
+// particle types are handled by MultiSpeciesIntegrator.
 /**
  * @brief Base Verlet integrator for particle simulation.
+ * @details The particles are kept in a structure-of-arrays ParticleStorage.
+ * The iterator and the element accessors gather a snapshot of a particle from
+ * the arrays, so modifications of the returned element are not written back.
+ *
+ * Indices and iterators are positions in the arrays. Removing a particle moves
+ * the last particle into its place, so they are not stable across removals.
+ * A Handle names a particle for as long as it exists: it is a slot in an
+ * indirection table plus the generation of the slot, which is bumped when the
+ * particle is removed, so a handle of a removed particle is detected rather
+ * than silently redirected to another particle.
  * @tparam Impl The implementation type.
  * @tparam Coord The coordinate system used for the simulation.
  * @tparam ParticleType The type of the particle to be integrated.
+ * @tparam Scheme The splitting scheme of a step, see SymplecticScheme.h.
  */
-template <typename Impl, typename Coord, typename ParticleType>
-  requires IsCoordinateVec<Coord> && Massive<ParticleType>
+template <typename Impl, typename Coord, typename ParticleType,
+          typename Scheme = VelocityVerlet>
+  requires IsCoordinateVec<Coord> && Massive<ParticleType> &&
+           SymplecticScheme<Scheme>
 class BaseVerletIntegrator {
+public:
+  using TimeType = double;
+  using CoordinateVec = Coord;
+  using Vector = typename CoordinateVec::Vector;
+  using Scalar = typename CoordinateVec::Scalar;
+  using Storage = ParticleStorage<CoordinateVec, ParticleType>;
+  using SchemeType = Scheme;
+
+  static constexpr size_t kDimension = CoordinateVec::dimension();
+
+  /**
+   * @brief A snapshot of a particle gathered from the storage.
+   */
   struct Element {
     ParticleType particle;
     Coord position;
-    typename Coord::Vector velocity;
-    typename Coord::Vector acceleration;
+    Vector velocity;
+    Vector acceleration;
   };
 
-public:
-  using TimeType = double;
-  using CoordinateVec = Coord;
-  using Vector = typename CoordinateVec::Vector;
+  /**
+   * @brief A stable reference to a particle, see the class description.
+   */
+  struct Handle {
+    std::uint32_t slot = std::numeric_limits<std::uint32_t>::max();
+    std::uint32_t generation = 0;
+
+    bool operator==(const Handle &) const = default;
+  };
 
   // The vector<>::iterator may be invalidated when the vector is resized.
   // So we need to use a custom iterator to avoid this problem.
   class iterator {
-  private:
-    using vector_type = std::vector<Element>;
-    using vector_iter = typename vector_type::iterator;
-    using const_vector_iter = typename vector_type::const_iterator;
+    // operator-> needs an address, so the gathered element is kept alive in
+    // this proxy for the duration of the member access.
+    struct ArrowProxy {
+      Element element;
+      const Element *operator->() const { return &element; }
+    };
 
   public:
     using iterator_category = std::random_access_iterator_tag;
     using value_type = Element;
     using difference_type = std::ptrdiff_t;
-    using pointer = Element *;
-    using reference = Element &;
+    using pointer = ArrowProxy;
+    using reference = Element;
+
+    iterator() = default;
 
     iterator(BaseVerletIntegrator *container, size_t index)
         : container_(container), index_(index) {}
 
-    iterator(BaseVerletIntegrator *container, const vector_iter iter)
-        : container_(container),
-          index_(std::distance(container->elements_.begin(), iter)) {}
-
-    iterator(BaseVerletIntegrator *container, pointer ptr)
-        : container_(container),
-          index_(std::distance(container->elements_.data(), ptr)) {}
-
     iterator(const BaseVerletIntegrator *container, size_t index)
         : container_(const_cast<BaseVerletIntegrator *>(container)),
           index_(index) {}
 
-    iterator(const BaseVerletIntegrator *container, const_vector_iter iter)
-        : container_(const_cast<BaseVerletIntegrator *>(container)),
-          index_(std::distance(container->elements_.begin(), iter)) {}
-
-    iterator(const BaseVerletIntegrator *container, pointer ptr)
-        : container_(const_cast<BaseVerletIntegrator *>(container)),
-          index_(std::distance(container->elements_.data(), ptr)) {}
+    reference operator*() const { return container_->element(index_); }
 
-    reference operator*() const { return container_->elements_[index_]; }
+    pointer operator->() const { return ArrowProxy{**this}; }
 
-    pointer operator->() const { return &(container_->elements_[index_]); }
+    reference operator[](difference_type n) const { return *(*this + n); }
 
     iterator &operator++() {
       index_++;
@@ -127,9 +166,19 @@ public:
       return index_ < other.index_;
     }
 
+    /**
+     * @brief The index of the particle in the storage arrays.
+     */
+    [[nodiscard]] size_t index() const { return index_; }
+
+    /**
+     * @brief The stable handle of the particle.
+     */
+    [[nodiscard]] Handle handle() const { return container_->handleOf(index_); }
+
   private:
-    BaseVerletIntegrator *container_;
-    size_t index_;
+    BaseVerletIntegrator *container_ = nullptr;
+    size_t index_ = 0;
   };
 
   /**
@@ -142,76 +191,741 @@ public:
   auto pushParticle(const ParticleType &particle,
                     const CoordinateVec &position = CoordinateVec(),
                     const Vector &velocity = Vector()) {
-    elements_.emplace_back(particle, position, velocity, Vector());
-    return std::prev(this->end());
+    auto index = storage_.push(particle, position, velocity, Vector());
+    std::uint32_t slot;
+    if (free_slots_.empty()) {
+      slot = static_cast<std::uint32_t>(slots_.size());
+      slots_.push_back({});
+    } else {
+      slot = free_slots_.back();
+      free_slots_.pop_back();
+    }
+    slots_[slot].index = index;
+    slot_of_.push_back(slot);
+    // A new particle changes the forces on every other particle.
+    particlesChanged();
+    return iterator(this, index);
   }
 
-  // TODO: First step should be handled separately
+  /**
+   * @brief Remove a particle in O(1).
+   * @details The last particle is moved into the place of the removed one.
+   * Its handle stays valid, but its index and iterators change. An
+   * implementation which keeps per-particle state of its own can follow the
+   * move in onSwapRemoveImpl(from, to), which is called after the storage has
+   * moved the particle at index from to index to.
+   * @return Whether the particle existed.
+   */
+  bool removeParticle(Handle handle) {
+    if (!contains(handle)) {
+      return false;
+    }
+    const auto index = slots_[handle.slot].index;
+    const auto from = storage_.swapRemove(index);
+    if (from != index) {
+      slot_of_[index] = slot_of_[from];
+      slots_[slot_of_[index]].index = index;
+      auto impl = static_cast<Impl *>(this);
+      if constexpr (requires { impl->onSwapRemoveImpl(from, index); }) {
+        impl->onSwapRemoveImpl(from, index);
+      }
+    }
+    slot_of_.pop_back();
+    ++slots_[handle.slot].generation;
+    free_slots_.push_back(handle.slot);
+    particlesChanged();
+    return true;
+  }
 
-  void step(TimeType dt) {
-    auto n = this->count();
+  /**
+   * @brief Whether the handle refers to an existing particle.
+   */
+  [[nodiscard]] bool contains(Handle handle) const {
+    return handle.slot < slots_.size() &&
+           slots_[handle.slot].generation == handle.generation;
+  }
+
+  /**
+   * @brief The current index of a particle.
+   * @throws std::out_of_range if the particle has been removed.
+   */
+  [[nodiscard]] size_t indexOf(Handle handle) const {
+    if (!contains(handle)) {
+      throw std::out_of_range("BaseVerletIntegrator: stale particle handle");
+    }
+    return slots_[handle.slot].index;
+  }
+
+  /**
+   * @brief The handle of the particle at an index.
+   */
+  [[nodiscard]] Handle handleOf(size_t index) const {
+    const auto slot = slot_of_[index];
+    return Handle{slot, slots_[slot].generation};
+  }
+
+  auto at(Handle handle) const { return element(indexOf(handle)); }
+
+  /**
+   * @brief Replace the particle, e.g. with the product of a merger.
+   */
+  void setParticle(Handle handle, const ParticleType &particle) {
+    storage_.setParticle(indexOf(handle), particle);
+    particlesChanged();
+  }
+  void setPosition(Handle handle, const CoordinateVec &position) {
+    storage_.setPosition(indexOf(handle), position);
+    particlesChanged();
+  }
+  void setVelocity(Handle handle, const Vector &velocity) {
+    storage_.setVelocity(indexOf(handle), velocity);
+    particlesChanged();
+  }
+
+  /**
+   * @brief Reserve the storage for n particles.
+   */
+  void reserve(size_t n) { storage_.reserve(n); }
 
-    // Use static storage to avoid dynamic allocation
-    static std::vector<Vector> acc(n);
-    static bool first_step = true;
+  /**
+   * @brief How advanceTo chooses the time steps.
+   * @details The tolerance passed to advanceTo is relative, so the same value
+   * works for any system of units.
+   */
+  enum class StepControl {
+    /// Estimate the local error from the difference between the trapezoidal
+    /// velocity update of the step and the embedded first-order (Euler)
+    /// update, relative to the velocity. A step whose error exceeds the
+    /// tolerance is rejected and retried with a smaller dt.
+    ErrorEstimate,
+    /// Keep the relative change of the accelerations over a step below the
+    /// tolerance. The next dt is extrapolated from the last step, so a step
+    /// is only retried when the accelerations change abruptly.
+    Acceleration,
+    /// Like Acceleration, but the criterion is measured over the step being
+    /// taken, which is symmetric in its two ends, and solved by iteration.
+    /// The choice of dt is then reversible, which avoids the secular energy
+    /// drift of the other two controllers.
+    TimeSymmetric,
+  };
 
-    // Resize the static storage if needed
-    // Because we do not support removing particles, we can assume that
-    // the size of the static storage is always greater than or equal to n.
-    if (acc.size() < n) {
-      acc.resize(n);
+  /**
+   * @brief Counters of an advanceTo call.
+   */
+  struct AdaptiveStats {
+    size_t steps = 0;       ///< Accepted steps
+    size_t rejected = 0;    ///< Rejected or iterated trial steps
+    size_t evaluations = 0; ///< Force evaluations, including the rejected
+  };
+
+  /**
+   * @brief Advance the system by one step of the scheme.
+   * @details The step runs in whole-array phases: kick or drift all the
+   * particles, and compute all the accelerations in one batched call. All the
+   * state touched by a step lives in this instance, so independent integrators
+   * can be stepped from different threads at the same time.
+   * @param dt The time step.
+   */
+  void step(TimeType dt) {
+    prepareStep();
+    if constexpr (std::same_as<Scheme, VelocityVerlet>) {
+      advance(dt);
+    } else {
+      advanceComposed(dt);
     }
+  }
 
-    if (first_step) {
-      for (auto &elem : elements_) {
-        elem.acceleration = this->calculateAcceleration(&elem);
-      }
+  /**
+   * @brief Advance the system to t_end with adaptive velocity Verlet steps.
+   * @details The last step is shortened to end exactly on t_end. The step size
+   * is kept between calls, so a run can be advanced in pieces (e.g. to record
+   * the trajectory at fixed times) without restarting the step control.
+   * @param t_end The time to advance to.
+   * @param tolerance The relative error per step, see StepControl.
+   * @param control How the steps are chosen.
+   * @return The counters of this call.
+   */
+  AdaptiveStats advanceTo(TimeType t_end, Scalar tolerance,
+                          StepControl control = StepControl::ErrorEstimate)
+    requires std::same_as<Scheme, VelocityVerlet>
+  {
+    if (!(tolerance > 0)) {
+      throw std::invalid_argument("Tolerance must be positive");
     }
+    const auto evaluations = force_evaluations_;
+    AdaptiveStats stats;
+    prepareStep();
+
+    while (time_ < t_end) {
+      const auto remaining = t_end - time_;
+      auto dt = adaptive_dt_ > 0 ? adaptive_dt_ : initialStep(remaining);
+
+      Scalar factor = 1;
+      bool accepted = false;
+      for (size_t trial = 0; !accepted; ++trial) {
+        // Finish on t_end rather than leaving a sliver of a step.
+        const bool last = dt >= remaining * (1 - 1e-12);
+        if (last) {
+          dt = remaining;
+        }
+        saveState();
+        advance(dt);
 
-    // Update positions and velocities
-    // TODO: Use std::views::zip when C++23 is available
-    for (auto &elem : elements_) {
-      elem.position += elem.velocity * dt + 0.5 * elem.acceleration * dt * dt;
-      auto prev_acc = elem.acceleration;
-      elem.acceleration = this->calculateAcceleration(&elem);
-      elem.velocity += 0.5 * (prev_acc + elem.acceleration) * dt;
+        if (control == StepControl::ErrorEstimate) {
+          const auto error = embeddedError(dt);
+          factor = error > 0 ? 0.9 * std::sqrt(tolerance / error) : kMaxGrowth;
+          factor = std::clamp<Scalar>(factor, kMaxShrink, kMaxGrowth);
+          accepted = error <= tolerance;
+        } else {
+          // The change grows like dt while the accelerations dominate the
+          // scale, and like dt^2 while the velocities do. The square root
+          // keeps the iteration of TimeSymmetric convergent in both.
+          const auto change = accelerationChange(dt);
+          factor = change > 0 ? std::sqrt(tolerance / change) : kMaxGrowth;
+          factor = std::clamp<Scalar>(factor, kMaxShrink, kMaxGrowth);
+          accepted = control == StepControl::Acceleration
+                         ? change <= 2 * tolerance
+                         : std::abs(factor - 1) <= kSymmetricTolerance ||
+                               trial + 1 >= kMaxIterations ||
+                               (last && factor > 1);
+        }
+
+        if (!accepted) {
+          restoreState();
+          ++stats.rejected;
+          dt *= factor;
+        } else if (!last || !(adaptive_dt_ > 0) || dt * factor < adaptive_dt_) {
+          // A step shortened to hit t_end only bounds the next one from
+          // above, unless there is no step size yet.
+          adaptive_dt_ = dt * factor;
+        }
+      }
+      ++stats.steps;
     }
 
-    first_step = false;
+    stats.evaluations = force_evaluations_ - evaluations;
+    return stats;
   }
 
-  auto count() const { return elements_.size(); }
-  auto size() const { return elements_.size(); }
+  /**
+   * @brief The simulation time, advanced by step and advanceTo.
+   */
+  [[nodiscard]] TimeType time() const { return time_; }
+  void setTime(TimeType time) { time_ = time; }
+
+  /**
+   * @brief The number of force evaluations since the construction.
+   */
+  [[nodiscard]] size_t forceEvaluations() const { return force_evaluations_; }
+
+  auto count() const { return storage_.size(); }
+  auto size() const { return storage_.size(); }
 
   // Access the elements
-  auto operator[](size_t index) { return elements_[index]; }
-  auto operator[](size_t index) const { return elements_[index]; }
-  auto at(size_t index) { return elements_.at(index); }
-  auto at(size_t index) const { return elements_.at(index); }
-  auto front() { return elements_.front(); }
-  auto back() { return elements_.back(); }
-  auto front() const { return elements_.front(); }
-  auto back() const { return elements_.back(); }
+  auto operator[](size_t index) const { return element(index); }
+  auto at(size_t index) const {
+    if (index >= count()) {
+      throw std::out_of_range("BaseVerletIntegrator::at: index out of range");
+    }
+    return element(index);
+  }
+  auto front() const { return element(0); }
+  auto back() const { return element(count() - 1); }
 
   // Iterators for the elements
-  auto begin() { return iterator(this, elements_.begin()); }
-  auto end() { return iterator(this, elements_.end()); }
-  auto begin() const { return iterator(this, elements_.begin()); }
-  auto end() const { return iterator(this, elements_.end()); }
+  auto begin() { return iterator(this, 0); }
+  auto end() { return iterator(this, count()); }
+  auto begin() const { return iterator(this, 0); }
+  auto end() const { return iterator(this, count()); }
+
+  /**
+   * @brief The underlying structure-of-arrays storage.
+   */
+  const Storage &storage() const { return storage_; }
+
+  /**
+   * @brief Write the state of the integrator into a checkpoint.
+   * @details The checkpoint holds the particles, their positions, velocities
+   * and accelerations, the handle table, the time, the step counters and the
+   * state of advanceTo. An implementation with state of its own writes it in
+   * saveCheckpointImpl(CheckpointWriter &). loadCheckpoint reads it back in two
+   * parts: readCheckpointImpl(const CheckpointReader &, size_t count) decodes
+   * and checks it, throwing CheckpointError, before anything is replaced, and
+   * restoreCheckpointImpl takes the decoded state afterwards and must not
+   * throw. The state is written as it is in memory, so the particle type must
+   * be trivially copyable.
+   */
+  void saveCheckpoint(CheckpointWriter &writer) const
+    requires std::is_trivially_copyable_v<ParticleType>
+  {
+    const auto n = count();
+    writer.writeValue("layout", checkpointLayout(n));
+    writer.writeValue("step",
+                      CheckpointStep{time_, adaptive_dt_, force_evaluations_,
+                                     accelerations_valid_ ? 1u : 0u});
+    writer.writeArray("particle", storage_.particles());
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      writer.writeArray(checkpointTag("pos", axis), storage_.positions(axis));
+      writer.writeArray(checkpointTag("vel", axis), storage_.velocities(axis));
+      writer.writeArray(checkpointTag("acc", axis),
+                        storage_.accelerations(axis));
+    }
+
+    std::vector<std::uint64_t> slot_index(slots_.size());
+    std::vector<std::uint32_t> slot_generation(slots_.size());
+    for (size_t slot = 0; slot < slots_.size(); ++slot) {
+      slot_index[slot] = slots_[slot].index;
+      slot_generation[slot] = slots_[slot].generation;
+    }
+    writer.writeArray("slotof", std::span<const std::uint32_t>(slot_of_));
+    writer.writeArray("slotidx", std::span<const std::uint64_t>(slot_index));
+    writer.writeArray("slotgen",
+                      std::span<const std::uint32_t>(slot_generation));
+    writer.writeArray("freeslot",
+                      std::span<const std::uint32_t>(free_slots_));
+
+    auto impl = static_cast<const Impl *>(this);
+    if constexpr (requires { impl->saveCheckpointImpl(writer); }) {
+      impl->saveCheckpointImpl(writer);
+    }
+  }
 
-  auto data() const { return elements_.data(); }
+  /**
+   * @brief Write a checkpoint file, replacing it only once it is complete.
+   */
+  void saveCheckpoint(const std::filesystem::path &path) const
+    requires std::is_trivially_copyable_v<ParticleType>
+  {
+    CheckpointWriter writer(path);
+    saveCheckpoint(writer);
+    writer.commit();
+  }
+
+  /**
+   * @brief Restore the state written by saveCheckpoint, replacing all the
+   * particles.
+   * @details The accelerations are restored too, so the run continues exactly
+   * as it would have without the restart, with no extra force evaluation.
+   * @throws CheckpointError if the checkpoint was written by an integrator of
+   * another dimension, scalar, particle type or scheme, or is inconsistent.
+   */
+  void loadCheckpoint(const CheckpointReader &reader)
+    requires std::is_trivially_copyable_v<ParticleType>
+  {
+    const auto layout = reader.value<CheckpointLayout>("layout");
+    const auto n = static_cast<size_t>(layout.count);
+    if (layout != checkpointLayout(n)) {
+      throw CheckpointError(
+          "Checkpoint was written by an integrator of another type");
+    }
+    auto section = [&]<typename T>(std::type_identity<T>,
+                                   const std::string &tag, size_t size) {
+      auto result = reader.array<T>(tag);
+      if (result.size() != size) {
+        throw CheckpointError("Checkpoint section " + tag +
+                              " has the wrong length");
+      }
+      return result;
+    };
+    constexpr std::type_identity<Scalar> kScalar;
+    constexpr std::type_identity<std::uint32_t> kIndex;
+
+    // Everything is decoded and checked before any member is touched, so a
+    // damaged checkpoint leaves the integrator as it was.
+    const auto particles =
+        section(std::type_identity<ParticleType>(), "particle", n);
+    Storage storage;
+    storage.resize(n);
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      std::ranges::copy(section(kScalar, checkpointTag("pos", axis), n),
+                        storage.positions(axis).begin());
+      std::ranges::copy(section(kScalar, checkpointTag("vel", axis), n),
+                        storage.velocities(axis).begin());
+      std::ranges::copy(section(kScalar, checkpointTag("acc", axis), n),
+                        storage.accelerations(axis).begin());
+    }
+    for (size_t i = 0; i < n; ++i) {
+      storage.setParticle(i, particles[i]);
+    }
+
+    const auto slot_index = reader.array<std::uint64_t>("slotidx");
+    const auto slot_generation =
+        section(kIndex, "slotgen", slot_index.size());
+    const auto slot_of = section(kIndex, "slotof", n);
+    const auto free_slots = reader.array<std::uint32_t>("freeslot");
+    std::vector<Slot> slots(slot_index.size());
+    for (size_t slot = 0; slot < slots.size(); ++slot) {
+      slots[slot] = {static_cast<size_t>(slot_index[slot]),
+                     slot_generation[slot]};
+    }
+    // Every slot is held by at most one particle or one free list entry.
+    std::vector<bool> taken(slots.size());
+    for (size_t i = 0; i < n; ++i) {
+      if (slot_of[i] >= slots.size() || slots[slot_of[i]].index != i) {
+        throw CheckpointError("Checkpoint has an inconsistent handle table");
+      }
+      taken[slot_of[i]] = true;
+    }
+    for (auto slot : free_slots) {
+      if (slot >= slots.size() || taken[slot]) {
+        throw CheckpointError("Checkpoint has an inconsistent free slot list");
+      }
+      taken[slot] = true;
+    }
+    const auto step = reader.value<CheckpointStep>("step");
+
+    auto restore = [&] {
+      storage_ = std::move(storage);
+      slots_ = std::move(slots);
+      slot_of_.assign(slot_of.begin(), slot_of.end());
+      free_slots_.assign(free_slots.begin(), free_slots.end());
+      time_ = step.time;
+      adaptive_dt_ = step.adaptive_dt;
+      force_evaluations_ = step.evaluations;
+      // Implementations with caches of their own see a change, but the
+      // accelerations are as they were when the checkpoint was written.
+      particlesChanged();
+      accelerations_valid_ = step.accelerations_valid != 0;
+    };
+    auto impl = static_cast<Impl *>(this);
+    if constexpr (requires { impl->readCheckpointImpl(reader, n); }) {
+      auto state = impl->readCheckpointImpl(reader, n);
+      restore();
+      impl->restoreCheckpointImpl(std::move(state));
+    } else {
+      restore();
+    }
+  }
+
+  /**
+   * @brief Restore the state from a checkpoint file, see above.
+   */
+  void loadCheckpoint(const std::filesystem::path &path)
+    requires std::is_trivially_copyable_v<ParticleType>
+  {
+    loadCheckpoint(CheckpointReader(path));
+  }
 
 protected:
+  Element element(size_t index) const {
+    return Element{storage_.particle(index), storage_.position(index),
+                   storage_.velocity(index), storage_.acceleration(index)};
+  }
+
+  using AccelerationSpan = typename Storage::Components;
+
+  /**
+   * @brief Compute the accelerations of all the particles at once.
+   * @details The implementation provides either a batched
+   * computeAccelerationsImpl(AccelerationSpan), which reads the current
+   * positions from the storage and writes one acceleration per particle, or a
+   * per-particle calculateAccelerationImpl(iterator), which is then called for
+   * every particle in turn.
+   * @param acc The output arrays, one element per particle.
+   */
+  void computeAccelerations(AccelerationSpan acc) const {
+    auto impl = static_cast<const Impl *>(this);
+    if constexpr (requires { impl->computeAccelerationsImpl(acc); }) {
+      impl->computeAccelerationsImpl(acc);
+    } else {
+      for (size_t i = 0; i < count(); ++i) {
+        acc.set(i, this->calculateAcceleration(i));
+      }
+    }
+  }
+
   Vector calculateAcceleration(iterator it) const {
     return static_cast<const Impl *>(this)->calculateAccelerationImpl(it);
   }
 
-  Vector calculateAcceleration(Element *elem) const {
-    return this->calculateAcceleration(
-        iterator(const_cast<BaseVerletIntegrator *>(this), elem));
+  Vector calculateAcceleration(size_t index) const {
+    return this->calculateAcceleration(iterator(this, index));
+  }
+
+  /**
+   * @brief How many times particles have been added, removed or edited.
+   * @details Implementations which cache per-particle data between steps
+   * compare this with the value they saw when building the cache.
+   */
+  [[nodiscard]] size_t changeCount() const { return changes_; }
+
+  /**
+   * @brief Compute the accelerations at the current positions into the
+   * storage, and count the evaluation.
+   */
+  void evaluateAccelerations() {
+    this->computeAccelerations(storage_.accelerationComponents());
+    ++force_evaluations_;
+  }
+
+  /**
+   * @brief Count forces evaluated outside evaluateAccelerations, in units of
+   * one evaluation for every particle.
+   */
+  void countForceEvaluations(size_t evaluations) {
+    force_evaluations_ += evaluations;
+  }
+
+  /**
+   * @brief Recompute the accelerations before the next step, for when the
+   * forces changed but the particles did not.
+   */
+  void invalidateAccelerations() { accelerations_valid_ = false; }
+
+  /**
+   * @brief The tag of the section of one component of a vector quantity.
+   */
+  static std::string checkpointTag(const char *name, size_t axis) {
+    return name + std::to_string(axis);
+  }
+
+  Storage storage_;
+
+private:
+  using Arrays = std::array<typename Storage::Array, kDimension>;
+
+  struct Slot {
+    size_t index = 0;
+    std::uint32_t generation = 0;
+  };
+
+  // The shape of the stored state, which must match on restore.
+  struct CheckpointLayout {
+    std::uint32_t dimension;
+    std::uint32_t scalar_size;
+    std::uint32_t particle_size;
+    std::uint32_t scheme_order;
+    std::uint32_t scheme_stages;
+    std::uint32_t reserved;
+    std::uint64_t count;
+
+    bool operator==(const CheckpointLayout &) const = default;
+  };
+
+  struct CheckpointStep {
+    TimeType time;
+    TimeType adaptive_dt;
+    std::uint64_t evaluations;
+    std::uint64_t accelerations_valid;
+  };
+
+  static CheckpointLayout checkpointLayout(size_t n) {
+    return {static_cast<std::uint32_t>(kDimension),
+            static_cast<std::uint32_t>(sizeof(Scalar)),
+            static_cast<std::uint32_t>(sizeof(ParticleType)),
+            static_cast<std::uint32_t>(Scheme::kOrder),
+            static_cast<std::uint32_t>(Scheme::kDrifts.size()),
+            0,
+            n};
+  }
+
+  void particlesChanged() {
+    accelerations_valid_ = false;
+    ++changes_;
+  }
+
+  static constexpr Scalar kMaxGrowth = 5;
+  static constexpr Scalar kMaxShrink = 0.2;
+  static constexpr Scalar kSymmetricTolerance = 1e-2;
+  static constexpr size_t kMaxIterations = 4;
+
+  /**
+   * @brief Size the scratch buffers and compute the initial accelerations.
+   */
+  void prepareStep() {
+    auto n = this->count();
+
+    // The scratch buffers are only grown, so they are reused between steps.
+    for (auto &buffer : previous_acceleration_) {
+      if (buffer.size() < n) {
+        buffer.resize(n);
+      }
+    }
+
+    // The accelerations are computed on the first step and whenever the set
+    // of particles has changed since the last step.
+    if (!accelerations_valid_) {
+      evaluateAccelerations();
+      accelerations_valid_ = true;
+    }
+  }
+
+  void advance(TimeType dt) {
+    auto n = this->count();
+
+    // Drift: x += v * dt + a * dt^2 / 2
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      auto x = storage_.positions(axis).data();
+      auto v = storage_.velocities(axis).data();
+      auto a = storage_.accelerations(axis).data();
+      auto prev = previous_acceleration_[axis].data();
+      for (size_t i = 0; i < n; ++i) {
+        x[i] += v[i] * dt + 0.5 * a[i] * dt * dt;
+        prev[i] = a[i];
+      }
+    }
+
+    evaluateAccelerations();
+
+    // Kick: v += (a_prev + a) * dt / 2
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      auto v = storage_.velocities(axis).data();
+      auto a = storage_.accelerations(axis).data();
+      auto prev = previous_acceleration_[axis].data();
+      for (size_t i = 0; i < n; ++i) {
+        v[i] += 0.5 * (prev[i] + a[i]) * dt;
+      }
+    }
+    time_ += dt;
+  }
+
+  /**
+   * @brief One step of a scheme other than velocity Verlet.
+   */
+  void advanceComposed(TimeType dt) {
+    auto n = this->count();
+    auto kick = [&](TimeType h) {
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        auto v = storage_.velocities(axis).data();
+        auto a = storage_.accelerations(axis).data();
+        for (size_t i = 0; i < n; ++i) {
+          v[i] += a[i] * h;
+        }
+      }
+    };
+    auto drift = [&](TimeType h) {
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        auto x = storage_.positions(axis).data();
+        auto v = storage_.velocities(axis).data();
+        for (size_t i = 0; i < n; ++i) {
+          x[i] += v[i] * h;
+        }
+      }
+    };
+
+    for (size_t stage = 0; stage < Scheme::kDrifts.size(); ++stage) {
+      kick(Scheme::kKicks[stage] * dt);
+      drift(Scheme::kDrifts[stage] * dt);
+      evaluateAccelerations();
+    }
+    kick(Scheme::kKicks.back() * dt);
+    time_ += dt;
+  }
+
+  void saveState() {
+    auto copy = [](Arrays &to, std::span<const Scalar> from, size_t axis) {
+      to[axis].assign(from.begin(), from.end());
+    };
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      copy(saved_position_, storage_.positions(axis), axis);
+      copy(saved_velocity_, storage_.velocities(axis), axis);
+      copy(saved_acceleration_, storage_.accelerations(axis), axis);
+    }
+    saved_time_ = time_;
+  }
+
+  void restoreState() {
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      std::ranges::copy(saved_position_[axis],
+                        storage_.positions(axis).begin());
+      std::ranges::copy(saved_velocity_[axis],
+                        storage_.velocities(axis).begin());
+      std::ranges::copy(saved_acceleration_[axis],
+                        storage_.accelerations(axis).begin());
+    }
+    time_ = saved_time_;
+  }
+
+  /**
+   * @brief A first guess of dt from the velocity and acceleration scales.
+   */
+  [[nodiscard]] TimeType initialStep(TimeType remaining) const {
+    auto result = remaining;
+    for (size_t i = 0; i < count(); ++i) {
+      auto speed = storage_.velocity(i).norm();
+      auto acceleration = storage_.acceleration(i).norm();
+      if (speed > 0 && acceleration > 0) {
+        result = std::min<TimeType>(result, 0.01 * speed / acceleration);
+      }
+    }
+    return result;
+  }
+
+  /**
+   * @brief The largest relative difference between the Verlet velocity and
+   * the embedded Euler velocity of the step just taken.
+   */
+  [[nodiscard]] Scalar embeddedError(TimeType dt) const {
+    Scalar result = 0;
+    for (size_t i = 0; i < count(); ++i) {
+      Scalar change2 = 0, speed2 = 0, acceleration2 = 0;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        auto d = storage_.accelerations(axis)[i] -
+                 previous_acceleration_[axis][i];
+        change2 += d * d;
+        speed2 += saved_velocity_[axis][i] * saved_velocity_[axis][i];
+        acceleration2 +=
+            previous_acceleration_[axis][i] * previous_acceleration_[axis][i];
+      }
+      if (change2 > 0) {
+        auto scale = std::sqrt(speed2) + std::sqrt(acceleration2) * dt;
+        result = std::max(result, 0.5 * std::sqrt(change2) * dt / scale);
+      }
+    }
+    return result;
   }
 
-  std::vector<Element> elements_;
+  /**
+   * @brief The largest relative change of an acceleration over the step just
+   * taken, 2 |a1 - a0| / (|a0| + |a1| + (|v0| + |v1|) / dt).
+   * @details The velocity term keeps the measure from reaching 2 where an
+   * acceleration passes through zero, e.g. twice a period of an oscillator,
+   * which would shrink dt without bound. It is symmetric in the two ends of
+   * the step, like the rest of the measure.
+   */
+  [[nodiscard]] Scalar accelerationChange(TimeType dt) const {
+    Scalar result = 0;
+    for (size_t i = 0; i < count(); ++i) {
+      Scalar change2 = 0, before2 = 0, after2 = 0, speed_before2 = 0,
+             speed_after2 = 0;
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        auto before = previous_acceleration_[axis][i];
+        auto after = storage_.accelerations(axis)[i];
+        change2 += (after - before) * (after - before);
+        before2 += before * before;
+        after2 += after * after;
+        speed_before2 += saved_velocity_[axis][i] * saved_velocity_[axis][i];
+        speed_after2 +=
+            storage_.velocities(axis)[i] * storage_.velocities(axis)[i];
+      }
+      if (change2 > 0) {
+        auto scale = std::sqrt(before2) + std::sqrt(after2) +
+                     (std::sqrt(speed_before2) + std::sqrt(speed_after2)) / dt;
+        result = std::max(result, 2 * std::sqrt(change2) / scale);
+      }
+    }
+    return result;
+  }
+
+  // The handle table: the slot of every index, the index and generation of
+  // every slot, and the slots of removed particles for reuse.
+  std::vector<std::uint32_t> slot_of_;
+  std::vector<Slot> slots_;
+  std::vector<std::uint32_t> free_slots_;
+  size_t changes_ = 0;
+
+  // Per-instance step state. It must never be shared between instances.
+  Arrays previous_acceleration_;
+  bool accelerations_valid_ = false;
+  TimeType time_ = 0;
+  size_t force_evaluations_ = 0;
+
+  // Adaptive step state.
+  TimeType adaptive_dt_ = 0;
+  Arrays saved_position_;
+  Arrays saved_velocity_;
+  Arrays saved_acceleration_;
+  TimeType saved_time_ = 0;
 };
 
 /**
@@ -219,13 +933,16 @@ protected:
  * @tparam Field The field used for the simulation.
  * @tparam Coord The coordinate system used for the simulation.
  * @tparam ParticleType The type of the particle to be integrated.
+ * @tparam Scheme The splitting scheme of a step.
  */
-template <typename Field, typename Coord, typename ParticleType>
+template <typename Field, typename Coord, typename ParticleType,
+          typename Scheme = VelocityVerlet>
 class FieldVerletIntegrator
     : public BaseVerletIntegrator<
-          FieldVerletIntegrator<Field, Coord, ParticleType>, Coord,
-          ParticleType> {
-  using Base = BaseVerletIntegrator<FieldVerletIntegrator, Coord, ParticleType>;
+          FieldVerletIntegrator<Field, Coord, ParticleType, Scheme>, Coord,
+          ParticleType, Scheme> {
+  using Base = BaseVerletIntegrator<FieldVerletIntegrator, Coord, ParticleType,
+                                    Scheme>;
   friend Base;
 
 public:
@@ -245,31 +962,72 @@ public:
   explicit FieldVerletIntegrator(const Field &force_field)
       : force_field_(force_field) {}
 
+  [[nodiscard]] const Field &field() const { return force_field_; }
+
+  /**
+   * @brief Modify the field between steps, e.g. add components to a FieldSet.
+   * The accelerations are recomputed before the next step.
+   * @return What func(field) returns.
+   */
+  template <typename Func>
+    requires std::invocable<Func, Field &>
+  decltype(auto) modifyField(Func &&func) {
+    this->invalidateAccelerations();
+    return std::invoke(std::forward<Func>(func), force_field_);
+  }
+
 private:
-  Vector calculateAccelerationImpl(iterator it) const {
-    return force_field_.evaluate(it->position, it->particle) /
-           it->particle.mass();
+  using AccelerationSpan = typename Base::AccelerationSpan;
+
+  void computeAccelerationsImpl(AccelerationSpan acc) const {
+    const auto &storage = this->storage_;
+    const auto positions = storage.positionComponents();
+    const auto particles = storage.particles();
+    // Fields derived from BaseField take the whole batch in one call, and
+    // write the forces straight into the acceleration arrays.
+    if constexpr (requires {
+                    force_field_.evaluateBatch(positions, particles, acc);
+                  }) {
+      force_field_.evaluateBatch(positions, particles, acc);
+      const auto masses = storage.masses();
+      for (size_t axis = 0; axis < Base::kDimension; ++axis) {
+        auto a = acc[axis].data();
+        for (size_t i = 0; i < storage.size(); ++i) {
+          a[i] /= masses[i];
+        }
+      }
+    } else {
+      for (size_t i = 0; i < storage.size(); ++i) {
+        acc.set(i, force_field_.evaluate(storage.position(i),
+                                         storage.particle(i)) /
+                       storage.mass(i));
+      }
+    }
   }
 
   Field force_field_;
 };
 
 // A deducing guide for LambdaField for convenience
-template <typename Coord, typename ParticleType>
-FieldVerletIntegrator(LambdaField<Coord, ParticleType>)
-    -> FieldVerletIntegrator<LambdaField<Coord, ParticleType>, Coord,
+template <typename Coord, typename ParticleType, typename Func>
+FieldVerletIntegrator(LambdaField<Coord, ParticleType, Func>)
+    -> FieldVerletIntegrator<LambdaField<Coord, ParticleType, Func>, Coord,
                              ParticleType>;
 
 /**
  * @brief Verlet integrator for particle simulation with gravity.
  * @tparam Coord The Coordinate system used for the simulation.
  * @tparam ParticleType The Particle type to be integrated.
+ * @tparam Scheme The splitting scheme of a step.
  */
-template <typename Coord, typename ParticleType>
+template <typename Coord, typename ParticleType,
+          typename Scheme = VelocityVerlet>
 class GravityIntegrator
-    : public BaseVerletIntegrator<GravityIntegrator<Coord, ParticleType>, Coord,
-                                  ParticleType> {
-  using Base = BaseVerletIntegrator<GravityIntegrator, Coord, ParticleType>;
+    : public BaseVerletIntegrator<
+          GravityIntegrator<Coord, ParticleType, Scheme>, Coord, ParticleType,
+          Scheme> {
+  using Base =
+      BaseVerletIntegrator<GravityIntegrator, Coord, ParticleType, Scheme>;
   friend Base;
 
 public:
@@ -279,34 +1037,377 @@ public:
   using CartesianVector = typename CoordinateVec::CartesianVector;
   using Vector = typename Base::Vector;
   using iterator = typename Base::iterator;
+  using Scalar = typename Base::Scalar;
 
+  static constexpr size_t kDimension = Base::kDimension;
   static constexpr double kGravityConstant = 6.67430e-11; // m^3 kg^-1 s^-2
 
+  /**
+   * @brief The all-pairs force kernels.
+   */
+  enum class Kernel {
+    /// Every particle sums the forces of all the others. Each pair is
+    /// evaluated twice, but the result does not depend on the threads.
+    Direct,
+    /// Every pair is evaluated once and the equal and opposite contributions
+    /// are scattered to both particles. Parallel runs accumulate into
+    /// per-thread buffers, so the rounding depends on the thread count.
+    Symmetric,
+  };
+
+  GravityIntegrator() = default;
+
+  explicit GravityIntegrator(const ParallelConfig &parallel,
+                             Kernel kernel = Kernel::Symmetric)
+      : parallel_(parallel), kernel_(kernel) {}
+
+  /**
+   * @brief Set how the force evaluation is spread over threads.
+   * @details With ParallelConfig::deterministic set, the direct kernel is
+   * used whatever kernel is selected, so that the results are bit-identical
+   * to the serial run for any number of threads and any schedule.
+   */
+  void setParallelConfig(const ParallelConfig &parallel) {
+    parallel_ = parallel;
+  }
+
+  [[nodiscard]] const ParallelConfig &parallelConfig() const {
+    return parallel_;
+  }
+
+  void setKernel(Kernel kernel) { kernel_ = kernel; }
+
+  [[nodiscard]] Kernel kernel() const { return kernel_; }
+
+  /**
+   * @brief Counters of a blockStep call.
+   */
+  struct BlockStats {
+    size_t substeps = 0;    ///< Block times at which some particle was active
+    size_t evaluations = 0; ///< Forces summed on single particles
+    size_t deepest = 0;     ///< The finest level used
+  };
+
+  /**
+   * @brief Advance the system by dt with individual block time steps.
+   * @details Every particle i moves with its own step dt / 2^level_i. At each
+   * block time only the particles whose step ends there are active. Their
+   * forces are summed over all the particles, the inactive ones being predicted
+   * to the block time from their last state with a third-order Taylor series.
+   * The active particles then complete a velocity Verlet step of their own
+   * length. The steps are chosen from the Aarseth-like criterion
+   * eta |a| / |da/dt|, with the jerk computed along with the forces, and
+   * rounded down to a power-of-two fraction of dt. A particle can move to a
+   * longer step only at a block time which is a multiple of that step, so the
+   * steps stay nested and all the particles are synchronized at the end.
+   *
+   * With one tight pair among many slow particles, only the pair is stepped at
+   * the fine levels, so the cost falls from O(N^2) per fine step to O(N) per
+   * fine step.
+   *
+   * The block steps are velocity Verlet steps, so only that scheme offers
+   * them. forceEvaluations() grows by the forces summed on single particles
+   * divided by the particle count, rounded down.
+   * @param dt The time to advance by, which is also the longest step.
+   * @param eta The accuracy parameter of the step criterion.
+   * @param max_level The finest level allowed, at most 30.
+   * @return The counters of this call.
+   */
+  BlockStats blockStep(TimeType dt, Scalar eta = 0.02, size_t max_level = 20)
+    requires std::same_as<Scheme, VelocityVerlet>
+  {
+    if (!(dt > 0) || !(eta > 0) || max_level > 30) {
+      throw std::invalid_argument("Invalid block step parameters");
+    }
+    auto &storage = this->storage_;
+    const auto n = storage.size();
+    BlockStats stats;
+    if (n == 0) {
+      this->setTime(this->time() + dt);
+      return stats;
+    }
+
+    // Time is counted in ticks of the finest level.
+    using Tick = std::uint64_t;
+    const Tick end = Tick{1} << max_level;
+    const auto tick = dt / static_cast<TimeType>(end);
+    auto ticks = [&](size_t level) { return end >> level; };
+
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      for (auto *array : {&jerk_[axis], &predicted_position_[axis],
+                          &predicted_velocity_[axis], &new_acceleration_[axis],
+                          &new_jerk_[axis]}) {
+        array->resize(n);
+      }
+    }
+    levels_.resize(n);
+    last_tick_.assign(n, 0);
+    active_.resize(n);
+    std::iota(active_.begin(), active_.end(), std::uint32_t{0});
+
+    // All the particles start synchronized, with fresh forces.
+    const auto &state = std::as_const(storage);
+    accelerationAndJerk<kDimension, Scalar>(
+        state.positionComponents(), state.velocityComponents(),
+        state.masses(), active_, storage.accelerationComponents(),
+        components(jerk_), kGravityConstant, parallel_);
+    stats.evaluations += n;
+    for (size_t i = 0; i < n; ++i) {
+      levels_[i] = requiredLevel(i, dt, eta, max_level, storage, jerk_);
+    }
+
+    for (Tick now = 0; now < end;) {
+      Tick next = end;
+      for (size_t i = 0; i < n; ++i) {
+        next = std::min(next, last_tick_[i] + ticks(levels_[i]));
+      }
+      active_.clear();
+      for (size_t i = 0; i < n; ++i) {
+        if (last_tick_[i] + ticks(levels_[i]) == next) {
+          active_.push_back(static_cast<std::uint32_t>(i));
+        }
+      }
+
+      // Predict everything to the block time. The active particles take the
+      // velocity Verlet drift, so their step is a plain Verlet step.
+      parallelFor(parallel_, n, [&](size_t i) {
+        const auto active = last_tick_[i] + ticks(levels_[i]) == next;
+        const auto tau = static_cast<TimeType>(next - last_tick_[i]) * tick;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          const auto x = storage.positions(axis)[i];
+          const auto v = storage.velocities(axis)[i];
+          const auto a = storage.accelerations(axis)[i];
+          const auto j = active ? Scalar{0} : jerk_[axis][i];
+          predicted_position_[axis][i] =
+              x + tau * (v + tau * (a / 2 + tau * j / 6));
+          predicted_velocity_[axis][i] = v + tau * (a + tau * j / 2);
+        }
+      });
+
+      accelerationAndJerk<kDimension, Scalar>(
+          constComponents(predicted_position_),
+          constComponents(predicted_velocity_), state.masses(), active_,
+          components(new_acceleration_), components(new_jerk_),
+          kGravityConstant, parallel_);
+      stats.evaluations += active_.size();
+      ++stats.substeps;
+
+      for (auto i : active_) {
+        const auto step = static_cast<TimeType>(ticks(levels_[i])) * tick;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          auto &a = storage.accelerations(axis)[i];
+          storage.positions(axis)[i] = predicted_position_[axis][i];
+          storage.velocities(axis)[i] +=
+              (a + new_acceleration_[axis][i]) * step / 2;
+          a = new_acceleration_[axis][i];
+          jerk_[axis][i] = new_jerk_[axis][i];
+        }
+        last_tick_[i] = next;
+
+        // Finer steps always fit, coarser ones only on their own boundaries.
+        auto level = requiredLevel(i, dt, eta, max_level, storage, jerk_);
+        if (level < levels_[i]) {
+          level = levels_[i] - 1;
+          if (next % ticks(level) != 0) {
+            level = levels_[i];
+          }
+        }
+        levels_[i] = static_cast<std::uint8_t>(level);
+        stats.deepest = std::max<size_t>(stats.deepest, level);
+      }
+      now = next;
+    }
+
+    this->countForceEvaluations(stats.evaluations / n);
+    this->setTime(this->time() + dt);
+    return stats;
+  }
+
+  /**
+   * @brief The block level of every particle after the last blockStep.
+   */
+  [[nodiscard]] std::span<const std::uint8_t> blockLevels() const {
+    return levels_;
+  }
+
 private:
-  [[nodiscard]] Vector calculateAccelerationImpl(iterator center_it) const {
-    // All evaluations are done in Cartesian coordinates to avoid complexity
-    auto center = center_it->position.toCartesian();
-    auto acc = CartesianVector{};
-
-    for (auto it = this->begin(); it != this->end(); ++it) {
-      if (it == center_it)
-        continue; // Skip self
-
-      auto other_pos = it->position.toCartesian();
-      auto distance_vector = other_pos - center;
-      auto distance_squared = distance_vector * distance_vector;
-      auto normalized_distance = distance_vector / std::sqrt(distance_squared);
-
-      if (distance_squared > 0) {
-        // Calculate gravitational force
-        auto force_magnitude =
-            kGravityConstant * it->particle.mass() / distance_squared;
-        acc += normalized_distance * force_magnitude;
+  using AccelerationSpan = typename Base::AccelerationSpan;
+  using Array = typename Base::Storage::Array;
+  using Arrays = std::array<Array, kDimension>;
+
+  static ComponentSpan<Scalar, kDimension> components(Arrays &arrays) {
+    std::array<std::span<Scalar>, kDimension> result;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result[axis] = arrays[axis];
+    }
+    return ComponentSpan<Scalar, kDimension>(result);
+  }
+
+  static ComponentSpan<const Scalar, kDimension>
+  constComponents(const Arrays &arrays) {
+    std::array<std::span<const Scalar>, kDimension> result;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      result[axis] = arrays[axis];
+    }
+    return ComponentSpan<const Scalar, kDimension>(result);
+  }
+
+  /**
+   * @brief The coarsest level whose step satisfies the criterion.
+   */
+  static size_t requiredLevel(size_t i, TimeType dt, Scalar eta,
+                              size_t max_level,
+                              const typename Base::Storage &storage,
+                              const Arrays &jerk) {
+    Scalar acc2 = 0, jerk2 = 0;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      acc2 += storage.accelerations(axis)[i] * storage.accelerations(axis)[i];
+      jerk2 += jerk[axis][i] * jerk[axis][i];
+    }
+    if (jerk2 == 0) {
+      return 0;
+    }
+    const auto required = eta * std::sqrt(acc2 / jerk2);
+    size_t level = 0;
+    for (auto step = dt; step > required && level < max_level; step /= 2) {
+      ++level;
+    }
+    return level;
+  }
+
+  void computeAccelerationsImpl(AccelerationSpan acc) const {
+    // The raw components of Cartesian coordinates are the Cartesian vector,
+    // so the evaluation runs directly on the storage arrays. All the
+    // accelerations are computed from the same set of positions.
+    if (kernel_ == Kernel::Direct || parallel_.deterministic) {
+      computeDirect(acc);
+    } else {
+      computeSymmetric(acc);
+    }
+  }
+
+  void computeDirect(AccelerationSpan acc) const {
+    const auto &storage = this->storage_;
+    const auto n = storage.size();
+    const auto masses = storage.masses().data();
+    const auto positions = storage.positionComponents();
+
+    parallelFor(parallel_, n, [&](size_t center) {
+      Scalar center_pos[kDimension];
+      Scalar center_acc[kDimension] = {};
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        center_pos[axis] = positions[axis][center];
+      }
+
+      for (size_t other = 0; other < n; ++other) {
+        Scalar d[kDimension];
+        Scalar distance_squared = 0;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          d[axis] = positions[axis][other] - center_pos[axis];
+          distance_squared += d[axis] * d[axis];
+        }
+        // This also skips the particle itself.
+        if (distance_squared > 0) {
+          auto inv_distance = 1.0 / std::sqrt(distance_squared);
+          auto factor = kGravityConstant * masses[other] * inv_distance *
+                        inv_distance * inv_distance;
+          for (size_t axis = 0; axis < kDimension; ++axis) {
+            center_acc[axis] += factor * d[axis];
+          }
+        }
+      }
+
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        acc[axis][center] = center_acc[axis];
+      }
+    });
+  }
+
+  void computeSymmetric(AccelerationSpan acc) const {
+    const auto &storage = this->storage_;
+    const auto n = storage.size();
+    const auto masses = storage.masses().data();
+    const auto positions = storage.positionComponents();
+    const auto threads = static_cast<size_t>(parallel_.threads());
+
+    // Every thread scatters into its own buffers, which are summed at the end.
+    if (thread_acc_.size() < threads) {
+      thread_acc_.resize(threads);
+    }
+    for (size_t t = 0; t < threads; ++t) {
+      for (auto &buffer : thread_acc_[t]) {
+        buffer.assign(n, Scalar{0});
       }
     }
 
-    return acc;
+    auto row = [&](size_t i, int thread) {
+      auto &local = thread_acc_[thread];
+      Scalar pos_i[kDimension];
+      Scalar acc_i[kDimension] = {};
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        pos_i[axis] = positions[axis][i];
+      }
+      const auto mass_i = kGravityConstant * masses[i];
+
+      for (size_t j = i + 1; j < n; ++j) {
+        Scalar d[kDimension];
+        Scalar distance_squared = 0;
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          d[axis] = positions[axis][j] - pos_i[axis];
+          distance_squared += d[axis] * d[axis];
+        }
+        if (distance_squared > 0) {
+          auto inv_distance = 1.0 / std::sqrt(distance_squared);
+          auto inv_cube = inv_distance * inv_distance * inv_distance;
+          auto factor_i = kGravityConstant * masses[j] * inv_cube;
+          auto factor_j = mass_i * inv_cube;
+          for (size_t axis = 0; axis < kDimension; ++axis) {
+            acc_i[axis] += factor_i * d[axis];
+            local[axis][j] -= factor_j * d[axis];
+          }
+        }
+      }
+
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        local[axis][i] += acc_i[axis];
+      }
+    };
+
+    // Row i has n - i - 1 pairs, so rows are folded in pairs (k, n - 1 - k)
+    // to give every iteration the same amount of work.
+    parallelForThreads(parallel_, (n + 1) / 2, [&](size_t k, int thread) {
+      row(k, thread);
+      if (n - 1 - k != k) {
+        row(n - 1 - k, thread);
+      }
+    });
+
+    parallelFor(parallel_, n, [&](size_t i) {
+      for (size_t axis = 0; axis < kDimension; ++axis) {
+        Scalar sum = 0;
+        for (size_t t = 0; t < threads; ++t) {
+          sum += thread_acc_[t][axis][i];
+        }
+        acc[axis][i] = sum;
+      }
+    });
   }
+
+  ParallelConfig parallel_;
+  Kernel kernel_ = Kernel::Symmetric;
+
+  // Per-thread accumulators of the symmetric kernel, reused between steps.
+  mutable std::vector<std::array<Array, kDimension>> thread_acc_;
+
+  // Block step state, reused between calls.
+  Arrays jerk_;
+  Arrays predicted_position_;
+  Arrays predicted_velocity_;
+  Arrays new_acceleration_;
+  Arrays new_jerk_;
+  std::vector<std::uint8_t> levels_;
+  std::vector<std::uint64_t> last_tick_;
+  std::vector<std::uint32_t> active_;
 };
 
 } // namespace phosphorus
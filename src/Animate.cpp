@@ -29,6 +29,7 @@ void AnimateGenerator::generate(const std::string &filename,
     name_ = filename;
     time_ = time;
     point_list_ = {points};
+    column_list_.clear();
     setup();
     generateDatafile(points);
     blockWorkflow();
@@ -39,7 +40,7 @@ void AnimateGenerator::generate(const std::string &filename,
 }
 
 void AnimateGenerator::generate(const std::string &filename, double time) {
-  if (point_list_.empty()) {
+  if (trajectoryCount() == 0) {
     throw std::runtime_error("No points to generate animation");
   }
   try {
@@ -49,6 +50,9 @@ void AnimateGenerator::generate(const std::string &filename, double time) {
     for (const auto &points : point_list_) {
       generateDatafile(points);
     }
+    for (const auto &[x, y] : column_list_) {
+      generateDatafile(x, y);
+    }
     blockWorkflow();
     cleanup();
   } catch (std::exception &e) {
@@ -64,27 +68,38 @@ void AnimateGenerator::setup() {
 }
 
 void AnimateGenerator::generateDatafile(std::span<Cartesian2D> points) {
-  auto temp_file = fs::path(current_temp_) / (name_ + ".dat");
-  auto temp_name = temp_file.string();
   vector<double> x = points |
                      views::transform([](const auto &p) { return p[0]; }) |
                      to<std::vector<double>>();
   vector<double> y = points |
                      views::transform([](const auto &p) { return p[1]; }) |
                      to<std::vector<double>>();
+  generateDatafile(x, y);
+}
+
+void AnimateGenerator::generateDatafile(const DataColumn &x,
+                                        const DataColumn &y) {
+  auto temp_file = fs::path(current_temp_) / (name_ + ".dat");
+  auto temp_name = temp_file.string();
 
   static constexpr double kScaleFactor = 1.1; // Scale factor for coordinates
-  min_x = min(*ranges::min_element(x) * kScaleFactor, min_x);
-  max_x = max(*ranges::max_element(x) * kScaleFactor, max_x);
-  min_y = min(*ranges::min_element(y) * kScaleFactor, min_y);
-  max_y = max(*ranges::max_element(y) * kScaleFactor, max_y);
+  x.forEachBlock([this](std::span<const double> block) {
+    min_x = min(*ranges::min_element(block) * kScaleFactor, min_x);
+    max_x = max(*ranges::max_element(block) * kScaleFactor, max_x);
+  });
+  y.forEachBlock([this](std::span<const double> block) {
+    min_y = min(*ranges::min_element(block) * kScaleFactor, min_y);
+    max_y = max(*ranges::max_element(block) * kScaleFactor, max_y);
+  });
 
   Gnuplot::generateDataBlock(temp_name, x, y);
 }
 
 void AnimateGenerator::blockWorkflow() {
   static constexpr int kBlockFactor = 50;
-  auto n = point_list_[0].size(); // Assuming all spans have the same size
+  // Assuming all spans have the same size
+  auto n = point_list_.empty() ? column_list_[0].first.size()
+                               : point_list_[0].size();
   auto block_count = (n + kBlockFactor - 1) / kBlockFactor;
   auto step = (n + block_count - 1) / block_count; // Calculate step size
 
@@ -164,7 +179,7 @@ void AnimateGenerator::generateKeyframeBlock(int start, int end) {
             .grid = true,
         });
 
-    for (int idx = 0; idx < point_list_.size(); ++idx) {
+    for (int idx = 0; idx < trajectoryCount(); ++idx) {
       plot.plot({
                     .index = idx,
                     .every = {1, i + 1},
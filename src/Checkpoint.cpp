@@ -0,0 +1,206 @@
+//
+// Created by Renatus Madrigal on 6/27/2025.
+//
+
+#include "phosphorus/Checkpoint.h"
+#include "FileMapping.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+namespace phosphorus {
+
+namespace {
+
+constexpr std::array<char, 8> kMagic = {'P', 'H', 'O', 'S',
+                                        'C', 'K', 'P', 'T'};
+constexpr std::uint32_t kByteOrderMark = 0x01020304;
+constexpr size_t kHeaderSize = CheckpointWriter::kAlignment;
+
+struct FileHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t byte_order;
+};
+
+struct SectionHeader {
+  std::array<char, CheckpointWriter::kTagSize> tag;
+  std::uint64_t size;
+};
+
+static_assert(sizeof(FileHeader) <= kHeaderSize);
+static_assert(sizeof(SectionHeader) == 16);
+
+size_t padding(size_t size) {
+  constexpr auto kAlignment = CheckpointWriter::kAlignment;
+  return (kAlignment - size % kAlignment) % kAlignment;
+}
+
+std::string systemMessage(const std::string &what,
+                          const std::filesystem::path &path) {
+  return what + " " + path.string() + ": " +
+         std::generic_category().message(errno);
+}
+
+// Write the data of a flushed file through to the disk.
+bool syncToDisk(std::FILE *file) {
+#ifndef _WIN32
+  return ::fsync(fileno(file)) == 0;
+#else
+  return _commit(_fileno(file)) == 0;
+#endif
+}
+
+} // namespace
+
+CheckpointWriter::CheckpointWriter(std::filesystem::path path)
+    : path_(std::move(path)) {
+  temporary_ = path_;
+  temporary_ += ".partial";
+  file_ = std::fopen(temporary_.string().c_str(), "wb");
+  if (file_ == nullptr) {
+    throw CheckpointError(systemMessage("Cannot create", temporary_));
+  }
+  // The arrays are written in single calls, so the stdio buffer is only used
+  // for the headers and does not need to be large.
+  std::array<std::byte, kHeaderSize> header{};
+  const FileHeader file_header{kMagic, kCheckpointVersion, kByteOrderMark};
+  std::memcpy(header.data(), &file_header, sizeof(file_header));
+  writeBytes(header.data(), header.size());
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  if (file_ != nullptr) {
+    std::fclose(file_);
+    std::error_code error;
+    std::filesystem::remove(temporary_, error);
+  }
+}
+
+void CheckpointWriter::write(std::string_view tag,
+                             std::span<const std::byte> data) {
+  if (file_ == nullptr) {
+    throw CheckpointError("Checkpoint has already been committed");
+  }
+  if (tag.empty() || tag.size() > kTagSize) {
+    throw CheckpointError("Invalid checkpoint section tag: " +
+                          std::string(tag));
+  }
+  if (!written_.emplace(std::string(tag), data.size()).second) {
+    throw CheckpointError("Duplicate checkpoint section: " + std::string(tag));
+  }
+  SectionHeader header{};
+  std::ranges::copy(tag, header.tag.begin());
+  header.size = data.size();
+  writeBytes(&header, sizeof(header));
+  // The section header leaves the data 16 bytes past an aligned offset.
+  static constexpr std::array<std::byte, kAlignment> kZeros{};
+  writeBytes(kZeros.data(), kAlignment - sizeof(header));
+  writeBytes(data.data(), data.size());
+  writeBytes(kZeros.data(), padding(data.size()));
+}
+
+void CheckpointWriter::commit() {
+  if (file_ == nullptr) {
+    throw CheckpointError("Checkpoint has already been committed");
+  }
+  // The data must be on the disk before the rename is, or a crash in between
+  // can leave a renamed but empty or partial file.
+  const auto flushed = std::fflush(file_) == 0 && syncToDisk(file_);
+  const auto closed = std::fclose(file_) == 0;
+  file_ = nullptr;
+  if (!flushed || !closed) {
+    std::error_code error;
+    std::filesystem::remove(temporary_, error);
+    throw CheckpointError(systemMessage("Cannot write", temporary_));
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary_, path_, error);
+  if (error) {
+    throw CheckpointError("Cannot rename " + temporary_.string() + " to " +
+                          path_.string() + ": " + error.message());
+  }
+}
+
+void CheckpointWriter::writeBytes(const void *data, size_t size) {
+  if (size != 0 && std::fwrite(data, 1, size, file_) != size) {
+    throw CheckpointError(systemMessage("Cannot write", temporary_));
+  }
+}
+
+class CheckpointReader::Mapping : public detail::FileMapping {
+public:
+  using FileMapping::FileMapping;
+};
+
+CheckpointReader::CheckpointReader(const std::filesystem::path &path) {
+  try {
+    mapping_ = std::make_unique<Mapping>(path);
+  } catch (const std::system_error &error) {
+    throw CheckpointError(error.what());
+  }
+  const auto bytes = mapping_->bytes();
+  const auto invalid = [&](const std::string &what) {
+    return CheckpointError(path.string() + " is not a valid checkpoint: " +
+                           what);
+  };
+
+  if (bytes.size() < kHeaderSize) {
+    throw invalid("the file is too short");
+  }
+  FileHeader header{};
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  if (header.magic != kMagic) {
+    throw invalid("wrong magic number");
+  }
+  if (header.byte_order != kByteOrderMark) {
+    throw invalid("written on a machine of another byte order");
+  }
+  if (header.version == 0 || header.version > kCheckpointVersion) {
+    throw invalid("unsupported version " + std::to_string(header.version));
+  }
+  version_ = header.version;
+
+  size_t offset = kHeaderSize;
+  while (offset < bytes.size()) {
+    if (bytes.size() - offset < kHeaderSize) {
+      throw invalid("truncated section header");
+    }
+    SectionHeader section{};
+    std::memcpy(&section, bytes.data() + offset, sizeof(section));
+    offset += kHeaderSize;
+    if (section.size > bytes.size() - offset) {
+      throw invalid("truncated section");
+    }
+    const auto size = static_cast<size_t>(section.size);
+    const auto length =
+        std::ranges::find(section.tag, '\0') - section.tag.begin();
+    sections_.emplace(std::string(section.tag.data(), length),
+                      bytes.subspan(offset, size));
+    offset += std::min(size + padding(size), bytes.size() - offset);
+  }
+}
+
+CheckpointReader::~CheckpointReader() = default;
+CheckpointReader::CheckpointReader(CheckpointReader &&) noexcept = default;
+CheckpointReader &
+CheckpointReader::operator=(CheckpointReader &&) noexcept = default;
+
+std::span<const std::byte>
+CheckpointReader::section(std::string_view tag) const {
+  const auto it = sections_.find(tag);
+  if (it == sections_.end()) {
+    throw CheckpointError("Checkpoint has no section " + std::string(tag));
+  }
+  return it->second;
+}
+
+} // namespace phosphorus
@@ -0,0 +1,91 @@
+//
+// Created by Renatus Madrigal on 6/30/2025.
+//
+
+#include "FileMapping.h"
+#include <cerrno>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace phosphorus::detail {
+
+namespace {
+
+std::system_error systemError(const std::string &what,
+                              const std::filesystem::path &path) {
+  return {errno, std::generic_category(), what + " " + path.string()};
+}
+
+} // namespace
+
+#ifndef _WIN32
+
+FileMapping::FileMapping(const std::filesystem::path &path, Access access) {
+  const auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw systemError("Cannot open", path);
+  }
+  struct stat status {};
+  if (::fstat(fd, &status) != 0) {
+    const auto error = systemError("Cannot stat", path);
+    ::close(fd);
+    throw error;
+  }
+  size_ = static_cast<size_t>(status.st_size);
+  if (size_ > 0) {
+    auto address = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+      const auto error = systemError("Cannot map", path);
+      ::close(fd);
+      throw error;
+    }
+    data_ = static_cast<const std::byte *>(address);
+    ::madvise(address, size_,
+              access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+  }
+  ::close(fd);
+}
+
+FileMapping::~FileMapping() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<std::byte *>(data_), size_);
+  }
+}
+
+#else
+
+FileMapping::FileMapping(const std::filesystem::path &path, Access) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    throw systemError("Cannot open", path);
+  }
+  const auto size = static_cast<size_t>(file.tellg());
+  // Over-allocate so the data can start on an aligned address.
+  static constexpr size_t kAlignment = 64;
+  buffer_.resize(size + kAlignment);
+  const auto address = reinterpret_cast<std::uintptr_t>(buffer_.data());
+  const auto offset = (kAlignment - address % kAlignment) % kAlignment;
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(buffer_.data() + offset),
+            static_cast<std::streamsize>(size));
+  if (!file) {
+    throw systemError("Cannot read", path);
+  }
+  data_ = buffer_.data() + offset;
+  size_ = size;
+}
+
+FileMapping::~FileMapping() = default;
+
+#endif
+
+} // namespace phosphorus::detail
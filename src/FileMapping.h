@@ -0,0 +1,51 @@
+//
+// Created by Renatus Madrigal on 6/30/2025.
+//
+
+#ifndef PHOSPHORUS_SRC_FILEMAPPING_H
+#define PHOSPHORUS_SRC_FILEMAPPING_H
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace phosphorus::detail {
+
+/**
+ * @brief A read-only view of a whole file in memory.
+ * @details On POSIX systems the file is mapped with mmap, so only the pages
+ * which are read are loaded, and they come straight from the page cache.
+ * Elsewhere, the file is read into memory in one call. Either way, the data
+ * starts on a 64 byte boundary.
+ */
+class FileMapping {
+public:
+  /// How the pages of the file will be read, as a hint to the system.
+  enum class Access { Sequential, Random };
+
+  /**
+   * @throws std::system_error if the file cannot be opened or mapped.
+   */
+  explicit FileMapping(const std::filesystem::path &path,
+                       Access access = Access::Sequential);
+  ~FileMapping();
+
+  FileMapping(const FileMapping &) = delete;
+  FileMapping &operator=(const FileMapping &) = delete;
+
+  [[nodiscard]] std::span<const std::byte> bytes() const {
+    return {data_, size_};
+  }
+
+private:
+  const std::byte *data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  std::vector<std::byte> buffer_;
+#endif
+};
+
+} // namespace phosphorus::detail
+
+#endif // PHOSPHORUS_SRC_FILEMAPPING_H
@@ -10,12 +10,14 @@
 #include <boost/asio.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/process.hpp>
+#include <algorithm>
 #include <format>
 #include <fstream>
 #include <random>
 #include <range/v3/view.hpp>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 namespace asio = boost::asio;
 namespace bp = boost::process;
@@ -184,29 +186,48 @@ struct Gnuplot::TempFileGuard {
 };
 
 void Gnuplot::generateDataBlock(const std::string &filename,
-                                std::span<double> x, std::span<double> y) {
+                                const DataColumn &x, const DataColumn &y) {
   using std::format;
   std::fstream file(filename, std::ios::app);
   if (!file.is_open()) {
     throw GnuplotException("Failed to open file: " + filename);
   }
-  for (auto [x, y] : ranges::views::zip(x, y)) {
-    file << format("{:.9f} {:.9f}\n", x, y);
+  // The columns are read a block at a time, so they need not be in memory.
+  const auto n = std::min(x.size(), y.size());
+  std::vector<double> xs(std::min(n, DataColumn::kBlockSize));
+  std::vector<double> ys(xs.size());
+  for (size_t offset = 0; offset < n; offset += DataColumn::kBlockSize) {
+    const auto count = std::min(DataColumn::kBlockSize, n - offset);
+    x.read(offset, std::span(xs).first(count));
+    y.read(offset, std::span(ys).first(count));
+    for (size_t i = 0; i < count; ++i) {
+      file << format("{:.9f} {:.9f}\n", xs[i], ys[i]);
+    }
   }
   file << "\n\n"; // End of data block
   file.close();
 }
 
 void Gnuplot::generate3DDataBlock(const std::string &filename,
-                                  std::span<double> x, std::span<double> y,
-                                  std::span<double> z) {
+                                  const DataColumn &x, const DataColumn &y,
+                                  const DataColumn &z) {
   using std::format;
   std::fstream file(filename, std::ios::app);
   if (!file.is_open()) {
     throw GnuplotException("Failed to open file: " + filename);
   }
-  for (auto [x, y, z] : ranges::views::zip(x, y, z)) {
-    file << format("{:.9f} {:.9f} {:.9f}\n", x, y, z);
+  const auto n = std::min({x.size(), y.size(), z.size()});
+  std::vector<double> xs(std::min(n, DataColumn::kBlockSize));
+  std::vector<double> ys(xs.size());
+  std::vector<double> zs(xs.size());
+  for (size_t offset = 0; offset < n; offset += DataColumn::kBlockSize) {
+    const auto count = std::min(DataColumn::kBlockSize, n - offset);
+    x.read(offset, std::span(xs).first(count));
+    y.read(offset, std::span(ys).first(count));
+    z.read(offset, std::span(zs).first(count));
+    for (size_t i = 0; i < count; ++i) {
+      file << format("{:.9f} {:.9f} {:.9f}\n", xs[i], ys[i], zs[i]);
+    }
   }
   file << "\n\n"; // End of data block
   file.close();
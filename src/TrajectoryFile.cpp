@@ -0,0 +1,770 @@
+//
+// Created by Renatus Madrigal on 6/29/2025.
+//
+
+#include "phosphorus/TrajectoryFile.h"
+#include "FileMapping.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <zlib.h>
+
+namespace phosphorus {
+
+namespace {
+
+constexpr std::array<char, 8> kMagic = {'P', 'H', 'O', 'S',
+                                        'T', 'R', 'A', 'J'};
+constexpr std::array<char, 8> kIndexMagic = {'P', 'H', 'O', 'S',
+                                             'T', 'I', 'D', 'X'};
+constexpr std::uint32_t kByteOrderMark = 0x01020304;
+constexpr size_t kHeaderSize = 64;
+// Plain columns are aligned for mapping, encoded ones only for their
+// headers.
+constexpr size_t kPlainAlignment = 64;
+constexpr size_t kAlignment = 8;
+
+struct FileHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint32_t dimension;
+  std::uint32_t reserved;
+  std::uint64_t particles;
+  std::uint64_t chunk_samples;
+  double tolerance;
+};
+
+struct ChunkHeader {
+  std::uint64_t first_sample;
+  std::uint32_t samples;
+  std::uint32_t columns;
+};
+
+enum class Encoding : std::uint32_t {
+  Plain = 0,     // The values, not compressed
+  Bits = 1,      // The bits of the values, predicted
+  Quantized = 2, // The values as multiples of the step, predicted
+};
+
+struct ColumnEntry {
+  std::uint64_t offset;
+  std::uint64_t size;
+  Encoding encoding;
+  std::uint32_t reserved;
+};
+
+struct IndexEntry {
+  std::uint64_t offset;
+  std::uint64_t first_sample;
+  std::uint64_t samples;
+};
+
+struct Footer {
+  std::uint64_t index_offset;
+  std::uint64_t chunks;
+  std::uint64_t samples;
+  std::array<char, 8> magic;
+};
+
+static_assert(sizeof(FileHeader) <= kHeaderSize);
+static_assert(sizeof(ChunkHeader) == 16);
+static_assert(sizeof(ColumnEntry) == 24);
+static_assert(sizeof(IndexEntry) == 24);
+static_assert(sizeof(Footer) == 32);
+
+size_t alignUp(size_t offset, size_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+std::string systemMessage(const std::string &what,
+                          const std::filesystem::path &path) {
+  return what + " " + path.string() + ": " +
+         std::generic_category().message(errno);
+}
+
+// Every word is predicted by extrapolating the two before it linearly, and
+// replaced by the error of the prediction, which is small for a smooth
+// trajectory. The arithmetic wraps around, so the bits of any doubles are
+// restored exactly. The errors are zigzag encoded, so small negative ones
+// have zero high bytes too.
+void predict(std::span<std::uint64_t> words) {
+  std::uint64_t previous = 0;
+  std::uint64_t before = 0;
+  for (size_t i = 0; i < words.size(); ++i) {
+    const auto word = words[i];
+    const auto prediction = i < 2 ? previous : 2 * previous - before;
+    const auto error = static_cast<std::int64_t>(word - prediction);
+    words[i] = (static_cast<std::uint64_t>(error) << 1) ^
+               static_cast<std::uint64_t>(error >> 63);
+    before = previous;
+    previous = word;
+  }
+}
+
+void unpredict(std::span<std::uint64_t> words) {
+  std::uint64_t previous = 0;
+  std::uint64_t before = 0;
+  for (size_t i = 0; i < words.size(); ++i) {
+    const auto error = (words[i] >> 1) ^ (0 - (words[i] & 1));
+    const auto prediction = i < 2 ? previous : 2 * previous - before;
+    before = previous;
+    previous = prediction + error;
+    words[i] = previous;
+  }
+}
+
+// The multiples of the step which can be told apart from their neighbours.
+constexpr double kLargestMultiple = 0x1p52;
+
+bool quantizable(std::span<const double> values, double step) {
+  return std::ranges::all_of(values, [step](double value) {
+    return std::abs(value / step) < kLargestMultiple;
+  });
+}
+
+// The bytes of the encoded words are regrouped by significance: all the
+// lowest bytes, then all the next ones, and so on. The high bytes of small
+// differences are zero, and end up in long runs.
+void shuffle(std::span<const std::uint64_t> words, unsigned char *bytes) {
+  const auto n = words.size();
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t b = 0; b < 8; ++b) {
+      bytes[b * n + i] = static_cast<unsigned char>(words[i] >> (8 * b));
+    }
+  }
+}
+
+void unshuffle(const unsigned char *bytes, std::span<std::uint64_t> words) {
+  const auto n = words.size();
+  for (size_t i = 0; i < n; ++i) {
+    std::uint64_t word = 0;
+    for (size_t b = 0; b < 8; ++b) {
+      word |= std::uint64_t{bytes[b * n + i]} << (8 * b);
+    }
+    words[i] = word;
+  }
+}
+
+} // namespace
+
+class TrajectoryFileWriter::Impl {
+public:
+  Impl(const std::filesystem::path &path, size_t dimension, size_t particles,
+       Options options)
+      : path_(path), columns_(1 + dimension * particles), options_(options) {
+    if (dimension == 0 || options_.chunk_samples == 0 ||
+        options_.chunk_samples > std::numeric_limits<std::uint32_t>::max() ||
+        options_.buffers == 0 || options_.level < 0 || options_.level > 9 ||
+        !(options_.tolerance >= 0) || !std::isfinite(options_.tolerance)) {
+      throw TrajectoryFileError("Invalid trajectory file options");
+    }
+    file_ = std::fopen(path_.string().c_str(), "wb");
+    if (file_ == nullptr) {
+      throw TrajectoryFileError(systemMessage("Cannot create", path_));
+    }
+    std::array<std::byte, kHeaderSize> header{};
+    const FileHeader file_header{kMagic,
+                                 kTrajectoryFileVersion,
+                                 kByteOrderMark,
+                                 static_cast<std::uint32_t>(dimension),
+                                 0,
+                                 particles,
+                                 options_.chunk_samples,
+                                 options_.tolerance};
+    std::memcpy(header.data(), &file_header, sizeof(file_header));
+    try {
+      writeBytes(header.data(), header.size());
+    } catch (...) {
+      std::fclose(file_);
+      throw;
+    }
+    offset_ = kHeaderSize;
+    // Runs of zeros are all the matching there is to find in the predicted
+    // bytes, so a search for longer matches would only cost time.
+    if (deflateInit2(&stream_, options_.level, Z_DEFLATED, 15, 8, Z_RLE) !=
+        Z_OK) {
+      std::fclose(file_);
+      throw TrajectoryFileError("Cannot initialize zlib");
+    }
+    current_.data.resize(columns_ * options_.chunk_samples);
+    allocated_ = 1;
+    thread_ = std::thread([this] { writerLoop(); });
+  }
+
+  ~Impl() {
+    try {
+      close();
+    } catch (...) {
+      // Reported by close, if it is called.
+    }
+    deflateEnd(&stream_);
+  }
+
+  void append(double time, std::span<const double> positions) {
+    if (closed_) {
+      throw TrajectoryFileError("Trajectory file is closed");
+    }
+    // The chunk which failed to go out may still be full.
+    if (failed_) {
+      std::rethrow_exception(failed_);
+    }
+    if (positions.size() + 1 != columns_) {
+      throw TrajectoryFileError("Wrong number of positions in a sample");
+    }
+    const auto stride = options_.chunk_samples;
+    const auto row = current_.size;
+    auto data = current_.data.data();
+    data[row] = time;
+    for (size_t i = 0; i < positions.size(); ++i) {
+      data[(i + 1) * stride + row] = positions[i];
+    }
+    ++samples_;
+    if (++current_.size == stride) {
+      submit();
+    }
+  }
+
+  void close() {
+    if (closed_) {
+      if (failed_) {
+        std::rethrow_exception(failed_);
+      }
+      return;
+    }
+    closed_ = true;
+    std::exception_ptr error;
+    try {
+      submit();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    {
+      std::lock_guard lock(mutex_);
+      stopping_ = true;
+    }
+    work_.notify_one();
+    thread_.join();
+    if (!error) {
+      error = error_;
+    }
+    if (!error) {
+      try {
+        writeIndex();
+      } catch (...) {
+        error = std::current_exception();
+      }
+    }
+    if (std::fclose(file_) != 0 && !error) {
+      error = std::make_exception_ptr(
+          TrajectoryFileError(systemMessage("Cannot write", path_)));
+    }
+    if (error) {
+      failed_ = error;
+      std::rethrow_exception(error);
+    }
+  }
+
+  [[nodiscard]] size_t samples() const { return samples_; }
+
+private:
+  struct Chunk {
+    std::vector<double> data;
+    size_t first = 0;
+    size_t size = 0;
+  };
+
+  // Hand the chunk being filled to the writer thread, and take a free buffer
+  // in its place.
+  void submit() {
+    if (current_.size == 0) {
+      return;
+    }
+    std::unique_lock lock(mutex_);
+    if (error_) {
+      failed_ = error_;
+      std::rethrow_exception(error_);
+    }
+    const auto next = current_.first + current_.size;
+    queue_.push_back(std::move(current_));
+    work_.notify_one();
+    if (free_.empty() && allocated_ < options_.buffers) {
+      ++allocated_;
+      free_.emplace_back(columns_ * options_.chunk_samples);
+    }
+    freed_.wait(lock, [this] { return !free_.empty(); });
+    current_ = Chunk{std::move(free_.back()), next, 0};
+    free_.pop_back();
+  }
+
+  void writerLoop() {
+    while (true) {
+      std::unique_lock lock(mutex_);
+      work_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      auto chunk = std::move(queue_.front());
+      queue_.pop_front();
+      const auto failed = static_cast<bool>(error_);
+      lock.unlock();
+
+      // After an error, the chunks are dropped, but their buffers are still
+      // returned so append does not wait forever.
+      std::exception_ptr error;
+      if (!failed) {
+        try {
+          writeChunk(chunk);
+        } catch (...) {
+          error = std::current_exception();
+        }
+      }
+
+      lock.lock();
+      if (error) {
+        error_ = error;
+      }
+      free_.push_back(std::move(chunk.data));
+      lock.unlock();
+      freed_.notify_one();
+    }
+  }
+
+  void writeChunk(const Chunk &chunk) {
+    blocks_.resize(columns_);
+    std::vector<ColumnEntry> entries(columns_);
+    const auto chunk_offset = offset_;
+    auto position = offset_ + sizeof(ChunkHeader) +
+                    columns_ * sizeof(ColumnEntry);
+    for (size_t column = 0; column < columns_; ++column) {
+      const std::span values(
+          chunk.data.data() + column * options_.chunk_samples, chunk.size);
+      const auto tolerance = column == 0 ? 0.0 : options_.tolerance;
+      auto &entry = entries[column];
+      entry.encoding = encode(values, tolerance, blocks_[column]);
+      entry.size = blocks_[column].size();
+      position = alignUp(position, entry.encoding == Encoding::Plain
+                                       ? kPlainAlignment
+                                       : kAlignment);
+      entry.offset = position;
+      position += entry.size;
+    }
+
+    const ChunkHeader header{chunk.first,
+                             static_cast<std::uint32_t>(chunk.size),
+                             static_cast<std::uint32_t>(columns_)};
+    writeBytes(&header, sizeof(header));
+    writeBytes(entries.data(), entries.size() * sizeof(ColumnEntry));
+    offset_ += sizeof(header) + entries.size() * sizeof(ColumnEntry);
+    for (size_t column = 0; column < columns_; ++column) {
+      pad(entries[column].offset);
+      writeBytes(blocks_[column].data(), blocks_[column].size());
+      offset_ += blocks_[column].size();
+    }
+    pad(alignUp(offset_, kAlignment));
+    index_.push_back({chunk_offset, chunk.first, chunk.size});
+  }
+
+  Encoding encode(std::span<const double> values, double tolerance,
+                  std::vector<unsigned char> &block) {
+    const auto n = values.size();
+    if (options_.level == 0) {
+      block.resize(n * sizeof(double));
+      std::memcpy(block.data(), values.data(), block.size());
+      return Encoding::Plain;
+    }
+
+    words_.resize(n);
+    auto encoding = Encoding::Bits;
+    const auto step = 2 * tolerance;
+    if (tolerance > 0 && quantizable(values, step)) {
+      encoding = Encoding::Quantized;
+      for (size_t i = 0; i < n; ++i) {
+        words_[i] = static_cast<std::uint64_t>(std::llround(values[i] / step));
+      }
+    } else {
+      for (size_t i = 0; i < n; ++i) {
+        words_[i] = std::bit_cast<std::uint64_t>(values[i]);
+      }
+    }
+    predict(words_);
+
+    bytes_.resize(n * sizeof(std::uint64_t));
+    shuffle(words_, bytes_.data());
+    block.resize(deflateBound(&stream_, static_cast<uLong>(bytes_.size())));
+    deflateReset(&stream_);
+    stream_.next_in = bytes_.data();
+    stream_.avail_in = static_cast<uInt>(bytes_.size());
+    stream_.next_out = block.data();
+    stream_.avail_out = static_cast<uInt>(block.size());
+    if (deflate(&stream_, Z_FINISH) != Z_STREAM_END) {
+      throw TrajectoryFileError("Cannot compress a trajectory chunk");
+    }
+    block.resize(stream_.total_out);
+    return encoding;
+  }
+
+  void writeIndex() {
+    const Footer footer{offset_, index_.size(), samples_, kIndexMagic};
+    writeBytes(index_.data(), index_.size() * sizeof(IndexEntry));
+    writeBytes(&footer, sizeof(footer));
+  }
+
+  void pad(size_t offset) {
+    static constexpr std::array<std::byte, kPlainAlignment> kZeros{};
+    writeBytes(kZeros.data(), offset - offset_);
+    offset_ = offset;
+  }
+
+  void writeBytes(const void *data, size_t size) {
+    if (size != 0 && std::fwrite(data, 1, size, file_) != size) {
+      throw TrajectoryFileError(systemMessage("Cannot write", path_));
+    }
+  }
+
+  std::filesystem::path path_;
+  size_t columns_;
+  Options options_;
+  std::FILE *file_ = nullptr;
+  Chunk current_;
+  size_t samples_ = 0;
+  bool closed_ = false;
+  // The first error seen by append or close, thrown again by every later call.
+  std::exception_ptr failed_;
+
+  // Shared with the writer thread.
+  std::mutex mutex_;
+  std::condition_variable work_;
+  std::condition_variable freed_;
+  std::deque<Chunk> queue_;
+  std::vector<std::vector<double>> free_;
+  size_t allocated_ = 0;
+  bool stopping_ = false;
+  std::exception_ptr error_;
+  std::thread thread_;
+
+  // Only used by the writer thread, and by close once it has stopped.
+  size_t offset_ = 0;
+  std::vector<IndexEntry> index_;
+  std::vector<std::vector<unsigned char>> blocks_;
+  std::vector<std::uint64_t> words_;
+  std::vector<unsigned char> bytes_;
+  z_stream stream_{};
+};
+
+TrajectoryFileWriter::TrajectoryFileWriter(const std::filesystem::path &path,
+                                           size_t dimension, size_t particles,
+                                           Options options)
+    : impl_(std::make_unique<Impl>(path, dimension, particles, options)) {}
+
+TrajectoryFileWriter::~TrajectoryFileWriter() = default;
+
+void TrajectoryFileWriter::append(double time,
+                                  std::span<const double> positions) {
+  impl_->append(time, positions);
+}
+
+void TrajectoryFileWriter::close() { impl_->close(); }
+
+size_t TrajectoryFileWriter::samples() const { return impl_->samples(); }
+
+class TrajectoryFileReader::Impl {
+public:
+  Impl(const std::filesystem::path &path, size_t cache_size)
+      : path_(path), cache_size_(cache_size) {
+    try {
+      // Plots and animations jump between the chunks of many columns.
+      mapping_ = std::make_unique<detail::FileMapping>(
+          path, detail::FileMapping::Access::Random);
+    } catch (const std::system_error &error) {
+      throw TrajectoryFileError(error.what());
+    }
+    bytes_ = mapping_->bytes();
+    if (bytes_.size() < kHeaderSize + sizeof(Footer)) {
+      throw invalid("the file is too short");
+    }
+    copy(0, &header_, sizeof(header_));
+    if (header_.magic != kMagic) {
+      throw invalid("wrong magic number");
+    }
+    if (header_.byte_order != kByteOrderMark) {
+      throw invalid("written on a machine of another byte order");
+    }
+    if (header_.version == 0 || header_.version > kTrajectoryFileVersion) {
+      throw invalid("unsupported version " + std::to_string(header_.version));
+    }
+    if (header_.dimension == 0) {
+      throw invalid("zero dimension");
+    }
+    columns_ = 1 + header_.dimension * header_.particles;
+
+    const auto size = bytes_.size();
+    Footer footer{};
+    copy(size - sizeof(footer), &footer, sizeof(footer));
+    if (footer.magic != kIndexMagic) {
+      throw invalid("no index, the file was not closed");
+    }
+    if (footer.index_offset > size - sizeof(footer) ||
+        footer.chunks != (size - sizeof(footer) - footer.index_offset) /
+                             sizeof(IndexEntry)) {
+      throw invalid("damaged index");
+    }
+    index_.resize(footer.chunks);
+    copy(footer.index_offset, index_.data(),
+         index_.size() * sizeof(IndexEntry));
+    samples_ = footer.samples;
+    size_t expected = 0;
+    for (const auto &entry : index_) {
+      if (entry.first_sample != expected ||
+          entry.offset >= footer.index_offset) {
+        throw invalid("damaged index");
+      }
+      expected += entry.samples;
+    }
+    if (expected != samples_) {
+      throw invalid("damaged index");
+    }
+    // Last, as the destructor does not run if the constructor throws.
+    if (inflateInit(&stream_) != Z_OK) {
+      throw TrajectoryFileError("Cannot initialize zlib");
+    }
+  }
+
+  ~Impl() { inflateEnd(&stream_); }
+
+  Impl(const Impl &) = delete;
+  Impl &operator=(const Impl &) = delete;
+
+  [[nodiscard]] const FileHeader &header() const { return header_; }
+  [[nodiscard]] size_t samples() const { return samples_; }
+  [[nodiscard]] const std::vector<IndexEntry> &index() const { return index_; }
+
+  void readColumn(size_t chunk, size_t column, std::span<double> out) const {
+    if (out.size() != index_.at(chunk).samples) {
+      throw TrajectoryFileError("Wrong size of the output of a column");
+    }
+    const auto entry = locate(chunk, column);
+    std::lock_guard lock(mutex_);
+    decode(entry, out);
+  }
+
+  ChunkValues chunkValues(size_t chunk, size_t column) const {
+    const auto n = static_cast<size_t>(index_.at(chunk).samples);
+    const auto entry = locate(chunk, column);
+    if (entry.encoding == Encoding::Plain &&
+        entry.offset % alignof(double) == 0) {
+      // The mapping is aligned, so the values can be used in place.
+      const auto data = bytes_.data() + entry.offset;
+      return {{reinterpret_cast<const double *>(data), n}, nullptr};
+    }
+
+    const auto key = chunk * columns_ + column;
+    std::lock_guard lock(mutex_);
+    if (const auto it = cached_.find(key); it != cached_.end()) {
+      recent_.splice(recent_.begin(), recent_, it->second);
+      return {*it->second->values, it->second->values};
+    }
+    auto values = std::make_shared<std::vector<double>>(n);
+    decode(entry, *values);
+    recent_.push_front({key, values});
+    cached_.emplace(key, recent_.begin());
+    cached_bytes_ += n * sizeof(double);
+    // The least recently used columns go first. Even the new one may go, but
+    // it is kept alive by the owner it is returned with.
+    while (cached_bytes_ > cache_size_ && !recent_.empty()) {
+      cached_bytes_ -= recent_.back().values->size() * sizeof(double);
+      cached_.erase(recent_.back().key);
+      recent_.pop_back();
+    }
+    return {*values, std::move(values)};
+  }
+
+private:
+  struct CachedColumn {
+    size_t key;
+    std::shared_ptr<const std::vector<double>> values;
+  };
+
+  [[nodiscard]] TrajectoryFileError invalid(const std::string &what) const {
+    return TrajectoryFileError(path_.string() +
+                               " is not a valid trajectory file: " + what);
+  }
+
+  void copy(size_t offset, void *data, size_t size) const {
+    if (offset > bytes_.size() || size > bytes_.size() - offset) {
+      throw invalid("truncated");
+    }
+    std::memcpy(data, bytes_.data() + offset, size);
+  }
+
+  // The entry of a column of a chunk, checked against the file.
+  [[nodiscard]] ColumnEntry locate(size_t chunk, size_t column) const {
+    const auto &chunk_entry = index_.at(chunk);
+    if (column >= columns_) {
+      throw TrajectoryFileError("No such trajectory column");
+    }
+    ChunkHeader header{};
+    copy(chunk_entry.offset, &header, sizeof(header));
+    if (header.first_sample != chunk_entry.first_sample ||
+        header.samples != chunk_entry.samples || header.columns != columns_) {
+      throw invalid("damaged chunk");
+    }
+    ColumnEntry entry{};
+    copy(chunk_entry.offset + sizeof(header) + column * sizeof(entry), &entry,
+         sizeof(entry));
+    const auto size = bytes_.size();
+    if (entry.offset > size || entry.size > size - entry.offset ||
+        (entry.encoding == Encoding::Plain &&
+         entry.size != header.samples * sizeof(double))) {
+      throw invalid("damaged chunk");
+    }
+    return entry;
+  }
+
+  // Called with the mutex held, for the stream and the scratch buffers.
+  void decode(const ColumnEntry &entry, std::span<double> out) const {
+    const auto block = bytes_.data() + entry.offset;
+    const auto n = out.size();
+    if (entry.encoding == Encoding::Plain) {
+      std::memcpy(out.data(), block, entry.size);
+      return;
+    }
+    const auto bytes = n * sizeof(std::uint64_t);
+    scratch_.resize(bytes);
+    inflateReset(&stream_);
+    // zlib does not write through next_in.
+    stream_.next_in =
+        reinterpret_cast<Bytef *>(const_cast<std::byte *>(block));
+    stream_.avail_in = static_cast<uInt>(entry.size);
+    stream_.next_out = scratch_.data();
+    stream_.avail_out = static_cast<uInt>(scratch_.size());
+    if (inflate(&stream_, Z_FINISH) != Z_STREAM_END ||
+        stream_.total_out != bytes) {
+      throw invalid("damaged column");
+    }
+    words_.resize(n);
+    unshuffle(scratch_.data(), words_);
+    unpredict(words_);
+
+    if (entry.encoding == Encoding::Bits) {
+      for (size_t i = 0; i < n; ++i) {
+        out[i] = std::bit_cast<double>(words_[i]);
+      }
+    } else if (entry.encoding == Encoding::Quantized) {
+      const auto step = 2 * header_.tolerance;
+      for (size_t i = 0; i < n; ++i) {
+        out[i] = static_cast<double>(static_cast<std::int64_t>(words_[i])) *
+                 step;
+      }
+    } else {
+      throw invalid("unknown column encoding");
+    }
+  }
+
+  std::filesystem::path path_;
+  std::unique_ptr<detail::FileMapping> mapping_;
+  std::span<const std::byte> bytes_;
+  FileHeader header_{};
+  size_t columns_ = 0;
+  size_t samples_ = 0;
+  std::vector<IndexEntry> index_;
+
+  // Guards the decoding state and the cache.
+  mutable std::mutex mutex_;
+  mutable z_stream stream_{};
+  mutable std::vector<unsigned char> scratch_;
+  mutable std::vector<std::uint64_t> words_;
+  size_t cache_size_;
+  mutable size_t cached_bytes_ = 0;
+  mutable std::list<CachedColumn> recent_;
+  mutable std::unordered_map<size_t, std::list<CachedColumn>::iterator>
+      cached_;
+};
+
+TrajectoryFileReader::TrajectoryFileReader(const std::filesystem::path &path,
+                                           size_t cache_size)
+    : impl_(std::make_unique<Impl>(path, cache_size)) {}
+
+TrajectoryFileReader::~TrajectoryFileReader() = default;
+TrajectoryFileReader::TrajectoryFileReader(TrajectoryFileReader &&) noexcept =
+    default;
+TrajectoryFileReader &
+TrajectoryFileReader::operator=(TrajectoryFileReader &&) noexcept = default;
+
+std::uint32_t TrajectoryFileReader::version() const {
+  return impl_->header().version;
+}
+
+size_t TrajectoryFileReader::dimension() const {
+  return impl_->header().dimension;
+}
+
+size_t TrajectoryFileReader::particles() const {
+  return impl_->header().particles;
+}
+
+double TrajectoryFileReader::tolerance() const {
+  return impl_->header().tolerance;
+}
+
+size_t TrajectoryFileReader::samples() const { return impl_->samples(); }
+
+size_t TrajectoryFileReader::chunks() const { return impl_->index().size(); }
+
+size_t TrajectoryFileReader::chunkBegin(size_t chunk) const {
+  return impl_->index().at(chunk).first_sample;
+}
+
+size_t TrajectoryFileReader::chunkSize(size_t chunk) const {
+  return impl_->index().at(chunk).samples;
+}
+
+size_t TrajectoryFileReader::chunkOf(size_t sample) const {
+  if (sample >= samples()) {
+    throw std::out_of_range("No such sample");
+  }
+  const auto &index = impl_->index();
+  const auto it = std::ranges::upper_bound(index, sample, {},
+                                           &IndexEntry::first_sample);
+  return static_cast<size_t>(it - index.begin()) - 1;
+}
+
+size_t TrajectoryFileReader::column(size_t particle, size_t axis) const {
+  if (particle >= particles() || axis >= dimension()) {
+    throw std::out_of_range("No such particle or axis");
+  }
+  return 1 + particle * dimension() + axis;
+}
+
+void TrajectoryFileReader::readColumn(size_t chunk, size_t column,
+                                      std::span<double> out) const {
+  impl_->readColumn(chunk, column, out);
+}
+
+std::vector<double> TrajectoryFileReader::readColumn(size_t chunk,
+                                                     size_t column) const {
+  std::vector<double> result(chunkSize(chunk));
+  readColumn(chunk, column, result);
+  return result;
+}
+
+TrajectoryFileReader::ChunkValues
+TrajectoryFileReader::chunkValues(size_t chunk, size_t column) const {
+  return impl_->chunkValues(chunk, column);
+}
+
+} // namespace phosphorus
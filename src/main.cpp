@@ -4,11 +4,34 @@
 
 // This is just a placeholder to help IDE analysis
 
+#include "phosphorus/BarnesHutIntegrator.h"
+#include "phosphorus/BatchIntegrator.h"
+#include "phosphorus/Checkpoint.h"
 #include "phosphorus/Coordinate.h"
+#include "phosphorus/DataColumn.h"
+#include "phosphorus/Ensemble.h"
+#include "phosphorus/FFT.h"
+#include "phosphorus/FMMIntegrator.h"
 #include "phosphorus/Field.h"
+#include "phosphorus/FieldSet.h"
 #include "phosphorus/Gnuplot.h"
+#include "phosphorus/GravityKernel.h"
+#include "phosphorus/HermiteIntegrator.h"
+#include "phosphorus/MultiSpeciesIntegrator.h"
+#include "phosphorus/Multipole.h"
+#include "phosphorus/NeighborList.h"
+#include "phosphorus/PairForceIntegrator.h"
+#include "phosphorus/PairPotential.h"
+#include "phosphorus/Parallel.h"
 #include "phosphorus/Particle.h"
+#include "phosphorus/ParticleMeshIntegrator.h"
+#include "phosphorus/ParticleStorage.h"
 #include "phosphorus/SignalSlot.h"
+#include "phosphorus/SpatialTree.h"
+#include "phosphorus/SymplecticScheme.h"
+#include "phosphorus/TabulatedField.h"
+#include "phosphorus/TrajectoryFile.h"
+#include "phosphorus/TrajectoryRecorder.h"
 #include "phosphorus/TypeTraits.h"
 #include "phosphorus/Vector.h"
 #include "phosphorus/VerletIntegrator.h"
@@ -0,0 +1,116 @@
+//
+// Created by Renatus Madrigal on 7/02/2025.
+//
+
+#include "phosphorus/BatchIntegrator.h"
+#include "phosphorus/Field.h"
+#include "phosphorus/Particle.h"
+#include "phosphorus/SymplecticScheme.h"
+#include "phosphorus/VerletIntegrator.h"
+#include <gtest/gtest.h>
+#include <array>
+#include <stdexcept>
+
+using namespace phosphorus;
+
+static constexpr auto eps = 1e-12;
+
+namespace {
+
+auto springField(double k) {
+  return LambdaField([k](Cartesian3D position, CommonParticle particle) {
+    return Cartesian3D::Vector{-position[0] * k * particle.mass(), 0, 0};
+  });
+}
+
+using SpringField = decltype(springField(1.0));
+
+constexpr size_t kLanes = 4;
+
+std::array<SpringField, kLanes> springFields() {
+  return {springField(1.0), springField(2.0), springField(3.0),
+          springField(4.0)};
+}
+
+} // namespace
+
+TEST(BatchIntegratorTest, Layout) {
+  auto batch = BatchFieldVerletIntegrator(springField(1.0));
+  static_assert(decltype(batch)::lanes() == 8);
+  EXPECT_EQ(batch.pushParticle(CommonParticle{1.0, 0}, Cartesian3D{1, 0, 0},
+                               Cartesian3D::Vector{0, 0, 0}),
+            0);
+  EXPECT_EQ(batch.pushParticle(CommonParticle{2.0, 0}, Cartesian3D{0, 2, 0},
+                               Cartesian3D::Vector{0, 0, 0}),
+            1);
+  EXPECT_EQ(batch.count(), 2);
+  EXPECT_EQ(batch.storage().size(), 16);
+
+  batch.setPosition(1, 3, Cartesian3D{0, 5, 0});
+  EXPECT_EQ(batch.positions(1, 1)[3], 5);
+  EXPECT_EQ(batch.positions(1, 1)[2], 2);
+  EXPECT_EQ(batch.positions(0, 0)[7], 1);
+  EXPECT_EQ(batch.particle(1, 5).mass(), 2.0);
+
+  EXPECT_THROW((void)batch.position(2, 0), std::out_of_range);
+  EXPECT_THROW((void)batch.position(0, 8), std::out_of_range);
+}
+
+TEST(BatchIntegratorTest, MatchesFieldVerletIntegrator) {
+  BatchFieldVerletIntegrator<SpringField, Cartesian3D, CommonParticle, kLanes>
+      batch(springFields());
+  batch.pushParticle(CommonParticle{1.0, 0}, Cartesian3D{1, 0, 0},
+                     Cartesian3D::Vector{0, 0.5, 0});
+  batch.setVelocity(0, 2, Cartesian3D::Vector{1, 0.5, 0});
+
+  std::array<double, kLanes> dt{0.1, 0.01, 0.05, 0.001};
+  for (int i = 0; i < 100; ++i) {
+    batch.step(dt);
+  }
+
+  for (size_t lane = 0; lane < kLanes; ++lane) {
+    auto system = FieldVerletIntegrator(batch.field(lane));
+    auto it = system.pushParticle(CommonParticle{1.0, 0}, Cartesian3D{1, 0, 0},
+                                  lane == 2 ? Cartesian3D::Vector{1, 0.5, 0}
+                                            : Cartesian3D::Vector{0, 0.5, 0});
+    for (int i = 0; i < 100; ++i) {
+      system.step(dt[lane]);
+    }
+    for (size_t axis = 0; axis < 3; ++axis) {
+      EXPECT_NEAR(batch.position(0, lane)[axis], it->position[axis], eps);
+      EXPECT_NEAR(batch.velocity(0, lane)[axis], it->velocity[axis], eps);
+    }
+    EXPECT_NEAR(batch.time(lane), 100 * dt[lane], eps);
+  }
+  EXPECT_EQ(batch.forceEvaluations(), 101);
+
+  // Reading a field keeps the cached accelerations, modifying one does not.
+  batch.step(0.0);
+  EXPECT_EQ(batch.forceEvaluations(), 102);
+  batch.modifyField(1, [](SpringField &) {});
+  batch.step(0.0);
+  EXPECT_EQ(batch.forceEvaluations(), 104);
+}
+
+TEST(BatchIntegratorTest, ComposedScheme) {
+  BatchFieldVerletIntegrator<SpringField, Cartesian3D, CommonParticle, kLanes,
+                             Yoshida4>
+      batch(springFields());
+  batch.pushParticle(CommonParticle{1.0, 0}, Cartesian3D{1, 0, 0},
+                     Cartesian3D::Vector{0, 0, 0});
+  for (int i = 0; i < 50; ++i) {
+    batch.step(0.02);
+  }
+
+  for (size_t lane = 0; lane < kLanes; ++lane) {
+    FieldVerletIntegrator<SpringField, Cartesian3D, CommonParticle, Yoshida4>
+        system(batch.field(lane));
+    auto it = system.pushParticle(CommonParticle{1.0, 0}, Cartesian3D{1, 0, 0},
+                                  Cartesian3D::Vector{0, 0, 0});
+    for (int i = 0; i < 50; ++i) {
+      system.step(0.02);
+    }
+    EXPECT_NEAR(batch.position(0, lane)[0], it->position[0], eps);
+    EXPECT_NEAR(batch.velocity(0, lane)[0], it->velocity[0], eps);
+  }
+}
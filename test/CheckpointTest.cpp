@@ -0,0 +1,228 @@
+//
+// Created by Renatus Madrigal on 6/27/2025.
+//
+
+#include "TestHelper.h"
+#include "phosphorus/Checkpoint.h"
+#include "phosphorus/HermiteIntegrator.h"
+#include "phosphorus/Particle.h"
+#include "phosphorus/VerletIntegrator.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace phosphorus;
+
+namespace {
+
+template <typename System> auto stateOf(const System &system) {
+  std::vector<double> result;
+  for (auto &&elem : system) {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      result.push_back(elem.position[axis]);
+      result.push_back(elem.velocity[axis]);
+      result.push_back(elem.acceleration[axis]);
+    }
+    result.push_back(elem.particle.mass());
+  }
+  return result;
+}
+
+} // namespace
+
+TEST(CheckpointTest, RestartContinuesExactly) {
+  using System = GravityIntegrator<Cartesian3D, CommonParticle>;
+  TemporaryFile file("restart.ckpt");
+  System original;
+  pushRandomBodies(original, 100, 3);
+  for (auto i = 0; i < 5; ++i) {
+    original.step(10.0);
+  }
+  original.saveCheckpoint(file.path());
+  for (auto i = 0; i < 5; ++i) {
+    original.step(10.0);
+  }
+
+  System restored;
+  restored.loadCheckpoint(file.path());
+  EXPECT_EQ(restored.count(), 100);
+  EXPECT_EQ(restored.time(), 50.0);
+  EXPECT_EQ(restored.forceEvaluations(), 6);
+  for (auto i = 0; i < 5; ++i) {
+    restored.step(10.0);
+  }
+  // The accelerations are restored, so no evaluation is repeated.
+  EXPECT_EQ(restored.forceEvaluations(), original.forceEvaluations());
+  EXPECT_EQ(stateOf(restored), stateOf(original));
+}
+
+TEST(CheckpointTest, HandlesSurviveRestart) {
+  using System = GravityIntegrator<Cartesian3D, CommonParticle>;
+  TemporaryFile file("handles.ckpt");
+  System original;
+  pushRandomBodies(original, 10, 3);
+  std::vector<System::Handle> handles;
+  for (auto it = original.begin(); it != original.end(); ++it) {
+    handles.push_back(it.handle());
+  }
+  original.removeParticle(handles[2]);
+  original.removeParticle(handles[7]);
+  original.step(1.0);
+  original.saveCheckpoint(file.path());
+
+  System restored;
+  pushRandomBodies(restored, 3, 3);
+  restored.loadCheckpoint(file.path());
+  EXPECT_EQ(restored.count(), 8);
+  for (size_t i = 0; i < handles.size(); ++i) {
+    EXPECT_EQ(restored.contains(handles[i]), original.contains(handles[i]));
+    if (original.contains(handles[i])) {
+      EXPECT_EQ(restored.indexOf(handles[i]), original.indexOf(handles[i]));
+    }
+  }
+  // The freed slots are reused in the same order.
+  auto next = [](System &system) {
+    return system.pushParticle(CommonParticle{1, 0}).handle();
+  };
+  EXPECT_EQ(next(restored), next(original));
+}
+
+TEST(CheckpointTest, HermiteRestartContinuesExactly) {
+  using System = HermiteGravityIntegrator<Cartesian3D, CommonParticle>;
+  TemporaryFile file("hermite.ckpt");
+  System original;
+  pushRandomBodies(original, 30, 3);
+  original.advanceTo(1e4);
+  original.saveCheckpoint(file.path());
+  const auto dt = original.timeStep();
+  const auto steps = original.advanceTo(2e4);
+
+  System restored;
+  restored.loadCheckpoint(file.path());
+  EXPECT_EQ(restored.timeStep(), dt);
+  EXPECT_EQ(restored.advanceTo(2e4), steps);
+  EXPECT_EQ(stateOf(restored), stateOf(original));
+}
+
+TEST(CheckpointTest, HermiteRejectsShortJerk) {
+  using System = HermiteGravityIntegrator<Cartesian3D, CommonParticle>;
+  TemporaryFile file("jerk.ckpt");
+  System original;
+  pushRandomBodies(original, 30, 3);
+  original.advanceTo(1e4);
+  original.saveCheckpoint(file.path());
+
+  // Drop the last value of the first jerk section. Its padded length, and so
+  // the place of every later section, stays the same.
+  {
+    std::fstream io(file.path(), std::ios::in | std::ios::out |
+                                     std::ios::binary);
+    const std::string bytes{std::istreambuf_iterator<char>(io), {}};
+    const std::uint64_t size = 29 * sizeof(double);
+    io.seekp(static_cast<std::streamoff>(bytes.find("jerk0") +
+                                         CheckpointWriter::kTagSize));
+    io.write(reinterpret_cast<const char *>(&size), sizeof(size));
+  }
+
+  System restored;
+  pushRandomBodies(restored, 3, 3);
+  restored.advanceTo(1e3);
+  const auto before = stateOf(restored);
+  const auto time = restored.time();
+  const auto dt = restored.timeStep();
+  EXPECT_THROW(restored.loadCheckpoint(file.path()), CheckpointError);
+  EXPECT_EQ(stateOf(restored), before);
+  EXPECT_EQ(restored.time(), time);
+  EXPECT_EQ(restored.timeStep(), dt);
+}
+
+TEST(CheckpointTest, RejectsMismatchAndDamage) {
+  TemporaryFile file("damage.ckpt");
+  GravityIntegrator<Cartesian3D, CommonParticle> system;
+  pushRandomBodies(system, 20, 3);
+  system.step(1.0);
+  system.saveCheckpoint(file.path());
+
+  // Another dimension or scheme.
+  GravityIntegrator<Cartesian2D, CommonParticle> planar;
+  EXPECT_THROW(planar.loadCheckpoint(file.path()), CheckpointError);
+  GravityIntegrator<Cartesian3D, CommonParticle, Yoshida4> yoshida;
+  EXPECT_THROW(yoshida.loadCheckpoint(file.path()), CheckpointError);
+
+  const auto size = std::filesystem::file_size(file.path());
+  std::filesystem::resize_file(file.path(), size - 100);
+  GravityIntegrator<Cartesian3D, CommonParticle> truncated;
+  EXPECT_THROW(truncated.loadCheckpoint(file.path()), CheckpointError);
+
+  {
+    std::ofstream out(file.path(), std::ios::binary);
+    out << "not a checkpoint, but long enough to hold a whole header........";
+  }
+  EXPECT_THROW(CheckpointReader reader(file.path()), CheckpointError);
+  EXPECT_THROW(CheckpointReader reader(file.path().string() + ".missing"),
+               CheckpointError);
+}
+
+TEST(CheckpointTest, RejectsDamagedFreeSlots) {
+  using System = GravityIntegrator<Cartesian3D, CommonParticle>;
+  TemporaryFile file("freeslot.ckpt");
+  System original;
+  pushRandomBodies(original, 10, 3);
+  original.removeParticle(original.begin().handle());
+  original.removeParticle(original.begin().handle());
+  original.saveCheckpoint(file.path());
+
+  // The data of a section starts 64 bytes after its tag.
+  auto overwrite = [&](std::uint32_t first, std::uint32_t second) {
+    std::fstream io(file.path(), std::ios::in | std::ios::out |
+                                     std::ios::binary);
+    const std::string bytes{std::istreambuf_iterator<char>(io), {}};
+    const std::uint32_t slots[] = {first, second};
+    io.seekp(static_cast<std::streamoff>(bytes.find("freeslot") + 64));
+    io.write(reinterpret_cast<const char *>(slots), sizeof(slots));
+  };
+
+  System restored;
+  pushRandomBodies(restored, 3, 3);
+  const auto before = stateOf(restored);
+  // Out of range, held by a particle, and listed twice.
+  for (auto [first, second] : {std::pair<std::uint32_t, std::uint32_t>{0, 10},
+                               {0, 5},
+                               {0, 0}}) {
+    overwrite(first, second);
+    EXPECT_THROW(restored.loadCheckpoint(file.path()), CheckpointError);
+    EXPECT_EQ(stateOf(restored), before);
+  }
+  overwrite(0, 9);
+  restored.loadCheckpoint(file.path());
+  EXPECT_EQ(stateOf(restored), stateOf(original));
+}
+
+TEST(CheckpointTest, UncommittedWriteKeepsOldFile) {
+  TemporaryFile file("atomic.ckpt");
+  {
+    CheckpointWriter writer(file.path());
+    writer.writeValue("answer", 42);
+    writer.commit();
+  }
+  {
+    CheckpointWriter writer(file.path());
+    writer.writeValue("answer", 7);
+    EXPECT_THROW(writer.writeValue("answer", 8), CheckpointError);
+    EXPECT_THROW(writer.writeValue("much too long", 8), CheckpointError);
+    // Destroyed without commit, as if the program had been interrupted.
+  }
+  CheckpointReader reader(file.path());
+  EXPECT_EQ(reader.version(), kCheckpointVersion);
+  EXPECT_EQ(reader.value<int>("answer"), 42);
+  EXPECT_FALSE(reader.contains("other"));
+  EXPECT_THROW((void)reader.section("other"), CheckpointError);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(reader.section("answer").data()) %
+                CheckpointWriter::kAlignment,
+            0);
+}
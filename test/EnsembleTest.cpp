@@ -0,0 +1,121 @@
+//
+// Created by Renatus Madrigal on 7/01/2025.
+//
+
+#include "phosphorus/Ensemble.h"
+#include "phosphorus/Field.h"
+#include "phosphorus/Particle.h"
+#include "phosphorus/VerletIntegrator.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <numbers>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace phosphorus;
+
+namespace {
+
+// One period of a unit mass on a spring, compared with the exact solution.
+EnsembleMetrics spring(const Parameters &parameters) {
+  const auto k = parameters["k"];
+  const auto step = parameters["step"];
+  auto system = FieldVerletIntegrator(
+      LambdaField([k](Cartesian3D position, CommonParticle particle) {
+        return Cartesian3D::Vector{-position[0] * k * particle.mass(), 0, 0};
+      }));
+  auto it = system.pushParticle(CommonParticle{1.0, 0}, Cartesian3D{0, 0, 0},
+                                Cartesian3D::Vector{1, 0, 0});
+
+  const auto omega = std::sqrt(k);
+  const auto n = static_cast<size_t>(2 * std::numbers::pi / (omega * step));
+  EnsembleMetrics metrics;
+  for (size_t i = 0; i <= n; ++i) {
+    const auto x = it->position[0];
+    const auto v = it->velocity[0];
+    const auto expected = std::sin(omega * step * static_cast<double>(i));
+    metrics.observe(x - expected / omega, 0.5 * v * v + 0.5 * k * x * x);
+    system.step(step);
+  }
+  return metrics;
+}
+
+ParameterGrid springGrid() {
+  ParameterGrid grid;
+  grid.add("k", {1.0, 4.0}).add("step", {0.1, 0.01, 0.001});
+  return grid;
+}
+
+} // namespace
+
+TEST(EnsembleTest, ParameterGrid) {
+  const auto grid = springGrid();
+  EXPECT_EQ(grid.axes(), 2);
+  EXPECT_EQ(grid.size(), 6);
+  EXPECT_EQ(grid.at(4)["k"], 4.0);
+  EXPECT_EQ(grid.at(4)["step"], 0.01);
+  EXPECT_EQ(grid.at(2).value(0), 1.0);
+  EXPECT_EQ(grid.at(2).value(1), 0.001);
+  EXPECT_EQ(ParameterGrid().size(), 1);
+
+  auto other = springGrid();
+  EXPECT_THROW(other.add("k", {2.0}), std::invalid_argument);
+  EXPECT_THROW(other.add("mass", {}), std::invalid_argument);
+  EXPECT_THROW((void)grid.at(6), std::out_of_range);
+  EXPECT_THROW((void)grid.at(0)["mass"], std::out_of_range);
+}
+
+TEST(EnsembleTest, StepSweep) {
+  const auto table = EnsembleRunner(springGrid()).run(spring);
+  ASSERT_EQ(table.rows(), 6);
+  EXPECT_EQ(table.names(),
+            (std::vector<std::string>{"k", "step", "max_error",
+                                      "energy_drift", "seconds"}));
+
+  const auto k = table.column("k");
+  const auto step = table.column("step");
+  const auto error = table.column("max_error");
+  const auto drift = table.column("energy_drift");
+  for (size_t row = 0; row < table.rows(); ++row) {
+    EXPECT_EQ(k[row], row < 3 ? 1.0 : 4.0);
+    EXPECT_GT(drift[row], 0);
+    EXPECT_LT(drift[row], 0.02);
+    EXPECT_GE(table.column("seconds")[row], 0);
+    // Verlet is of second order.
+    if (row % 3 != 0) {
+      EXPECT_NEAR(std::log10(error[row - 1] / error[row]), 2, 0.3)
+          << "k = " << k[row] << ", step = " << step[row];
+    }
+  }
+
+  // Each member writes its own row, whatever the threads.
+  const auto serial =
+      EnsembleRunner(springGrid(), ParallelConfig::serialConfig())
+          .run(spring);
+  for (size_t row = 0; row < table.rows(); ++row) {
+    EXPECT_EQ(serial.column("max_error")[row], error[row]);
+    EXPECT_EQ(serial.column("energy_drift")[row], drift[row]);
+  }
+
+  std::ostringstream out;
+  table.write(out);
+  EXPECT_TRUE(out.str().starts_with(
+      "# k step max_error energy_drift seconds\n1 0.10000000000000001 "));
+}
+
+TEST(EnsembleTest, RethrowsTheFirstFailure) {
+  const EnsembleRunner runner(springGrid());
+  const auto failing = [](const Parameters &parameters) -> EnsembleMetrics {
+    if (parameters.member() >= 3) {
+      throw std::runtime_error(std::to_string(parameters.member()));
+    }
+    return {};
+  };
+  EXPECT_THROW(runner.run(failing), std::runtime_error);
+  try {
+    runner.run(failing);
+  } catch (const std::runtime_error &error) {
+    EXPECT_STREQ(error.what(), "3");
+  }
+}
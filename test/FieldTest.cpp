@@ -2,10 +2,22 @@
 // Created by Renatus Madrigal on 5/23/2025.
 //
 
+#include "TestHelper.h"
 #include "phosphorus/Field.h"
+#include "phosphorus/FieldSet.h"
+#include "phosphorus/ParticleStorage.h"
+#include "phosphorus/TabulatedField.h"
 #include "phosphorus/Vector.h"
+#include "phosphorus/VerletIntegrator.h"
 #include <gtest/gtest.h>
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <functional>
 #include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
 
 using namespace phosphorus;
 
@@ -54,6 +66,87 @@ TEST(FieldTest, LambdaField) {
   EXPECT_EQ(force2, expected_force2);
 }
 
+namespace {
+
+Cartesian3D::Vector pointForce(const Cartesian3D &point,
+                               const CommonParticle &particle) {
+  return point.toCartesian() * particle.mass();
+}
+
+} // namespace
+
+TEST(FieldTest, LambdaFieldStoresCallable) {
+  auto lambda = [](const Cartesian3D &point, const CommonParticle &particle) {
+    return point.toCartesian() * particle.mass();
+  };
+  auto counter = 0;
+  auto counting = [counter](Cartesian3D point,
+                            CommonParticle particle) mutable {
+    ++counter;
+    return point.toCartesian() * (particle.mass() * counter);
+  };
+
+  static_assert(std::same_as<decltype(LambdaField(lambda))::Function,
+                             decltype(lambda)>);
+  static_assert(std::same_as<decltype(LambdaField(counting))::Function,
+                             decltype(counting)>);
+  using Signature = Cartesian3D::Vector(const Cartesian3D &,
+                                        const CommonParticle &);
+  static_assert(std::same_as<decltype(LambdaField(pointForce)),
+                             LambdaField<Cartesian3D, CommonParticle,
+                                         Signature *>>);
+  // Naming only the coordinate and particle types erases the callable.
+  static_assert(
+      std::same_as<LambdaField<Cartesian3D, CommonParticle>::Function,
+                   std::function<Signature>>);
+  static_assert(sizeof(LambdaField(lambda)) < sizeof(std::function<void()>));
+
+  CommonParticle particle{2.0, 0};
+  Cartesian3D position{1.0, 2.0, 3.0};
+  auto expected = position.toCartesian() * particle.mass();
+  EXPECT_EQ(LambdaField(lambda).evaluate(position, particle), expected);
+  EXPECT_EQ(LambdaField(pointForce).evaluate(position, particle), expected);
+  using ErasedField = LambdaField<Cartesian3D, CommonParticle>;
+  EXPECT_EQ(ErasedField(lambda).evaluate(position, particle), expected);
+
+  auto field = LambdaField(counting);
+  EXPECT_EQ(field.evaluate(position, particle), expected);
+  EXPECT_EQ(field.evaluate(position, particle), expected * 2.0);
+
+  auto system = FieldVerletIntegrator(LambdaField(lambda));
+  using Field = decltype(LambdaField(lambda));
+  static_assert(
+      std::same_as<decltype(system),
+                   FieldVerletIntegrator<Field, Cartesian3D, CommonParticle>>);
+}
+
+TEST(FieldTest, FunctionTraits) {
+  auto lambda = [](const Cartesian3D &, CommonParticle) { return 1.0; };
+  auto mutable_lambda = [](int, const double &) mutable { return 'a'; };
+  using Lambda = function_traits<decltype(lambda)>;
+  static_assert(std::same_as<Lambda::first_argument_type, Cartesian3D>);
+  static_assert(std::same_as<Lambda::second_argument_type, CommonParticle>);
+  static_assert(std::same_as<Lambda::result_type, double>);
+  static_assert(Lambda::arity == 2);
+  using Mutable = function_traits<decltype(mutable_lambda)>;
+  static_assert(std::same_as<Mutable::argument_type<1>, double>);
+  static_assert(std::same_as<Mutable::result_type, char>);
+  static_assert(std::same_as<
+                function_traits<const decltype(lambda) &>::argument_types,
+                Lambda::argument_types>);
+
+  using Pointer = function_traits<decltype(&pointForce)>;
+  static_assert(std::same_as<Pointer::first_argument_type, Cartesian3D>);
+  static_assert(std::same_as<Pointer::result_type, Cartesian3D::Vector>);
+  static_assert(std::same_as<function_traits<decltype(pointForce)>::result_type,
+                             Pointer::result_type>);
+  static_assert(function_traits<int (&)() noexcept>::arity == 0);
+  static_assert(std::same_as<
+                function_traits<int (std::vector<int>::*)(size_t) const &&>::
+                    first_argument_type,
+                size_t>);
+}
+
 TEST(FieldTest, FieldOperations) {
   auto force_function1 = [](const Cartesian3D &point,
                             const CommonParticle &particle) {
@@ -125,3 +218,266 @@ TEST(FieldTest, FieldOperationWithModification) {
   EXPECT_EQ(modified_force2, expected_force2);
   EXPECT_NE(modified_force, modified_force2);
 }
+
+namespace {
+
+// Evaluate a field on a few particles one by one and as a batch.
+template <typename Field, typename Coord>
+void expectBatchMatches(const Field &field, const std::vector<Coord> &points) {
+  constexpr auto kDimension = Coord::dimension();
+  ParticleStorage<Coord, CommonParticle> storage;
+  for (size_t i = 0; i < points.size(); ++i) {
+    storage.push(CommonParticle{1.0 + i, 0}, points[i], {}, {});
+  }
+  field.evaluateBatch(std::as_const(storage).positionComponents(),
+                      storage.particles(), storage.accelerationComponents());
+  for (size_t i = 0; i < points.size(); ++i) {
+    auto expected = field.evaluate(points[i], storage.particle(i));
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      EXPECT_NEAR(storage.acceleration(i)[axis], expected[axis],
+                  1e-12 * std::abs(expected[axis]))
+          << "Where i == " << i << ", axis == " << axis;
+    }
+  }
+}
+
+} // namespace
+
+TEST(FieldTest, BatchEvaluation) {
+  std::vector<Cartesian3D> points3 = {
+      {1, 2, 3}, {-4, 0.5, 2}, {0, 0, 7}, {1e3, -2e3, 5}};
+  CartesianGravityField gravity(Cartesian3D{0.5, 0, -1}, 2e12);
+  expectBatchMatches(gravity, points3);
+
+  auto spring = LambdaField([](const Cartesian3D &point,
+                               const CommonParticle &particle) {
+    return point.toCartesian() * (-particle.mass());
+  });
+  expectBatchMatches(spring, points3);
+  expectBatchMatches(gravity + spring, points3);
+  // The composite fields keep references, so the negated operand must outlive
+  // the sum.
+  auto negative = -spring;
+  expectBatchMatches(negative, points3);
+  expectBatchMatches(gravity + negative, points3);
+
+  std::vector<Cartesian2D> points2 = {{1, 2}, {-4, 0.5}, {0, 7}};
+  Cartesian2DGravityField gravity2(Cartesian2D{1, 1}, 3e11);
+  static_assert(
+      std::same_as<Cartesian2DGravityField::CoordinateVec, Cartesian2D>);
+  expectBatchMatches(gravity2, points2);
+}
+
+namespace {
+
+auto makeSpring(double k) {
+  return LambdaField([k](const Cartesian3D &point,
+                         const CommonParticle &particle) {
+    return point.toCartesian() * (-k * particle.mass());
+  });
+}
+
+using Spring = decltype(makeSpring(1.0));
+using Set = FieldSet<Cartesian3D, CartesianGravityField, Spring>;
+
+} // namespace
+
+TEST(FieldTest, FieldSetComponents) {
+  Set set;
+  EXPECT_TRUE(set.empty());
+  auto sun = set.add(CartesianGravityField(Cartesian3D{0, 0, 0}, 2e12));
+  auto weak = set.add(makeSpring(1.0));
+  auto strong = set.add(makeSpring(3.0));
+  auto planet = set.add(CartesianGravityField(Cartesian3D{5, 0, 0}, 1e11));
+  EXPECT_EQ(set.size(), 4);
+  EXPECT_EQ(set.size<Spring>(), 2);
+  EXPECT_EQ(set.components<CartesianGravityField>().size(), 2);
+
+  CommonParticle particle{2.0, 0};
+  Cartesian3D position{1, 2, 3};
+  auto expected = set.get<CartesianGravityField>(sun).evaluate(position,
+                                                               particle) +
+                  set.get<CartesianGravityField>(planet).evaluate(position,
+                                                                  particle) +
+                  position.toCartesian() * (-4 * particle.mass());
+  EXPECT_VEC_NEAR(set.evaluate(position, particle), expected,
+                  1e-12 * expected.norm());
+
+  set.remove(weak);
+  EXPECT_FALSE(set.contains(weak));
+  EXPECT_TRUE(set.contains(strong));
+  EXPECT_THROW(set.remove(weak), std::out_of_range);
+  EXPECT_THROW((void)set.get<Spring>(sun), std::out_of_range);
+  EXPECT_EQ(set.size<Spring>(), 1);
+  set.remove(sun);
+  EXPECT_EQ(set.evaluate(position, particle),
+            set.get<CartesianGravityField>(planet).evaluate(position,
+                                                            particle) +
+                position.toCartesian() * (-3 * particle.mass()));
+
+  set.clear();
+  EXPECT_TRUE(set.empty());
+  EXPECT_EQ(set.evaluate(position, particle), Cartesian3D::Vector{});
+}
+
+TEST(FieldTest, FieldSetBatchSpansTiles) {
+  Set set;
+  set.add(CartesianGravityField(Cartesian3D{0.5, 0, -1}, 2e12));
+  set.add(makeSpring(1.0));
+  set.add(makeSpring(0.25));
+  std::vector<Cartesian3D> points;
+  for (size_t i = 0; i < Set::kTileSize * 2 + 17; ++i) {
+    points.push_back({std::cos(0.1 * i) * i, std::sin(0.1 * i) * i, 1.0 + i});
+  }
+  expectBatchMatches(set, points);
+}
+
+TEST(FieldTest, FieldSetInIntegrator) {
+  // A particle in a spring field whose stiffness is raised half way.
+  auto system = FieldVerletIntegrator<Set, Cartesian3D, CommonParticle>();
+  auto first =
+      system.modifyField([](Set &set) { return set.add(makeSpring(1.0)); });
+  system.pushParticle(CommonParticle{1.0, 0}, Cartesian3D{1, 0, 0},
+                      Cartesian3D::Vector{});
+  constexpr auto dt = 1e-3;
+  for (auto i = 0; i < 1000; ++i) {
+    system.step(dt);
+  }
+  auto x = system[0].position[0];
+  auto v = system[0].velocity[0];
+  EXPECT_NEAR(x, std::cos(1.0), 1e-6);
+
+  // Reading the field keeps the cached accelerations.
+  const auto evaluations = system.forceEvaluations();
+  (void)system.field();
+  system.step(0.0);
+  EXPECT_EQ(system.forceEvaluations(), evaluations + 1);
+
+  // Swapping the unit spring for one of stiffness 4 doubles omega.
+  system.modifyField([&](Set &set) {
+    set.remove(first);
+    set.add(makeSpring(4.0));
+  });
+  for (auto i = 0; i < 1000; ++i) {
+    system.step(dt);
+  }
+  auto expected = x * std::cos(2.0) + v / 2 * std::sin(2.0);
+  EXPECT_NEAR(system[0].position[0], expected, 1e-6);
+}
+
+namespace {
+
+// The field of a few point masses, as an expensive field would be.
+auto makeCluster() {
+  return LambdaField([](const Cartesian3D &point,
+                        const CommonParticle &particle) {
+    const std::array<Cartesian3D, 3> centers = {
+        Cartesian3D{-3, 0, 0}, Cartesian3D{0, 4, 1}, Cartesian3D{1, -2, 5}};
+    Cartesian3D::Vector result{};
+    for (const auto &center : centers) {
+      auto d = center.toCartesian() - point.toCartesian();
+      auto r = d.norm();
+      for (size_t axis = 0; axis < 3; ++axis) {
+        result[axis] += particle.mass() * d[axis] / (r * r * r);
+      }
+    }
+    return result;
+  });
+}
+
+} // namespace
+
+TEST(FieldTest, TabulatedFieldAccuracy) {
+  auto cluster = makeCluster();
+  using Tabulated = TabulatedField<decltype(cluster), CommonParticle>;
+  // A box away from the masses, with two particle masses.
+  const Cartesian3D::Vector lower{10, 10, 10}, upper{20, 20, 20};
+  for (auto tolerance : {1e-3, 1e-4}) {
+    Tabulated table(cluster, lower, upper, CommonParticle{1.0, 0},
+                    {.tiles_per_axis = 4, .max_level = 4,
+                     .tolerance = tolerance});
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<> coordinate(10, 20);
+    for (auto i = 0; i < 500; ++i) {
+      Cartesian3D point{coordinate(gen), coordinate(gen), coordinate(gen)};
+      CommonParticle particle{i % 2 ? 3.0 : 0.5, 0};
+      auto expected = cluster.evaluate(point, particle);
+      auto actual = table.evaluate(point, particle);
+      EXPECT_LT((actual - expected).norm(), 2 * tolerance * expected.norm())
+          << "Where tolerance == " << tolerance << ", i == " << i;
+    }
+  }
+}
+
+TEST(FieldTest, TabulatedFieldIsLazy) {
+  auto cluster = makeCluster();
+  using Tabulated = TabulatedField<decltype(cluster), CommonParticle>;
+  Tabulated table(cluster, {10, 10, 10}, {20, 20, 20}, CommonParticle{1.0, 0},
+                  {.tiles_per_axis = 5, .max_level = 0, .tolerance = 1e-2});
+  EXPECT_EQ(table.populatedTiles(), 0);
+
+  CommonParticle particle{1.0, 0};
+  (void)table.evaluate(Cartesian3D{10.5, 10.5, 10.5}, particle);
+  (void)table.evaluate(Cartesian3D{11, 11.5, 10.1}, particle);
+  EXPECT_EQ(table.populatedTiles(), 1);
+  EXPECT_EQ(table.tabulatedNodes(), 5 * 5 * 5);
+  (void)table.evaluate(Cartesian3D{19.5, 10.5, 10.5}, particle);
+  EXPECT_EQ(table.populatedTiles(), 2);
+
+  // Outside the box, the field itself answers.
+  Cartesian3D outside{0, 0, 0};
+  EXPECT_EQ(table.evaluate(outside, particle),
+            cluster.evaluate(outside, particle));
+  EXPECT_EQ(table.populatedTiles(), 2);
+
+  // Copies share the table.
+  auto copy = table;
+  copy.populate();
+  EXPECT_EQ(table.populatedTiles(), 125);
+}
+
+TEST(FieldTest, TabulatedFieldRefinesWhereNeeded) {
+  // The mass at (1, 1, 1) is just outside the corner of the box, so the tiles
+  // near it need more cells than the ones far from it.
+  CartesianGravityField gravity(Cartesian3D{1, 1, 1}, 1e12);
+  using Tabulated = TabulatedField<CartesianGravityField, CommonParticle>;
+  Tabulated table(gravity, {1.5, 1.5, 1.5}, {9.5, 9.5, 9.5},
+                  CommonParticle{1.0, 0},
+                  {.tiles_per_axis = 4, .max_level = 4, .tolerance = 1e-3});
+  CommonParticle particle{2.0, 0};
+  (void)table.evaluate(Cartesian3D{9, 9, 9}, particle);
+  const auto far = table.tabulatedNodes();
+  (void)table.evaluate(Cartesian3D{2, 2, 2}, particle);
+  const auto near = table.tabulatedNodes() - far;
+  EXPECT_GT(near, far * 8);
+
+  std::vector<Cartesian3D> points = {{2, 2, 2}, {2.1, 3, 2.5}, {9, 9, 9}};
+  for (const auto &point : points) {
+    auto expected = gravity.evaluate(point, particle);
+    EXPECT_LT((table.evaluate(point, particle) - expected).norm(),
+              2e-3 * expected.norm());
+  }
+  expectBatchMatches(table, points);
+}
+
+TEST(FieldTest, TabulatedFieldPassesUntabulatedTiles) {
+  // The mass sits on a grid node of the upper tile, where the field is 0 / 0.
+  CartesianGravityField gravity(Cartesian3D{0.5, 0.5, 0.5}, 1e12);
+  using Tabulated = TabulatedField<CartesianGravityField, CommonParticle>;
+  Tabulated singular(gravity, {-1, -1, -1}, {1, 1, 1}, CommonParticle{1.0, 0},
+                     {.tiles_per_axis = 2});
+  CommonParticle particle{2.0, 0};
+  Cartesian3D near{0.6, 0.55, 0.5};
+  EXPECT_EQ(singular.evaluate(near, particle),
+            gravity.evaluate(near, particle));
+  EXPECT_EQ(singular.populatedTiles(), 1);
+  EXPECT_EQ(singular.directTiles(), 1);
+  EXPECT_EQ(singular.tabulatedNodes(), 0);
+
+  // No grid fits a tolerance this tight, so the field itself answers.
+  Tabulated tight(gravity, {-1, -1, -1}, {1, 1, 1}, CommonParticle{1.0, 0},
+                  {.tiles_per_axis = 2, .max_level = 1, .tolerance = 1e-12});
+  Cartesian3D far{-0.9, -0.7, -0.8};
+  EXPECT_EQ(tight.evaluate(far, particle), gravity.evaluate(far, particle));
+  EXPECT_EQ(tight.directTiles(), 1);
+}
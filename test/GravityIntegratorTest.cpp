@@ -0,0 +1,445 @@
+//
+// Created by Renatus Madrigal on 6/15/2025.
+//
+
+#include "TestHelper.h"
+#include "phosphorus/BarnesHutIntegrator.h"
+#include "phosphorus/FMMIntegrator.h"
+#include "phosphorus/HermiteIntegrator.h"
+#include "phosphorus/Particle.h"
+#include "phosphorus/ParticleMeshIntegrator.h"
+#include "phosphorus/VerletIntegrator.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <vector>
+
+using namespace phosphorus;
+
+namespace {
+
+template <typename System> auto positionsOf(const System &system) {
+  std::vector<typename System::CoordinateVec> result;
+  for (auto &&elem : system) {
+    result.push_back(elem.position);
+  }
+  return result;
+}
+
+} // namespace
+
+TEST(GravityIntegratorTest, ParallelIsBitIdentical) {
+  using System = GravityIntegrator<Cartesian3D, CommonParticle>;
+  using Schedule = ParallelConfig::Schedule;
+
+  auto run = [](const ParallelConfig &config, System::Kernel kernel) {
+    System system(config, kernel);
+    pushRandomBodies(system, 300);
+    for (auto i = 0; i < 5; ++i) {
+      system.step(10.0);
+    }
+    return positionsOf(system);
+  };
+
+  auto serial = run(ParallelConfig{}, System::Kernel::Direct);
+  EXPECT_EQ(run({.num_threads = 4, .schedule = Schedule::Static},
+                System::Kernel::Direct),
+            serial);
+  EXPECT_EQ(run({.num_threads = 3,
+                 .schedule = Schedule::Dynamic,
+                 .chunk_size = 7},
+                System::Kernel::Direct),
+            serial);
+  // Deterministic runs ignore the symmetric kernel.
+  EXPECT_EQ(run({.num_threads = 0, .deterministic = true},
+                System::Kernel::Symmetric),
+            serial);
+  EXPECT_EQ(run({.deterministic = true}, System::Kernel::Symmetric), serial);
+}
+
+TEST(GravityIntegratorTest, SymmetricKernelMatchesDirect) {
+  using System = GravityIntegrator<Cartesian3D, CommonParticle>;
+  using Schedule = ParallelConfig::Schedule;
+
+  auto accelerations = [](const ParallelConfig &config, System::Kernel kernel) {
+    System system(config, kernel);
+    pushRandomBodies(system, 257);
+    system.step(0.0);
+    std::vector<double> result;
+    for (auto &&elem : system) {
+      for (size_t axis = 0; axis < 3; ++axis) {
+        result.push_back(elem.acceleration[axis]);
+      }
+    }
+    return result;
+  };
+
+  auto direct = accelerations({}, System::Kernel::Direct);
+  auto scale = 0.0;
+  for (auto value : direct) {
+    scale = std::max(scale, std::abs(value));
+  }
+  auto tolerance = scale * 1e-12;
+
+  EXPECT_VEC_NEAR(accelerations({}, System::Kernel::Symmetric), direct,
+                  tolerance);
+  EXPECT_VEC_NEAR(accelerations({.num_threads = 4}, System::Kernel::Symmetric),
+                  direct, tolerance);
+  EXPECT_VEC_NEAR(accelerations({.num_threads = 3,
+                                 .schedule = Schedule::Dynamic,
+                                 .chunk_size = 5},
+                                System::Kernel::Symmetric),
+                  direct, tolerance);
+}
+
+namespace {
+
+template <typename System> auto accelerationsOf(System &system) {
+  // A zero step leaves the positions unchanged and fills the accelerations.
+  system.step(0.0);
+  std::vector<double> result;
+  for (auto &&elem : system) {
+    for (size_t axis = 0; axis < System::kDimension; ++axis) {
+      result.push_back(elem.acceleration[axis]);
+    }
+  }
+  return result;
+}
+
+double relativeRmsError(const std::vector<double> &actual,
+                        const std::vector<double> &expected) {
+  double error = 0, norm = 0;
+  for (size_t i = 0; i < actual.size(); ++i) {
+    error += (actual[i] - expected[i]) * (actual[i] - expected[i]);
+    norm += expected[i] * expected[i];
+  }
+  return std::sqrt(error / norm);
+}
+
+} // namespace
+
+TEST(GravityIntegratorTest, BarnesHutZeroAngleIsDirectSum) {
+  using Direct = GravityIntegrator<Cartesian2D, CommonParticle>;
+  Direct direct(ParallelConfig{}, Direct::Kernel::Direct);
+  BarnesHutGravityIntegrator<Cartesian2D, CommonParticle> tree(0.0);
+  pushRandomBodies(direct, 500);
+  pushRandomBodies(tree, 500);
+  EXPECT_LT(relativeRmsError(accelerationsOf(tree), accelerationsOf(direct)),
+            1e-12);
+}
+
+TEST(GravityIntegratorTest, BarnesHutAccuracy) {
+  GravityIntegrator<Cartesian3D, CommonParticle> direct;
+  pushRandomBodies(direct, 2000);
+  auto expected = accelerationsOf(direct);
+
+  auto error = [&](double theta) {
+    BarnesHutGravityIntegrator<Cartesian3D, CommonParticle> tree(theta);
+    pushRandomBodies(tree, 2000);
+    return relativeRmsError(accelerationsOf(tree), expected);
+  };
+  auto coarse = error(0.8);
+  auto fine = error(0.3);
+  EXPECT_LT(coarse, 2e-2);
+  EXPECT_LT(fine, 2e-3);
+  EXPECT_LT(fine, coarse);
+}
+
+TEST(GravityIntegratorTest, BarnesHutParallelBuild) {
+  using System = BarnesHutGravityIntegrator<Cartesian3D, CommonParticle>;
+  System serial(0.5);
+  System parallel(0.5, {.num_threads = 4});
+  pushRandomBodies(serial, 3000);
+  pushRandomBodies(parallel, 3000);
+  EXPECT_EQ(accelerationsOf(parallel), accelerationsOf(serial));
+
+  // The tree covers every particle once and conserves the total mass.
+  const auto &tree = parallel.tree();
+  const auto &root = tree.node(0);
+  EXPECT_EQ(root.subtree_size, tree.nodes().size());
+  EXPECT_EQ(root.count(), 3000);
+  double total_mass = 0;
+  for (auto &&elem : parallel) {
+    total_mass += elem.particle.mass();
+  }
+  EXPECT_NEAR(root.mass, total_mass, total_mass * 1e-12);
+  size_t leaf_particles = 0;
+  for (const auto &node : tree.nodes()) {
+    if (node.isLeaf()) {
+      leaf_particles += node.count();
+    }
+  }
+  EXPECT_EQ(leaf_particles, 3000);
+}
+
+TEST(GravityIntegratorTest, FMMConvergesWithOrder) {
+  GravityIntegrator<Cartesian3D, CommonParticle> direct;
+  pushRandomBodies(direct, 2000);
+  auto expected = accelerationsOf(direct);
+
+  auto error = [&](size_t order) {
+    FMMGravityIntegrator<Cartesian3D, CommonParticle> fmm(order);
+    pushRandomBodies(fmm, 2000);
+    return relativeRmsError(accelerationsOf(fmm), expected);
+  };
+  auto low = error(2);
+  auto medium = error(4);
+  auto high = error(8);
+  EXPECT_LT(medium, low);
+  EXPECT_LT(high, medium);
+  EXPECT_LT(medium, 1e-3);
+  EXPECT_LT(high, 1e-5);
+}
+
+TEST(GravityIntegratorTest, FMMInTwoDimensions) {
+  GravityIntegrator<Cartesian2D, CommonParticle> direct;
+  FMMGravityIntegrator<Cartesian2D, CommonParticle> fmm(6);
+  pushRandomBodies(direct, 2000);
+  pushRandomBodies(fmm, 2000);
+  EXPECT_LT(relativeRmsError(accelerationsOf(fmm), accelerationsOf(direct)),
+            1e-4);
+}
+
+TEST(GravityIntegratorTest, FMMParallelIsBitIdentical) {
+  using System = FMMGravityIntegrator<Cartesian3D, CommonParticle>;
+  System serial(5);
+  System parallel(5, System::kDefaultOpeningAngle, {.num_threads = 4});
+  pushRandomBodies(serial, 3000);
+  pushRandomBodies(parallel, 3000);
+  EXPECT_EQ(accelerationsOf(parallel), accelerationsOf(serial));
+}
+
+namespace {
+
+// Fill a ball with a cubic lattice. Unlike a random cloud, the forces are
+// dominated by the mean field rather than by close pairs.
+template <typename System>
+void pushLatticeBall(System &system, double radius, double spacing) {
+  const auto side = static_cast<int>(radius / spacing);
+  for (int x = -side; x <= side; ++x) {
+    for (int y = -side; y <= side; ++y) {
+      for (int z = -side; z <= side; ++z) {
+        Cartesian3D pos{x * spacing, y * spacing, z * spacing};
+        if (pos.toVector().norm() <= radius) {
+          system.pushParticle(CommonParticle(1e10, 0), pos,
+                              Cartesian3D::Vector{});
+        }
+      }
+    }
+  }
+}
+
+} // namespace
+
+TEST(GravityIntegratorTest, ParticleMeshIsolatedMatchesDirect) {
+  GravityIntegrator<Cartesian3D, CommonParticle> direct;
+  ParticleMeshGravityIntegrator<Cartesian3D, CommonParticle> mesh(64);
+  pushLatticeBall(direct, 1e3, 1e2);
+  pushLatticeBall(mesh, 1e3, 1e2);
+  EXPECT_LT(relativeRmsError(accelerationsOf(mesh), accelerationsOf(direct)),
+            5e-2);
+}
+
+TEST(GravityIntegratorTest, ParticleMeshConservesMomentum) {
+  ParticleMeshGravityIntegrator<Cartesian3D, CommonParticle> mesh(32);
+  pushRandomBodies(mesh, 1000);
+  mesh.step(0.0);
+  Cartesian3D::Vector force{};
+  double scale = 0;
+  for (auto &&elem : mesh) {
+    force = force + elem.acceleration * elem.particle.mass();
+    scale += elem.acceleration.norm() * elem.particle.mass();
+  }
+  EXPECT_LT(force.norm(), scale * 1e-12);
+}
+
+TEST(GravityIntegratorTest, ParticleMeshPeriodicPlaneWave) {
+  // A lattice displaced by psi = A sin(kx) along x. In linear theory the
+  // acceleration is 4 pi G rho psi.
+  constexpr size_t kSide = 32;
+  constexpr double kBox = 1e3, kMass = 1e10, kAmplitude = 1e-2 * kBox / kSide;
+  const double k = 2 * std::numbers::pi / kBox;
+  ParticleMeshGravityIntegrator<Cartesian3D, CommonParticle> mesh(kSide);
+  mesh.setPeriodicBox({0, 0, 0}, kBox);
+  const double spacing = kBox / kSide;
+  for (size_t x = 0; x < kSide; ++x) {
+    for (size_t y = 0; y < kSide; ++y) {
+      for (size_t z = 0; z < kSide; ++z) {
+        // Particles on the cell corners, so their clouds straddle cells.
+        double q = x * spacing;
+        mesh.pushParticle(CommonParticle(kMass, 0),
+                          {q + kAmplitude * std::sin(k * q), y * spacing,
+                           z * spacing},
+                          Cartesian3D::Vector{});
+      }
+    }
+  }
+  mesh.step(0.0);
+
+  const double density = kMass * kSide * kSide * kSide / (kBox * kBox * kBox);
+  const double peak = 4 * std::numbers::pi * Constants::G * density *
+                      kAmplitude;
+  for (auto &&elem : mesh) {
+    double q = elem.position[0] - kAmplitude * std::sin(k * elem.position[0]);
+    EXPECT_NEAR(elem.acceleration[0], peak * std::sin(k * q), peak * 5e-2);
+    EXPECT_NEAR(elem.acceleration[1], 0, peak * 1e-9);
+  }
+}
+
+TEST(GravityIntegratorTest, ParticleMeshParallelIsBitIdentical) {
+  using System = ParticleMeshGravityIntegrator<Cartesian3D, CommonParticle>;
+  System serial(32);
+  System parallel(32, {.num_threads = 4});
+  pushRandomBodies(serial, 3000);
+  pushRandomBodies(parallel, 3000);
+  EXPECT_EQ(accelerationsOf(parallel), accelerationsOf(serial));
+
+  serial.setPeriodicBox({-1e3, -1e3, -1e3}, 2e3);
+  parallel.setPeriodicBox({-1e3, -1e3, -1e3}, 2e3);
+  EXPECT_EQ(accelerationsOf(parallel), accelerationsOf(serial));
+}
+
+namespace {
+
+// A tight binary in the middle of a ring of light bodies. The units make
+// G times the mass of a binary member 1.
+template <typename System> void pushBinaryAndRing(System &system) {
+  using Vector = typename System::Vector;
+  const auto unit = 1 / System::kGravityConstant;
+  const auto separation = 0.01;
+  const auto speed = std::sqrt(2 / separation) / 2;
+  system.pushParticle(CommonParticle{unit, 0},
+                      Cartesian3D{separation / 2, 0, 0}, Vector{0, speed, 0});
+  system.pushParticle(CommonParticle{unit, 0},
+                      Cartesian3D{-separation / 2, 0, 0}, Vector{0, -speed, 0});
+  for (auto i = 0; i < 30; ++i) {
+    auto radius = 1 + 0.1 * i;
+    auto angle = 0.7 * i;
+    auto circular = std::sqrt(2 / radius);
+    system.pushParticle(
+        CommonParticle{unit * 1e-3, 0},
+        Cartesian3D{radius * std::cos(angle), radius * std::sin(angle), 0},
+        Vector{-circular * std::sin(angle), circular * std::cos(angle), 0});
+  }
+}
+
+} // namespace
+
+TEST(GravityIntegratorTest, BlockStepsMatchFineGlobalStep) {
+  using System = GravityIntegrator<Cartesian3D, CommonParticle>;
+  constexpr auto kDuration = 0.2;
+  constexpr size_t kFineSteps = size_t{1} << 15;
+
+  System reference, blocks;
+  pushBinaryAndRing(reference);
+  pushBinaryAndRing(blocks);
+  for (size_t i = 0; i < kFineSteps; ++i) {
+    reference.step(kDuration / kFineSteps);
+  }
+
+  size_t evaluations = 0;
+  size_t full_evaluations = 0;
+  for (auto i = 0; i < 2; ++i) {
+    auto stats = blocks.blockStep(kDuration / 2, 0.01);
+    evaluations += stats.evaluations;
+    full_evaluations += stats.evaluations / blocks.count();
+    EXPECT_GT(stats.deepest, 10);
+  }
+  EXPECT_DOUBLE_EQ(blocks.time(), kDuration);
+  EXPECT_EQ(blocks.forceEvaluations(), full_evaluations);
+
+  // Only the binary runs on the fine levels.
+  auto levels = blocks.blockLevels();
+  for (size_t i = 2; i < levels.size(); ++i) {
+    EXPECT_LT(levels[i] + 5, levels[0]) << "Where i == " << i;
+  }
+  EXPECT_LT(evaluations * 10, kFineSteps * blocks.count());
+
+  for (size_t i = 0; i < blocks.count(); ++i) {
+    EXPECT_LT(distance(blocks[i].position, reference[i].position), 1e-4)
+        << "Where i == " << i;
+  }
+  EXPECT_NEAR(distance(blocks[0].position, blocks[1].position), 0.01, 1e-5);
+}
+
+namespace {
+
+// An equal-mass binary of eccentricity e and unit semi-major axis, with G
+// times the total mass 1 and so a period of 2 pi. It starts at the
+// apocenter, on the x axis.
+template <typename System> void pushBinary(System &system, double e) {
+  using Vector = typename System::Vector;
+  const auto half = 0.5 / System::kGravityConstant;
+  const auto speed = std::sqrt((1 - e) / (1 + e)) / 2;
+  system.pushParticle(CommonParticle{half, 0}, Cartesian3D{(1 + e) / 2, 0, 0},
+                      Vector{0, speed, 0});
+  system.pushParticle(CommonParticle{half, 0}, Cartesian3D{-(1 + e) / 2, 0, 0},
+                      Vector{0, -speed, 0});
+}
+
+// The distance from the starting point after a period with fixed steps.
+template <typename System> double binaryError(double e, size_t steps) {
+  System system;
+  pushBinary(system, e);
+  for (size_t i = 0; i < steps; ++i) {
+    system.step(2 * std::numbers::pi / static_cast<double>(steps));
+  }
+  return distance(system[0].position, Cartesian3D{(1 + e) / 2, 0, 0});
+}
+
+} // namespace
+
+TEST(GravityIntegratorTest, HermiteIsFourthOrder) {
+  using Hermite = HermiteGravityIntegrator<Cartesian3D, CommonParticle>;
+  using Verlet = GravityIntegrator<Cartesian3D, CommonParticle>;
+  auto coarse = binaryError<Hermite>(0.5, 400);
+  auto fine = binaryError<Hermite>(0.5, 800);
+  EXPECT_GT(coarse / fine, 12);
+  // One evaluation per step like Verlet, but far more accurate.
+  EXPECT_LT(fine * 1000, binaryError<Verlet>(0.5, 800));
+}
+
+TEST(GravityIntegratorTest, HermiteAarsethSteps) {
+  HermiteGravityIntegrator<Cartesian3D, CommonParticle> system;
+  pushBinary(system, 0.9);
+  auto steps = system.advanceTo(2 * std::numbers::pi, 0.01);
+  EXPECT_EQ(system.time(), 2 * std::numbers::pi);
+  EXPECT_EQ(system.forceEvaluations(), steps + 1);
+  auto error = distance(system[0].position, Cartesian3D{0.95, 0, 0});
+  EXPECT_LT(error, 1e-4);
+
+  // A fixed step with the same number of evaluations does not resolve the
+  // pericenter.
+  using System = HermiteGravityIntegrator<Cartesian3D, CommonParticle>;
+  EXPECT_GT(binaryError<System>(0.9, steps), 100 * error);
+}
+
+TEST(GravityIntegratorTest, HermiteJerkMatchesFiniteDifference) {
+  HermiteGravityIntegrator<Cartesian3D, CommonParticle> system;
+  pushRandomBodies(system, 20);
+  auto derivatives = [&](bool jerk) {
+    std::vector<double> result;
+    for (size_t i = 0; i < system.count(); ++i) {
+      auto value = jerk ? system.jerk(i) : system[i].acceleration;
+      for (size_t axis = 0; axis < 3; ++axis) {
+        result.push_back(value[axis]);
+      }
+    }
+    return result;
+  };
+
+  // The central difference of the accelerations around the middle step.
+  constexpr auto dt = 1e-2;
+  system.step(dt);
+  auto before = derivatives(false);
+  system.step(dt);
+  auto jerk = derivatives(true);
+  system.step(dt);
+  auto after = derivatives(false);
+  std::vector<double> difference(before.size());
+  for (size_t k = 0; k < before.size(); ++k) {
+    difference[k] = (after[k] - before[k]) / (2 * dt);
+  }
+  EXPECT_LT(relativeRmsError(difference, jerk), 1e-6);
+}
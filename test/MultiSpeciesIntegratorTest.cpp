@@ -0,0 +1,161 @@
+//
+// Created by Renatus Madrigal on 6/24/2025.
+//
+
+#include "phosphorus/MultiSpeciesIntegrator.h"
+#include "TestHelper.h"
+#include "phosphorus/Particle.h"
+#include "phosphorus/VerletIntegrator.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+
+using namespace phosphorus;
+
+namespace {
+
+// A particle with a mass only.
+struct Star {
+  double mass_;
+  [[nodiscard]] double mass() const { return mass_; }
+};
+
+using Tracer = CommonParticle;
+using System = MultiSpeciesIntegrator<GravityCoulombInteraction, Cartesian3D,
+                                      Star, Tracer>;
+
+void pushCloud(System &system, size_t stars, size_t tracers) {
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<> position(-10, 10);
+  std::uniform_real_distribution<> charge(-1e-3, 1e-3);
+  auto random_position = [&] {
+    return Cartesian3D{position(gen), position(gen), position(gen)};
+  };
+  for (size_t i = 0; i < stars; ++i) {
+    system.pushParticle(Star{1e10 * (1 + i)}, random_position());
+  }
+  for (size_t i = 0; i < tracers; ++i) {
+    system.pushParticle(Tracer{1.0 + i, charge(gen)}, random_position());
+  }
+}
+
+} // namespace
+
+TEST(MultiSpeciesIntegratorTest, PairsAreDispatchedAtCompileTime) {
+  static_assert(System::interacts<Star, Tracer>());
+  static_assert(System::kSpeciesIndex<Tracer> == 1);
+  static_assert(sizeof(Star) == sizeof(double));
+
+  System system;
+  pushCloud(system, 3, 4);
+  EXPECT_EQ(system.count<Star>(), 3);
+  EXPECT_EQ(system.count<Tracer>(), 4);
+  EXPECT_EQ(system.count(), 7);
+}
+
+TEST(MultiSpeciesIntegratorTest, MatchesSingleSpeciesGravity) {
+  // Without charges, a mixed system is a plain gravitating system.
+  System mixed;
+  GravityIntegrator<Cartesian3D, CommonParticle> single;
+  for (auto i = 0; i < 3; ++i) {
+    auto position = Cartesian3D{3.0 * i, 1.0 * i * i, 0};
+    mixed.pushParticle(Star{2e10}, position);
+    single.pushParticle(CommonParticle{2e10, 0}, position);
+  }
+  for (auto i = 0; i < 2; ++i) {
+    auto position = Cartesian3D{-4.0, 2.0 * i, 1};
+    mixed.pushParticle(Tracer{1e9, 0}, position);
+    single.pushParticle(CommonParticle{1e9, 0}, position);
+  }
+  for (auto i = 0; i < 100; ++i) {
+    mixed.step(0.5);
+    single.step(0.5);
+  }
+  const auto &stars = mixed.storage<Star>();
+  const auto &tracers = mixed.storage<Tracer>();
+  for (size_t i = 0; i < 5; ++i) {
+    auto position = i < 3 ? stars.position(i) : tracers.position(i - 3);
+    // The forces are divided by the mass rather than summed as G m / r^2, so
+    // only the rounding differs.
+    EXPECT_VEC_NEAR(position, single[i].position, 1e-7) << "Where i == " << i;
+  }
+}
+
+TEST(MultiSpeciesIntegratorTest, CoulombOnlyBetweenChargedSpecies) {
+  // Two tracers of opposite charge and no mass to speak of attract; a star
+  // of the same tiny mass between them does not feel the charges.
+  GravityCoulombInteraction interaction;
+  interaction.gravity = 0;
+  System system(interaction);
+  system.pushParticle(Tracer{1, 1e-5}, Cartesian3D{-1, 0, 0});
+  system.pushParticle(Tracer{1, -1e-5}, Cartesian3D{1, 0, 0});
+  system.pushParticle(Star{1}, Cartesian3D{0, 1, 0});
+  system.step(0.0);
+  const auto &tracers = system.storage<Tracer>();
+  EXPECT_NEAR(tracers.acceleration(0)[0], Constants::K * 1e-10 / 4, 1e-12);
+  EXPECT_NEAR(tracers.acceleration(1)[0], -Constants::K * 1e-10 / 4, 1e-12);
+  EXPECT_EQ(system.storage<Star>().acceleration(0), (Vector{0, 0, 0}));
+}
+
+namespace {
+
+// Tracers feel the stars, but the stars do not feel the tracers.
+struct OneWayGravity {
+  double forceOverDistance(const Tracer &tracer, const Star &star,
+                           double r2) const {
+    return -Constants::G * tracer.mass() * star.mass() / (r2 * std::sqrt(r2));
+  }
+  double forceOverDistance(const Star &a, const Star &b, double r2) const {
+    return -Constants::G * a.mass() * b.mass() / (r2 * std::sqrt(r2));
+  }
+};
+
+} // namespace
+
+TEST(MultiSpeciesIntegratorTest, PairsWithoutInteractionAreSkipped) {
+  using OneWay =
+      MultiSpeciesIntegrator<OneWayGravity, Cartesian3D, Star, Tracer>;
+  static_assert(OneWay::interacts<Tracer, Star>());
+  static_assert(!OneWay::interacts<Star, Tracer>());
+  static_assert(!OneWay::interacts<Tracer, Tracer>());
+
+  OneWay system;
+  system.pushParticle(Star{1e10}, Cartesian3D{0, 0, 0});
+  system.pushParticle(Tracer{1e20, 0}, Cartesian3D{10, 0, 0});
+  system.pushParticle(Tracer{1e20, 0}, Cartesian3D{20, 0, 0});
+  for (auto i = 0; i < 10; ++i) {
+    system.step(1.0);
+  }
+  EXPECT_EQ(system.storage<Star>().position(0), (Cartesian3D{0, 0, 0}));
+  EXPECT_LT(system.storage<Tracer>().position(0)[0], 10);
+  EXPECT_NEAR(system.time(), 10, 1e-12);
+}
+
+TEST(MultiSpeciesIntegratorTest, SettersInvalidateAccelerations) {
+  MultiSpeciesIntegrator<OneWayGravity, Cartesian3D, Star, Tracer> system;
+  system.pushParticle(Star{1e10}, Cartesian3D{0, 0, 0});
+  system.pushParticle(Tracer{1e20, 0}, Cartesian3D{10, 0, 0});
+  system.step(0.0);
+  const auto near = system.storage<Tracer>().acceleration(0)[0];
+
+  // Twice as far away, the step must start from a quarter of the pull.
+  system.setPosition<Tracer>(0, Cartesian3D{20, 0, 0});
+  system.setVelocity<Tracer>(0, Vector{0, 1, 0});
+  system.step(1.0);
+  EXPECT_NEAR(system.storage<Tracer>().velocity(0)[0], near / 4,
+              1e-2 * std::abs(near));
+}
+
+TEST(MultiSpeciesIntegratorTest, ParallelIsBitIdentical) {
+  System serial, parallel({}, ParallelConfig{.num_threads = 4});
+  pushCloud(serial, 20, 30);
+  pushCloud(parallel, 20, 30);
+  for (auto i = 0; i < 10; ++i) {
+    serial.step(0.1);
+    parallel.step(0.1);
+  }
+  for (size_t i = 0; i < 30; ++i) {
+    EXPECT_EQ(serial.storage<Tracer>().position(i),
+              parallel.storage<Tracer>().position(i));
+  }
+}
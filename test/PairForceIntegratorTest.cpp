@@ -0,0 +1,208 @@
+//
+// Created by Renatus Madrigal on 6/19/2025.
+//
+
+#include "phosphorus/PairForceIntegrator.h"
+#include "TestHelper.h"
+#include "phosphorus/PairPotential.h"
+#include "phosphorus/Particle.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using namespace phosphorus;
+
+namespace {
+
+// A gas on a jittered lattice, so no two particles start too close.
+template <typename System>
+void pushGas(System &system, size_t side, double spacing, double speed,
+             unsigned seed = 42) {
+  using Coord = typename System::CoordinateVec;
+  using Vector = typename System::Vector;
+  constexpr auto kDimension = System::kDimension;
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<> jitter(-0.1 * spacing, 0.1 * spacing);
+  std::uniform_real_distribution<> velocity(-speed, speed);
+  size_t count = 1;
+  for (size_t axis = 0; axis < kDimension; ++axis) {
+    count *= side;
+  }
+  for (size_t k = 0; k < count; ++k) {
+    Coord pos{};
+    Vector vel{};
+    auto rest = k;
+    for (size_t axis = 0; axis < kDimension; ++axis) {
+      pos[axis] = static_cast<double>(rest % side) * spacing + jitter(gen);
+      vel[axis] = velocity(gen);
+      rest /= side;
+    }
+    system.pushParticle(CommonParticle(1.0, 0), pos, vel);
+  }
+}
+
+// The O(N^2) reference of the cut off pair forces.
+template <typename System>
+std::vector<double> bruteForce(const System &system) {
+  constexpr auto kDimension = System::kDimension;
+  const auto n = system.size();
+  const auto cutoff2 = system.cutoff() * system.cutoff();
+  std::vector<double> result(n * kDimension);
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      auto d = system[i].position.toVector() - system[j].position.toVector();
+      auto r2 = d * d;
+      if (i != j && r2 < cutoff2) {
+        auto factor = system.potential().forceOverDistance(r2);
+        for (size_t axis = 0; axis < kDimension; ++axis) {
+          result[i * kDimension + axis] += factor * d[axis];
+        }
+      }
+    }
+  }
+  return result;
+}
+
+template <typename System>
+std::vector<double> accelerationsOf(const System &system) {
+  std::vector<double> result;
+  for (auto &&elem : system) {
+    for (size_t axis = 0; axis < System::kDimension; ++axis) {
+      result.push_back(elem.acceleration[axis]);
+    }
+  }
+  return result;
+}
+
+template <typename System> double totalEnergy(const System &system) {
+  double kinetic = 0;
+  for (auto &&elem : system) {
+    kinetic += 0.5 * elem.particle.mass() * (elem.velocity * elem.velocity);
+  }
+  return kinetic + system.potentialEnergy();
+}
+
+} // namespace
+
+TEST(PairForceIntegratorTest, MatchesBruteForce) {
+  PairForceIntegrator<LennardJones, Cartesian3D, CommonParticle> system(
+      LennardJones{1, 1}, 2.5, 0.3);
+  pushGas(system, 8, 1.2, 0.5);
+  for (int i = 0; i < 50; ++i) {
+    system.step(1e-3);
+    EXPECT_PRED_FORMAT3(ContainersNear, accelerationsOf(system),
+                        bruteForce(system), 1e-9);
+  }
+}
+
+TEST(PairForceIntegratorTest, RebuildsOnlyAfterHalfSkin) {
+  PairForceIntegrator<SoftSpring, Cartesian2D, CommonParticle> system(
+      SoftSpring{10, 1}, 1, 0.4);
+  pushGas(system, 20, 1.0, 1.0);
+  for (int i = 0; i < 200; ++i) {
+    system.step(1e-2);
+  }
+  // No particle moves faster than about sqrt(2) * 1.5, so half of the skin
+  // takes at least ~10 steps.
+  EXPECT_GT(system.rebuildCount(), 1);
+  EXPECT_LT(system.rebuildCount(), 40);
+  EXPECT_PRED_FORMAT3(ContainersNear, accelerationsOf(system),
+                      bruteForce(system), 1e-9);
+
+  // Asking for the energy does not count as a rebuild, even when the list
+  // is out of date.
+  const auto rebuilds = system.rebuildCount();
+  for (size_t i = 0; i < system.size(); ++i) {
+    system.setPosition(system.handleOf(i),
+                       system[i].position + Cartesian2D{0.5, 0});
+  }
+  (void)system.potentialEnergy();
+  EXPECT_EQ(system.rebuildCount(), rebuilds);
+}
+
+TEST(PairForceIntegratorTest, CoincidentSoftSpheres) {
+  PairForceIntegrator<SoftSpring, Cartesian3D, CommonParticle> system(
+      SoftSpring{10, 1}, 1, 0.2);
+  system.pushParticle(CommonParticle(1, 0), {0, 0, 0}, {});
+  system.pushParticle(CommonParticle(1, 0), {0, 0, 0}, {});
+  system.pushParticle(CommonParticle(1, 0), {0.5, 0, 0}, {});
+  system.step(1e-3);
+  for (auto &&elem : system) {
+    for (size_t axis = 0; axis < 3; ++axis) {
+      EXPECT_TRUE(std::isfinite(elem.acceleration[axis]));
+    }
+  }
+  EXPECT_GT(system[2].acceleration[0], 0);
+}
+
+TEST(PairForceIntegratorTest, SoftSpheresConserveEnergy) {
+  PairForceIntegrator<SoftSpring, Cartesian3D, CommonParticle> system(
+      SoftSpring{100, 1}, 1, 0.2);
+  pushGas(system, 6, 0.9, 1.0);
+  system.step(0.0);
+  const auto initial = totalEnergy(system);
+  for (int i = 0; i < 1000; ++i) {
+    system.step(1e-3);
+  }
+  EXPECT_NEAR(totalEnergy(system), initial, std::abs(initial) * 1e-3);
+}
+
+TEST(PairForceIntegratorTest, ParallelIsBitIdentical) {
+  using System = PairForceIntegrator<LennardJones, Cartesian3D, CommonParticle>;
+  System serial(LennardJones{1, 1}, 2.5, 0.3);
+  System parallel(LennardJones{1, 1}, 2.5, 0.3, {.num_threads = 4});
+  pushGas(serial, 8, 1.2, 0.5);
+  pushGas(parallel, 8, 1.2, 0.5);
+  for (int i = 0; i < 20; ++i) {
+    serial.step(1e-3);
+    parallel.step(1e-3);
+  }
+  EXPECT_EQ(accelerationsOf(parallel), accelerationsOf(serial));
+  EXPECT_EQ(parallel.rebuildCount(), serial.rebuildCount());
+}
+
+TEST(PairForceIntegratorTest, SparseSystem) {
+  // Two particles far apart must not allocate a cell per cutoff volume.
+  PairForceIntegrator<LennardJones, Cartesian3D, CommonParticle> system(
+      LennardJones{1, 1}, 2.5, 0.3);
+  system.pushParticle(CommonParticle(1, 0), {0, 0, 0}, {});
+  system.pushParticle(CommonParticle(1, 0), {1e9, 1e9, 1e9}, {});
+  system.pushParticle(CommonParticle(1, 0), {1.5, 0, 0}, {});
+  system.step(0.0);
+  EXPECT_LE(system.neighborList().cells().cellCount(), 7);
+  EXPECT_EQ(system.neighborList().entries(), 2);
+  EXPECT_PRED_FORMAT3(ContainersNear, accelerationsOf(system),
+                      bruteForce(system), 1e-12);
+}
+
+TEST(PairForceIntegratorTest, DistantOutlier) {
+  // The product of the sides of the cell grid of an outlier this far away
+  // overflows size_t if it is counted before the cells are widened.
+  PairForceIntegrator<LennardJones, Cartesian3D, CommonParticle> system(
+      LennardJones{1, 1}, 2.5, 0.3);
+  pushGas(system, 4, 1.2, 0.5);
+  system.pushParticle(CommonParticle(1, 0), {1.2e7, 1.2e7, 1.2e7}, {});
+  system.step(0.0);
+  EXPECT_LE(system.neighborList().cells().cellCount(), 2 * system.size() + 1);
+  EXPECT_PRED_FORMAT3(ContainersNear, accelerationsOf(system),
+                      bruteForce(system), 1e-12);
+
+  system.pushParticle(CommonParticle(1, 0), {NAN, 0, 0}, {});
+  EXPECT_THROW(system.step(0.0), std::invalid_argument);
+}
+
+TEST(PairForceIntegratorTest, RemoveAndInsert) {
+  PairForceIntegrator<LennardJones, Cartesian3D, CommonParticle> system(
+      LennardJones{1, 1}, 2.5, 0.3);
+  pushGas(system, 6, 1.2, 0.5);
+  system.step(1e-3);
+  // Swap a particle for a new one, keeping the count. The particle moved
+  // into the hole is far from where the list saw it, which forces a rebuild.
+  system.removeParticle(system.handleOf(7));
+  system.pushParticle(CommonParticle(1.0, 0), Cartesian3D{3.0, 3.0, 3.6});
+  system.step(1e-3);
+  EXPECT_PRED_FORMAT3(ContainersNear, accelerationsOf(system),
+                      bruteForce(system), 1e-9);
+}
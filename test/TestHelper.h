@@ -7,6 +7,47 @@
 
 #include "phosphorus/phosphorus.h"
 #include <gtest/gtest.h>
+#include <filesystem>
+#include <random>
+#include <string>
+
+// A file in the temporary directory, removed at the end of the test.
+class TemporaryFile {
+public:
+  explicit TemporaryFile(const std::string &name)
+      : path_(std::filesystem::temp_directory_path() / ("phosphorus_" + name)) {
+    std::filesystem::remove(path_);
+  }
+  ~TemporaryFile() { std::filesystem::remove(path_); }
+
+  TemporaryFile(const TemporaryFile &) = delete;
+  TemporaryFile &operator=(const TemporaryFile &) = delete;
+
+  [[nodiscard]] const std::filesystem::path &path() const { return path_; }
+
+private:
+  std::filesystem::path path_;
+};
+
+// Fill a system with a reproducible cloud of bodies.
+template <typename System>
+void pushRandomBodies(System &system, size_t n, unsigned seed = 42) {
+  using Coord = typename System::CoordinateVec;
+  using Vector = typename System::Vector;
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<> position(-1e3, 1e3);
+  std::uniform_real_distribution<> velocity(-1e-2, 1e-2);
+  std::uniform_real_distribution<> mass(1e8, 1e10);
+  for (size_t i = 0; i < n; ++i) {
+    Coord pos{};
+    Vector vel{};
+    for (size_t axis = 0; axis < Coord::dimension(); ++axis) {
+      pos[axis] = position(gen);
+      vel[axis] = velocity(gen);
+    }
+    system.pushParticle(phosphorus::CommonParticle{mass(gen), 0}, pos, vel);
+  }
+}
 
 // A test helper for vector comparing
 template <typename Container>
@@ -0,0 +1,284 @@
+//
+// Created by Renatus Madrigal on 6/29/2025.
+//
+
+#include "TestHelper.h"
+#include "phosphorus/DataColumn.h"
+#include "phosphorus/Field.h"
+#include "phosphorus/Particle.h"
+#include "phosphorus/TrajectoryFile.h"
+#include "phosphorus/TrajectoryRecorder.h"
+#include "phosphorus/VerletIntegrator.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+using namespace phosphorus;
+
+namespace {
+
+using System = FieldVerletIntegrator<CartesianGravityField, Cartesian3D,
+                                     CommonParticle>;
+
+// Particles on inclined circular orbits around a unit mass, with G = 1.
+System makeSystem(size_t n) {
+  System system(CartesianGravityField({0, 0, 0}, 1.0, 1.0));
+  for (size_t i = 0; i < n; ++i) {
+    const auto r = 1.0 + 0.1 * static_cast<double>(i);
+    const auto v = std::sqrt(1.0 / r);
+    const auto tilt = 0.05 * static_cast<double>(i);
+    system.pushParticle(CommonParticle{1e-6, 0}, Cartesian3D{r, 0, 0},
+                        Cartesian3D::Vector{0, v * std::cos(tilt),
+                                            v * std::sin(tilt)});
+  }
+  return system;
+}
+
+// Runs the system, writing the trajectory to the file and keeping a copy in
+// memory.
+TrajectoryRecorder<System> run(System &system, const TemporaryFile &file,
+                               TrajectoryFileWriter::Options options,
+                               size_t steps) {
+  TrajectoryRecorder<System> recorder(system);
+  TrajectoryWriter<System> writer(system, file.path(), options);
+  for (size_t i = 0; i <= steps; ++i) {
+    recorder.observe();
+    writer.observe();
+    system.step(0.01);
+  }
+  writer.close();
+  EXPECT_EQ(writer.samples(), steps + 1);
+  recorder.compact();
+  return recorder;
+}
+
+// The largest difference between the file and the recorder.
+double largestError(const TrajectoryFileReader &reader,
+                    const TrajectoryRecorder<System> &recorder) {
+  double result = 0;
+  for (size_t chunk = 0; chunk < reader.chunks(); ++chunk) {
+    const auto begin = reader.chunkBegin(chunk);
+    const auto times = reader.readColumn(chunk, reader.kTimeColumn);
+    for (size_t i = 0; i < times.size(); ++i) {
+      EXPECT_EQ(times[i], recorder.times()[begin + i]);
+    }
+    for (size_t p = 0; p < reader.particles(); ++p) {
+      for (size_t axis = 0; axis < 3; ++axis) {
+        const auto values = reader.readColumn(chunk, reader.column(p, axis));
+        const auto expected = recorder.positions(p, axis);
+        for (size_t i = 0; i < values.size(); ++i) {
+          result = std::max(result, std::abs(values[i] - expected[begin + i]));
+        }
+      }
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+TEST(TrajectoryFileTest, LosslessRoundTrip) {
+  TemporaryFile file("lossless.traj");
+  auto system = makeSystem(5);
+  const auto recorder = run(system, file, {.chunk_samples = 64}, 1000);
+
+  TrajectoryFileReader reader(file.path());
+  EXPECT_EQ(reader.version(), kTrajectoryFileVersion);
+  EXPECT_EQ(reader.dimension(), 3);
+  EXPECT_EQ(reader.particles(), 5);
+  EXPECT_EQ(reader.samples(), 1001);
+  EXPECT_EQ(reader.chunks(), (1001 + 63) / 64);
+  EXPECT_EQ(reader.chunkSize(reader.chunks() - 1), 1001 % 64);
+  EXPECT_EQ(reader.chunkOf(0), 0);
+  EXPECT_EQ(reader.chunkOf(640), 10);
+  EXPECT_EQ(reader.chunkBegin(reader.chunkOf(1000)), 960);
+  EXPECT_EQ(largestError(reader, recorder), 0.0);
+  // Smooth orbits compress well even losslessly.
+  EXPECT_LT(std::filesystem::file_size(file.path()), 1001 * 16 * 8 * 3 / 4);
+}
+
+TEST(TrajectoryFileTest, QuantizedWithinTolerance) {
+  TemporaryFile lossless("reference.traj");
+  TemporaryFile lossy("quantized.traj");
+  auto first = makeSystem(8);
+  run(first, lossless, {}, 2000);
+  auto second = makeSystem(8);
+  const auto recorder =
+      run(second, lossy, {.chunk_samples = 500, .tolerance = 1e-6}, 2000);
+
+  TrajectoryFileReader reader(lossy.path());
+  EXPECT_EQ(reader.tolerance(), 1e-6);
+  EXPECT_EQ(reader.chunks(), 5);
+  EXPECT_LE(largestError(reader, recorder), 1e-6 * (1 + 1e-9));
+  EXPECT_LT(std::filesystem::file_size(lossy.path()),
+            std::filesystem::file_size(lossless.path()) / 2);
+}
+
+TEST(TrajectoryFileTest, StoredAndRemovedParticles) {
+  TemporaryFile file("stored.traj");
+  auto system = makeSystem(3);
+  const std::vector handles{system.handleOf(0), system.handleOf(2)};
+  {
+    TrajectoryWriter<System> writer(
+        system, file.path(), handles,
+        {.chunk_samples = 16, .tolerance = 1e-3, .level = 0, .buffers = 1}, 2);
+    for (auto i = 0; i < 40; ++i) {
+      writer.observe();
+      system.step(0.01);
+      if (i == 35) {
+        system.removeParticle(handles[1]);
+      }
+    }
+    // Closed by the destructor.
+  }
+
+  TrajectoryFileReader reader(file.path());
+  EXPECT_EQ(reader.particles(), 2);
+  EXPECT_EQ(reader.samples(), 20);
+  const auto x = reader.readColumn(1, reader.column(1, 0));
+  ASSERT_EQ(x.size(), 4);
+  EXPECT_FALSE(std::isnan(x[1]));
+  EXPECT_TRUE(std::isnan(x[2]));
+  const auto times = reader.readColumn(1, reader.kTimeColumn);
+  EXPECT_NEAR(times[0], 0.32, 1e-12);
+  EXPECT_THROW((void)reader.column(2, 0), std::out_of_range);
+  EXPECT_THROW((void)reader.chunkOf(20), std::out_of_range);
+}
+
+TEST(TrajectoryFileTest, RejectsBadInputAndDamage) {
+  TemporaryFile file("damage.traj");
+  EXPECT_THROW(TrajectoryFileWriter(file.path(), 3, 1, {.chunk_samples = 0}),
+               TrajectoryFileError);
+  EXPECT_THROW(TrajectoryFileWriter(file.path(), 3, 1, {.tolerance = -1}),
+               TrajectoryFileError);
+  {
+    TrajectoryFileWriter writer(file.path(), 3, 1, {.chunk_samples = 4});
+    EXPECT_THROW(writer.append(0, std::vector<double>(2)),
+                 TrajectoryFileError);
+    for (auto i = 0; i < 10; ++i) {
+      writer.append(i, std::vector<double>{1.0 * i, 2.0, 3.0});
+    }
+    writer.close();
+    EXPECT_THROW(writer.append(10, std::vector<double>(3)),
+                 TrajectoryFileError);
+  }
+  {
+    TrajectoryFileReader reader(file.path());
+    EXPECT_EQ(reader.readColumn(2, reader.column(0, 0)),
+              (std::vector<double>{8.0, 9.0}));
+  }
+
+  // Without its footer, the file looks like a run which was never closed.
+  const auto size = std::filesystem::file_size(file.path());
+  std::filesystem::resize_file(file.path(), size - 8);
+  EXPECT_THROW(TrajectoryFileReader reader(file.path()), TrajectoryFileError);
+  {
+    std::ofstream out(file.path(), std::ios::binary);
+    out << "not a trajectory, but long enough to hold a whole header and a "
+           "footer after it.........";
+  }
+  EXPECT_THROW(TrajectoryFileReader reader(file.path()), TrajectoryFileError);
+  EXPECT_THROW(TrajectoryFileReader reader(file.path().string() + ".missing"),
+               TrajectoryFileError);
+}
+
+TEST(TrajectoryFileTest, WriteFailureIsSticky) {
+  const std::filesystem::path full("/dev/full");
+  if (!std::filesystem::exists(full)) {
+    GTEST_SKIP() << "No device which is always full";
+  }
+  // Every chunk is larger than the buffer of the file, so writing it fails.
+  TrajectoryFileWriter writer(full, 3, 100,
+                              {.chunk_samples = 64, .level = 0, .buffers = 1});
+  const std::vector<double> positions(300, 1.0);
+  size_t appended = 0;
+  try {
+    for (; appended < 64 * 10; ++appended) {
+      writer.append(1.0 * appended, positions);
+    }
+  } catch (const TrajectoryFileError &) {
+  }
+  EXPECT_LT(appended, 64 * 10);
+  for (auto i = 0; i < 100; ++i) {
+    EXPECT_THROW(writer.append(0, positions), TrajectoryFileError);
+  }
+  EXPECT_THROW(writer.close(), TrajectoryFileError);
+  EXPECT_THROW(writer.close(), TrajectoryFileError);
+  EXPECT_THROW(writer.append(0, positions), TrajectoryFileError);
+}
+
+TEST(TrajectoryFileTest, ColumnsAcrossChunks) {
+  TemporaryFile stored("stored.traj");
+  TemporaryFile compressed("compressed.traj");
+  auto first = makeSystem(4);
+  const auto recorder = run(first, stored, {.chunk_samples = 50, .level = 0},
+                            300);
+  auto second = makeSystem(4);
+  run(second, compressed, {.chunk_samples = 50}, 300);
+
+  // Small enough a cache to evict columns while they are read.
+  TrajectoryFileReader plain(stored.path());
+  TrajectoryFileReader packed(compressed.path(), 2 * 50 * sizeof(double));
+  for (const auto *reader : {&plain, &packed}) {
+    const auto times = reader->times();
+    EXPECT_EQ(times.size(), 301);
+    EXPECT_EQ(times[120], recorder.times()[120]);
+    for (size_t p = 0; p < 4; ++p) {
+      for (size_t axis = 0; axis < 3; ++axis) {
+        const auto column = reader->positions(p, axis);
+        const auto expected = recorder.positions(p, axis);
+        std::vector<double> values(130);
+        column.read(40, values);
+        for (size_t i = 0; i < values.size(); ++i) {
+          ASSERT_EQ(values[i], expected[40 + i]);
+        }
+        EXPECT_EQ(column[300], expected[300]);
+      }
+    }
+    std::vector<double> values(2);
+    EXPECT_THROW(times.read(300, values), std::out_of_range);
+  }
+
+  // Stored columns are read in place, and compressed ones outlive the cache.
+  const auto mapped = plain.times().chunk(1);
+  EXPECT_EQ(mapped.owner, nullptr);
+  EXPECT_EQ(mapped.values.data(), plain.times().chunk(1).values.data());
+  const auto decoded = packed.positions(0, 0).chunk(2);
+  ASSERT_NE(decoded.owner, nullptr);
+  for (size_t chunk = 0; chunk < packed.chunks(); ++chunk) {
+    (void)packed.times().chunk(chunk);
+  }
+  EXPECT_EQ(decoded.values.size(), 50);
+  EXPECT_EQ(decoded.values[10], recorder.positions(0, 0)[110]);
+}
+
+TEST(TrajectoryFileTest, PlotsThroughDataColumns) {
+  TemporaryFile file("plot.traj");
+  auto system = makeSystem(2);
+  const auto recorder = run(system, file, {.chunk_samples = 1000}, 5000);
+  TrajectoryFileReader reader(file.path());
+
+  const DataColumn x = reader.positions(1, 0);
+  const DataColumn y = recorder.positions(1, 0);
+  ASSERT_EQ(x.size(), y.size());
+  std::vector<double> from_file;
+  std::vector<double> from_memory;
+  x.forEachBlock([&](std::span<const double> block) {
+    EXPECT_LE(block.size(), DataColumn::kBlockSize);
+    from_file.insert(from_file.end(), block.begin(), block.end());
+  });
+  y.forEachBlock([&](std::span<const double> block) {
+    from_memory.insert(from_memory.end(), block.begin(), block.end());
+  });
+  EXPECT_EQ(from_file, from_memory);
+  EXPECT_TRUE(DataColumn().empty());
+
+  // Columns refer to containers, so temporary ones are rejected.
+  static_assert(std::is_convertible_v<std::vector<double> &, DataColumn>);
+  static_assert(std::is_convertible_v<std::span<double>, DataColumn>);
+  static_assert(!std::is_convertible_v<std::vector<double>, DataColumn>);
+}
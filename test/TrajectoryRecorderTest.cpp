@@ -0,0 +1,132 @@
+//
+// Created by Renatus Madrigal on 6/28/2025.
+//
+
+#include "phosphorus/DataColumn.h"
+#include "phosphorus/Field.h"
+#include "phosphorus/Particle.h"
+#include "phosphorus/TrajectoryRecorder.h"
+#include "phosphorus/VerletIntegrator.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+using namespace phosphorus;
+
+namespace {
+
+using System = FieldVerletIntegrator<Cartesian2DGravityField, Cartesian2D,
+                                     CommonParticle>;
+using Recorder = TrajectoryRecorder<System>;
+
+// Three particles on circular orbits of radius 1, 2 and 3.
+void pushOrbits(System &system) {
+  for (auto r = 1; r <= 3; ++r) {
+    system.pushParticle(CommonParticle{1, 0}, Cartesian2D{1.0 * r, 0},
+                        Cartesian2D::Vector{0, std::sqrt(1.0 / r)});
+  }
+}
+
+} // namespace
+
+TEST(TrajectoryRecorderTest, RecordsEveryKSteps) {
+  System system(Cartesian2DGravityField({0, 0}, 1.0, 1.0));
+  pushOrbits(system);
+  Recorder recorder(system, {.every = 3, .chunk_size = 4});
+
+  std::vector<std::vector<Cartesian2D>> expected(3);
+  std::vector<double> expected_times;
+  for (auto i = 0; i <= 30; ++i) {
+    if (i % 3 == 0) {
+      for (size_t p = 0; p < 3; ++p) {
+        expected[p].push_back(system.at(p).position);
+      }
+      expected_times.push_back(system.time());
+    }
+    recorder.observe();
+    system.step(0.01);
+  }
+
+  ASSERT_EQ(recorder.samples(), 11);
+  EXPECT_EQ(recorder.chunks(), 3);
+  EXPECT_EQ(recorder.times(2).size(), 3);
+  for (size_t sample = 0; sample < recorder.samples(); ++sample) {
+    EXPECT_EQ(recorder.time(sample), expected_times[sample]);
+    for (size_t p = 0; p < 3; ++p) {
+      const auto position = recorder.position(p, sample);
+      EXPECT_EQ(position[0], expected[p][sample][0]);
+      EXPECT_EQ(position[1], expected[p][sample][1]);
+    }
+  }
+  // The columns of a chunk are the samples in order.
+  EXPECT_EQ(recorder.positions(1, 0, 1)[2], expected[1][6][0]);
+  EXPECT_THROW((void)recorder.position(3, 0), std::out_of_range);
+  EXPECT_THROW((void)recorder.time(11), std::out_of_range);
+}
+
+TEST(TrajectoryRecorderTest, ChunksDoNotMove) {
+  System system(Cartesian2DGravityField({0, 0}, 1.0, 1.0));
+  pushOrbits(system);
+  Recorder recorder(system, {.chunk_size = 16});
+  recorder.record();
+  const auto first = recorder.positions(0, 0, 0).data();
+  for (auto i = 0; i < 1000; ++i) {
+    system.step(0.01);
+    recorder.observe();
+  }
+  EXPECT_EQ(recorder.chunks(), (1001 + 15) / 16);
+  EXPECT_EQ(recorder.positions(0, 0, 0).data(), first);
+
+  // A column view covers every chunk, also when plotted as a DataColumn.
+  const DataColumn radius = recorder.positions(2, 0);
+  ASSERT_EQ(radius.size(), 1001);
+  std::vector<double> values(1001);
+  radius.read(0, values);
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(values[i], recorder.position(2, i)[0]);
+  }
+  EXPECT_EQ(recorder.times()[1000], recorder.time(1000));
+
+  // Compacting puts every column in one span.
+  recorder.compact();
+  EXPECT_EQ(recorder.chunks(), 1);
+  const auto x = recorder.positions(2, 0, 0);
+  const auto y = recorder.positions(2, 1, 0);
+  ASSERT_EQ(x.size(), 1001);
+  for (size_t i = 0; i < x.size(); ++i) {
+    EXPECT_NEAR(std::hypot(x[i], y[i]), 3.0, 1e-4);
+  }
+  // Recording goes on after compacting.
+  recorder.record();
+  EXPECT_EQ(recorder.samples(), 1002);
+  EXPECT_EQ(recorder.position(2, 1001)[0], system.at(2).position[0]);
+}
+
+TEST(TrajectoryRecorderTest, ReserveAllocatesOnce) {
+  System system(Cartesian2DGravityField({0, 0}, 1.0, 1.0));
+  pushOrbits(system);
+  const auto handles = std::vector{system.handleOf(2)};
+  Recorder recorder(system, handles, {.chunk_size = 8});
+  recorder.reserve(100);
+  EXPECT_EQ(recorder.capacity(), 100);
+  for (auto i = 0; i < 100; ++i) {
+    recorder.observe();
+    system.step(0.01);
+  }
+  EXPECT_EQ(recorder.capacity(), 100);
+  EXPECT_EQ(recorder.chunks(), 1);
+  EXPECT_EQ(recorder.times().size(), 100);
+  EXPECT_NEAR(recorder.times()[99], 0.99, 1e-12);
+
+  // A removed particle is recorded as NaN.
+  system.removeParticle(handles[0]);
+  recorder.record();
+  EXPECT_EQ(recorder.chunks(), 2);
+  EXPECT_TRUE(std::isnan(recorder.position(0, 100)[0]));
+
+  recorder.clear();
+  EXPECT_TRUE(recorder.empty());
+  EXPECT_EQ(recorder.chunks(), 0);
+  EXPECT_THROW(Recorder(system, {.every = 0}), std::invalid_argument);
+}
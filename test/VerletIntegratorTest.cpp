@@ -7,6 +7,9 @@
 #include "phosphorus/Field.h"
 #include "phosphorus/Particle.h"
 #include <gtest/gtest.h>
+#include <numbers>
+#include <thread>
+#include <vector>
 
 using namespace phosphorus;
 
@@ -119,3 +122,404 @@ TEST(VerletIntegratorTest, NonUniformField) {
     system.step(0.001);
   }
 }
+
+TEST(VerletIntegratorTest, StructureOfArraysStorage) {
+  EmptySystem system;
+  system.reserve(3);
+  for (auto i = 0; i < 3; ++i) {
+    system.pushParticle(CommonParticle{1.0 + i, -1.0 * i},
+                        Cartesian3D{1.0 * i, 2.0 * i, 3.0 * i},
+                        Vector{-1.0 * i, 0, 1.0 * i});
+  }
+
+  const auto &storage = system.storage();
+  ASSERT_EQ(storage.size(), 3);
+  for (size_t axis = 0; axis < 3; ++axis) {
+    auto address =
+        reinterpret_cast<std::uintptr_t>(storage.positions(axis).data());
+    EXPECT_EQ(address % 64, 0);
+    EXPECT_EQ(storage.positions(axis)[2], 2.0 * (axis + 1));
+  }
+  EXPECT_EQ(storage.masses()[1], 2.0);
+
+  // The iterator gathers a snapshot of the particle from the arrays.
+  auto it = system.begin() + 2;
+  EXPECT_EQ(it->position, (Cartesian3D{2.0, 4.0, 6.0}));
+  EXPECT_EQ(it->velocity, (Vector{-2.0, 0, 2.0}));
+  EXPECT_EQ(it->particle.charge(), -2.0);
+  EXPECT_EQ(system.end() - system.begin(), 3);
+  EXPECT_THROW(system.at(3), std::out_of_range);
+}
+
+TEST(VerletIntegratorTest, IndependentInstances) {
+  static constexpr auto g = 9.8;
+  auto force = [](Cartesian3D, CommonParticle particle) {
+    return Cartesian3D::Vector{0, 0, particle.mass() * g};
+  };
+  auto acc = Cartesian3D::Vector{0, 0, g};
+
+  // Every instance must do its own initial acceleration pass.
+  for (auto system_index = 0; system_index < 2; ++system_index) {
+    auto system = FieldVerletIntegrator(LambdaField(force));
+    auto it = system.pushParticle(CommonParticle{1.0, 1.0});
+    for (auto i = 1; i <= 3; ++i) {
+      system.step(1.0);
+      EXPECT_VEC_NEAR(it->position, Cartesian3D{} + 0.5 * acc * i * i, eps)
+          << "Where system_index == " << system_index;
+    }
+  }
+}
+
+TEST(VerletIntegratorTest, ConcurrentInstances) {
+  auto force = [](Cartesian3D pos, CommonParticle part) {
+    return Cartesian3D::Vector{-pos[0] * part.mass(), 0, 0};
+  };
+  auto run = [&](double v0, size_t particles) {
+    auto system = FieldVerletIntegrator(LambdaField(force));
+    for (size_t i = 0; i < particles; ++i) {
+      system.pushParticle(CommonParticle{1.0, 0}, Cartesian3D{0, 0, 0},
+                          Vector{v0 * (i + 1), 0, 0});
+    }
+    for (auto i = 0; i < 1000; ++i) {
+      system.step(0.001);
+    }
+    return system.back().position[0];
+  };
+
+  constexpr auto kSystems = 8;
+  std::vector<double> expected(kSystems), actual(kSystems);
+  for (auto i = 0; i < kSystems; ++i) {
+    expected[i] = run(1.0 + i, i + 1);
+  }
+
+  std::vector<std::thread> threads;
+  for (auto i = 0; i < kSystems; ++i) {
+    threads.emplace_back([&, i] { actual[i] = run(1.0 + i, i + 1); });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(actual, expected);
+}
+
+TEST(VerletIntegratorTest, GravityConservesMomentum) {
+  GravityIntegrator<Cartesian3D, CommonParticle> system;
+  system.pushParticle(CommonParticle{5e10, 0}, Cartesian3D{0, 0, 0},
+                      Vector{0, -0.5, 0});
+  system.pushParticle(CommonParticle{1e10, 0}, Cartesian3D{10, 0, 0},
+                      Vector{0, 2.0, 0.1});
+  system.pushParticle(CommonParticle{2e10, 0}, Cartesian3D{-5, 3, 1},
+                      Vector{0.3, 0, 0});
+
+  auto momentum = [&] {
+    auto total = Vector{0, 0, 0};
+    for (auto &&elem : system) {
+      total += elem.velocity * elem.particle.mass();
+    }
+    return total;
+  };
+
+  // All the forces of one step are evaluated at the same positions, so the
+  // pair forces cancel and the total momentum is conserved.
+  auto initial = momentum();
+  for (auto i = 0; i < 100; ++i) {
+    system.step(0.1);
+  }
+  EXPECT_VEC_NEAR(momentum(), initial, 1e-3);
+}
+
+namespace {
+
+// A unit mass on an orbit of eccentricity e around a fixed unit mass at the
+// origin (G M = 1), started at the apocenter of an orbit of semi-major axis 1,
+// so the period is 2 pi.
+auto makeKeplerOrbit(double e) {
+  auto force = [](Cartesian3D pos, CommonParticle part) -> Cartesian3D::Vector {
+    auto r = distance(pos, Cartesian3D{});
+    return Cartesian3D::Vector{pos[0], pos[1], pos[2]} *
+           (-part.mass() / (r * r * r));
+  };
+  auto system = FieldVerletIntegrator(LambdaField(force));
+  system.pushParticle(CommonParticle{1.0, 0}, Cartesian3D{1 + e, 0, 0},
+                      Vector{0, std::sqrt((1 - e) / (1 + e)), 0});
+  return system;
+}
+
+// A unit mass on a unit spring, started at x = 1 at rest, so the period is
+// 2 pi and the acceleration passes through zero twice a period.
+auto makeSpring() {
+  auto force = [](Cartesian3D pos, CommonParticle part) {
+    return Cartesian3D::Vector{-pos[0] * part.mass(), 0, 0};
+  };
+  auto system = FieldVerletIntegrator(LambdaField(force));
+  system.pushParticle(CommonParticle{1.0, 0}, Cartesian3D{1, 0, 0},
+                      Vector{0, 0, 0});
+  return system;
+}
+
+} // namespace
+
+TEST(VerletIntegratorTest, AdvanceToLandsOnEndTime) {
+  auto system = makeKeplerOrbit(0.5);
+  using Control = decltype(system)::StepControl;
+  for (auto control : {Control::ErrorEstimate, Control::Acceleration,
+                       Control::TimeSymmetric}) {
+    auto end = system.time() + 1.25;
+    auto stats = system.advanceTo(end, 1e-3, control);
+    EXPECT_EQ(system.time(), end);
+    EXPECT_GT(stats.steps, 1);
+    EXPECT_GE(stats.evaluations, stats.steps);
+  }
+  // Advancing to the current time is a no-op.
+  auto before = system.front().position;
+  auto stats = system.advanceTo(system.time(), 1e-3);
+  EXPECT_EQ(stats.steps, 0);
+  EXPECT_EQ(system.front().position, before);
+  EXPECT_THROW(system.advanceTo(10, 0), std::invalid_argument);
+}
+
+TEST(VerletIntegratorTest, AdvanceToInShortPieces) {
+  // Every piece ends in a step shortened to hit its end, so the step size
+  // carried to the next call comes from shortened steps only.
+  using Control = decltype(makeSpring())::StepControl;
+  for (auto control : {Control::ErrorEstimate, Control::Acceleration,
+                       Control::TimeSymmetric}) {
+    auto system = makeSpring();
+    for (int i = 1; i <= 20; ++i) {
+      auto stats = system.advanceTo(1e-4 * i, 1e-3, control);
+      EXPECT_EQ(system.time(), 1e-4 * i);
+      EXPECT_GE(stats.steps, 1);
+    }
+  }
+}
+
+TEST(VerletIntegratorTest, AdaptiveEccentricOrbit) {
+  constexpr auto e = 0.9;
+  constexpr auto period = 2 * std::numbers::pi;
+  const auto start = Cartesian3D{1 + e, 0, 0};
+  using Control = decltype(makeKeplerOrbit(e))::StepControl;
+
+  for (auto [control, tolerance] : {std::pair{Control::ErrorEstimate, 1e-4},
+                                    {Control::Acceleration, 1e-4},
+                                    {Control::TimeSymmetric, 1e-4}}) {
+    auto adaptive = makeKeplerOrbit(e);
+    auto stats = adaptive.advanceTo(period, tolerance, control);
+    auto adaptive_error = distance(adaptive.front().position, start);
+
+    // The steps concentrate around the pericenter, so a fixed step with the
+    // same number of force evaluations is far less accurate.
+    auto fixed = makeKeplerOrbit(e);
+    for (size_t i = 0; i < stats.evaluations; ++i) {
+      fixed.step(period / static_cast<double>(stats.evaluations));
+    }
+    auto fixed_error = distance(fixed.front().position, start);
+    EXPECT_LT(adaptive_error, 1e-4);
+    EXPECT_LT(adaptive_error * 100, fixed_error);
+  }
+}
+
+TEST(VerletIntegratorTest, AdaptiveOscillator) {
+  // The acceleration passes through zero, where a measure relative to the
+  // acceleration alone would call for ever smaller steps.
+  constexpr auto period = 2 * std::numbers::pi;
+  using Control = decltype(makeSpring())::StepControl;
+  for (auto control : {Control::ErrorEstimate, Control::Acceleration,
+                       Control::TimeSymmetric}) {
+    auto system = makeSpring();
+    auto stats = system.advanceTo(period, 1e-3, control);
+    EXPECT_LT(stats.steps, 500);
+    EXPECT_LT(stats.evaluations, 1000);
+    EXPECT_VEC_NEAR(system.front().position, (Cartesian3D{1, 0, 0}), 1e-3);
+  }
+}
+
+TEST(VerletIntegratorTest, TimeSymmetricStepsLimitEnergyDrift) {
+  constexpr auto e = 0.9;
+  using Control = decltype(makeKeplerOrbit(e))::StepControl;
+  auto drift = [&](Control control) {
+    auto system = makeKeplerOrbit(e);
+    auto energy = [&] {
+      auto body = system.front();
+      double v2 = 0;
+      for (size_t axis = 0; axis < 3; ++axis) {
+        v2 += body.velocity[axis] * body.velocity[axis];
+      }
+      return 0.5 * v2 - 1 / distance(body.position, Cartesian3D{});
+    };
+    auto initial = energy();
+    system.advanceTo(50 * 2 * std::numbers::pi, 0.05, control);
+    return std::abs(energy() - initial);
+  };
+  EXPECT_LT(drift(Control::TimeSymmetric) * 5, drift(Control::Acceleration));
+}
+
+namespace {
+
+// The largest energy error over ten periods of an e = 0.5 Kepler orbit, with
+// the given number of force evaluations per period.
+template <typename Scheme> double keplerEnergyError(size_t evaluations) {
+  constexpr auto e = 0.5;
+  auto force = [](Cartesian3D pos, CommonParticle part) -> Cartesian3D::Vector {
+    auto r = distance(pos, Cartesian3D{});
+    return Cartesian3D::Vector{pos[0], pos[1], pos[2]} *
+           (-part.mass() / (r * r * r));
+  };
+  using Field = LambdaField<Cartesian3D, CommonParticle>;
+  FieldVerletIntegrator<Field, Cartesian3D, CommonParticle, Scheme> system{
+      Field(force)};
+  system.pushParticle(CommonParticle{1.0, 0}, Cartesian3D{1 + e, 0, 0},
+                      Vector{0, std::sqrt((1 - e) / (1 + e)), 0});
+  auto energy = [&] {
+    auto body = system.front();
+    double v2 = 0;
+    for (size_t axis = 0; axis < 3; ++axis) {
+      v2 += body.velocity[axis] * body.velocity[axis];
+    }
+    return 0.5 * v2 - 1 / distance(body.position, Cartesian3D{});
+  };
+
+  const auto steps = evaluations / Scheme::kDrifts.size();
+  const auto initial = energy();
+  double result = 0;
+  for (size_t i = 0; i < 10 * steps; ++i) {
+    system.step(2 * std::numbers::pi / static_cast<double>(steps));
+    result = std::max(result, std::abs(energy() - initial));
+  }
+  return result;
+}
+
+template <typename Scheme> void expectOrder() {
+  auto coarse = keplerEnergyError<Scheme>(800);
+  auto fine = keplerEnergyError<Scheme>(1600);
+  EXPECT_GT(coarse / fine, 0.7 * (1 << Scheme::kOrder));
+}
+
+} // namespace
+
+TEST(VerletIntegratorTest, SymplecticSchemesConvergeAtTheirOrder) {
+  expectOrder<VelocityVerlet>();
+  expectOrder<Yoshida4>();
+  expectOrder<Yoshida6>();
+  expectOrder<Omelyan2>();
+  expectOrder<Omelyan4>();
+}
+
+TEST(VerletIntegratorTest, FourthOrderSchemesBeatVerlet) {
+  // At the same number of force evaluations.
+  auto verlet = keplerEnergyError<VelocityVerlet>(1600);
+  EXPECT_LT(keplerEnergyError<Yoshida4>(1600) * 50, verlet);
+  EXPECT_LT(keplerEnergyError<Omelyan4>(1600) * 500, verlet);
+  // And with 16x fewer steps.
+  EXPECT_LT(keplerEnergyError<Omelyan4>(400), verlet);
+}
+
+TEST(VerletIntegratorTest, GravityIntegratorWithScheme) {
+  GravityIntegrator<Cartesian3D, CommonParticle, Yoshida4> system;
+  system.pushParticle(CommonParticle{5e10, 0}, Cartesian3D{0, 0, 0});
+  system.pushParticle(CommonParticle{1e10, 0}, Cartesian3D{10, 0, 0},
+                      Vector{0, 0.5, 0});
+  system.step(0.5);
+  EXPECT_EQ(system.forceEvaluations(), 1 + Yoshida4::kDrifts.size());
+  EXPECT_DOUBLE_EQ(system.time(), 0.5);
+}
+
+TEST(VerletIntegratorTest, HandlesSurviveRemoval) {
+  EmptySystem system;
+  std::vector<EmptySystem::Handle> handles;
+  for (auto i = 0; i < 5; ++i) {
+    auto it = system.pushParticle(CommonParticle{1.0 + i, 0},
+                                  Cartesian3D{1.0 * i, 0, 0});
+    handles.push_back(it.handle());
+  }
+
+  EXPECT_TRUE(system.removeParticle(handles[1]));
+  EXPECT_FALSE(system.removeParticle(handles[1]));
+  EXPECT_FALSE(system.contains(handles[1]));
+  EXPECT_THROW((void)system.indexOf(handles[1]), std::out_of_range);
+  ASSERT_EQ(system.count(), 4);
+  for (auto i : {0, 2, 3, 4}) {
+    EXPECT_EQ(system.at(handles[i]).position[0], 1.0 * i);
+    EXPECT_EQ(system.handleOf(system.indexOf(handles[i])), handles[i]);
+  }
+  // The last particle took the place of the removed one.
+  EXPECT_EQ(system.indexOf(handles[4]), 1);
+
+  // The slot is reused with a new generation.
+  auto it = system.pushParticle(CommonParticle{9.0, 0});
+  EXPECT_EQ(it.handle().slot, handles[1].slot);
+  EXPECT_NE(it.handle(), handles[1]);
+  EXPECT_FALSE(system.contains(handles[1]));
+
+  system.setVelocity(handles[3], Vector{0, 2, 0});
+  system.step(1.0);
+  EXPECT_EQ(system.at(handles[3]).position, (Cartesian3D{3, 2, 0}));
+}
+
+namespace {
+
+// A system which keeps a per-particle tag of its own.
+class TaggedSystem
+    : public BaseVerletIntegrator<TaggedSystem, Cartesian3D, CommonParticle> {
+  using Base = BaseVerletIntegrator<TaggedSystem, Cartesian3D, CommonParticle>;
+  friend Base;
+
+public:
+  void push(int tag) {
+    pushParticle(CommonParticle{1.0, 0});
+    tags.push_back(tag);
+  }
+
+  std::vector<int> tags;
+
+private:
+  [[nodiscard]] Vector calculateAccelerationImpl(auto) const {
+    return Vector{0, 0, 0};
+  }
+
+  void onSwapRemoveImpl(size_t from, size_t to) { tags[to] = tags[from]; }
+};
+
+} // namespace
+
+TEST(VerletIntegratorTest, SwapRemoveHook) {
+  TaggedSystem system;
+  for (auto tag : {10, 11, 12, 13}) {
+    system.push(tag);
+  }
+  auto handle = system.handleOf(3);
+  system.removeParticle(system.handleOf(0));
+  system.tags.pop_back();
+  EXPECT_EQ(system.tags, (std::vector{13, 11, 12}));
+  EXPECT_EQ(system.tags[system.indexOf(handle)], 13);
+}
+
+TEST(VerletIntegratorTest, RemovedBodyNoLongerAttracts) {
+  using System = GravityIntegrator<Cartesian3D, CommonParticle>;
+  auto push = [](System &system, int i) {
+    system.pushParticle(CommonParticle{1e10 * (i + 1), 0},
+                        Cartesian3D{10.0 * i, 1.0 * i * i, 0},
+                        Vector{0, 0.1 * i, 0});
+  };
+  System reduced, full;
+  for (auto i : {0, 2}) {
+    push(reduced, i);
+  }
+  for (auto i : {0, 1, 2}) {
+    push(full, i);
+  }
+  full.step(0.1);
+  // Take the second body out mid-run, as for an escaper.
+  auto handle = full.handleOf(2);
+  full.removeParticle(full.handleOf(1));
+  auto replay = full.at(handle);
+  reduced.setPosition(reduced.handleOf(1), replay.position);
+  reduced.setVelocity(reduced.handleOf(1), replay.velocity);
+  reduced.setPosition(reduced.handleOf(0), full[0].position);
+  reduced.setVelocity(reduced.handleOf(0), full[0].velocity);
+  for (auto i = 0; i < 10; ++i) {
+    full.step(0.1);
+    reduced.step(0.1);
+  }
+  EXPECT_EQ(full.at(handle).position, reduced[1].position);
+  EXPECT_EQ(full[0].position, reduced[0].position);
+}